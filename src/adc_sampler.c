@@ -0,0 +1,167 @@
+/* Background sampling of the analogue input, see adc_sampler.h
+ */
+
+#include <stdio.h>
+#include <FreeRTOS.h>
+#include <timers.h>
+#include "adc_sampler.h"
+#include "sensor_hal.h"
+#include "signal_filter.h"
+#include "sensor_trace.h"
+#include "burst_capture.h"
+
+
+typedef struct {
+    adc_window_t window;
+    signal_filter_t filter;
+    q16_t estimate;
+} adc_channel_t;
+
+
+static adc_channel_t adc_channels[ADC_MUX_CHANNELS];
+static TimerHandle_t adc_sampler_timer = NULL;
+static uint8_t adc_sampler_channel;         /* selected, sampled on the next tick */
+static uint32_t adc_sampler_selected_us;
+static volatile TickType_t adc_sampler_period;     /* of the timer outside a burst */
+static volatile bool adc_sampler_period_changed = false;
+static bool adc_sampler_bursting = false;
+static void (*adc_sampler_burst_callback)(void) = NULL;
+
+
+static void adc_sampler_burst_start(void){
+    /* the MQ135 alone, the first burst code is a tick away so it has settled by then */
+    if (ADC_MUX_CHANNELS > 1){
+        adc_sampler_channel = 0;
+        sensor_hal->adc_select(0);
+        adc_sampler_selected_us = sensor_hal->now_us();
+    }
+    adc_sampler_bursting = true;
+    xTimerChangePeriod(adc_sampler_timer, pdMS_TO_TICKS(BURST_PERIOD_MS), 0);
+    if (adc_sampler_burst_callback){
+        adc_sampler_burst_callback();
+    }
+}
+
+
+static void adc_sampler_burst_end(void){
+    /* scanning carries on from the MQ135, which is still selected */
+    adc_sampler_bursting = false;
+    xTimerChangePeriod(adc_sampler_timer, adc_sampler_period, 0);
+}
+
+
+static void adc_sampler_callback(TimerHandle_t timer){
+    adc_channel_t *channel = &adc_channels[adc_sampler_channel];
+    uint8_t sampled = adc_sampler_channel;
+    uint16_t raw;
+    q16_t clean, estimate;
+    uint16_t code;
+    uint32_t total;
+
+    if (adc_sampler_bursting){
+        /* burst codes only go to the capture, the windows keep the normal rate */
+        if (burst_capture_add(sensor_hal->adc_read(0))){
+            adc_sampler_burst_end();
+        }
+        return;
+    }
+
+    if (adc_sampler_period_changed){
+        /* changed here rather than by the caller, so it cannot cut into a burst */
+        adc_sampler_period_changed = false;
+        xTimerChangePeriod(adc_sampler_timer, adc_sampler_period, 0);
+    }
+
+    if (ADC_MUX_CHANNELS > 1){
+        if (sensor_hal->now_us() - adc_sampler_selected_us < ADC_MUX_SETTLE_US){
+            return;
+        }
+        raw = sensor_hal->adc_read(sampled);
+        /* the next channel settles while this sample is filtered */
+        adc_sampler_channel = (sampled + 1) % ADC_MUX_CHANNELS;
+        sensor_hal->adc_select(adc_sampler_channel);
+        adc_sampler_selected_us = sensor_hal->now_us();
+    } else {
+        raw = sensor_hal->adc_read(sampled);
+    }
+
+    clean = signal_filter_clean(&channel->filter, (q16_t) raw << 16);
+    estimate = signal_filter_smooth(&channel->filter, clean);
+    code = clean >> 16;     /* codes are whole numbers and so is the median of them */
+
+    taskENTER_CRITICAL();
+    adc_window_push(&channel->window, code);
+    channel->estimate = estimate;
+    total = channel->window.total;
+    taskEXIT_CRITICAL();
+    /* after the push, so a reading never counts a sample the trace has not reached. Only
+     * the first channel is traced, it is the one the replay runs the pipeline on */
+    if (sampled == 0){
+        trace_adc(raw, total);
+        if (burst_capture_sample(raw, sensor_hal->now_ms())){
+            adc_sampler_burst_start();
+        }
+    }
+}
+
+
+static TickType_t adc_sampler_ticks(uint32_t period_ms){
+    /* the channels share the timer, so it ticks that many times a period */
+    uint32_t tick_ms;
+
+    if (period_ms > ADC_SAMPLE_PERIOD_MAX_MS){
+        period_ms = ADC_SAMPLE_PERIOD_MAX_MS;
+    }
+    tick_ms = period_ms / ADC_MUX_CHANNELS;
+    return pdMS_TO_TICKS(tick_ms > ADC_SAMPLE_PERIOD_MIN_MS ? tick_ms : ADC_SAMPLE_PERIOD_MIN_MS);
+}
+
+
+bool adc_sampler_start(uint32_t period_ms){
+    const signal_filter_t filter = ADC_FILTER;
+    uint8_t i;
+
+    if (adc_sampler_timer != NULL){
+        return true;
+    }
+
+    for (i = 0; i < ADC_MUX_CHANNELS; i++){
+        adc_window_reset(&adc_channels[i].window);
+        adc_channels[i].filter = filter;
+        signal_filter_reset(&adc_channels[i].filter);
+    }
+    adc_sampler_channel = 0;
+    if (ADC_MUX_CHANNELS > 1){
+        sensor_hal->adc_select(0);
+        adc_sampler_selected_us = sensor_hal->now_us();
+    }
+    adc_sampler_period = adc_sampler_ticks(period_ms);
+    adc_sampler_timer = xTimerCreate("ADC sampler", adc_sampler_period, pdTRUE, NULL, adc_sampler_callback);
+    if (adc_sampler_timer == NULL || xTimerStart(adc_sampler_timer, 0) != pdPASS){
+        printf("%s: failed to start the sampler timer\n", __func__);
+        return false;
+    }
+    return true;
+}
+
+
+void adc_sampler_set_period(uint32_t period_ms){
+    adc_sampler_period = adc_sampler_ticks(period_ms);
+    adc_sampler_period_changed = true;
+}
+
+
+void adc_sampler_on_burst(void (*callback)(void)){
+    adc_sampler_burst_callback = callback;
+}
+
+
+void adc_sampler_snapshot(uint8_t channel, adc_snapshot_t *snapshot){
+    adc_channel_t *sampled = &adc_channels[channel < ADC_MUX_CHANNELS ? channel : 0];
+
+    taskENTER_CRITICAL();
+    adc_window_snapshot(&sampled->window, snapshot);
+    snapshot->filtered_q16 = sampled->estimate;
+    snapshot->filtered = Q16_TO_FLOAT(sampled->estimate);
+    taskEXIT_CRITICAL();
+}
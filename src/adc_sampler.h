@@ -0,0 +1,53 @@
+/* Background sampling of the analogue input into an adc_window_t, driven by a
+ * FreeRTOS software timer so that readers never have to wait on the ADC. Spikes
+ * are replaced by the signal_filter before a code reaches the window, which also
+ * keeps a smoothed level.
+ *
+ * With a multiplexer in front of the ADC every channel has its own window and
+ * filter, and each tick of the timer samples one channel round robin. The next
+ * channel is selected straight after the read, so it settles while the sample just
+ * taken is filtered and for the rest of the tick, and a tick that comes round
+ * before ADC_MUX_SETTLE_US have passed is skipped rather than waited out.
+ *
+ * Each code of the MQ135 is also passed to burst_capture. When it triggers, the
+ * timer runs at BURST_PERIOD_MS on the MQ135 alone until the capture is full, and
+ * then goes back to the normal period and scan. The trigger is also passed on to a
+ * callback, so a reader that polls slowly in a quiet room can be woken early.
+ *
+ * However long the reader polls, a channel is sampled at least every
+ * ADC_SAMPLE_PERIOD_MAX_MS, so the filter and the trigger keep up with a change.
+ */
+
+#ifndef __ADC_SAMPLER_H__
+#define __ADC_SAMPLER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "adc_window.h"
+#include "signal_filter.h"
+
+#define ADC_SAMPLE_PERIOD_MS    50      /* default time between samples of a channel */
+#define ADC_SAMPLE_PERIOD_MIN_MS 20     /* two ticks, the timer cannot run usefully faster */
+#define ADC_SAMPLE_PERIOD_MAX_MS 250    /* the trigger slope then spans a second */
+
+#ifndef ADC_MUX_CHANNELS
+#define ADC_MUX_CHANNELS        1       /* inputs of the multiplexer that are scanned, 1 without one */
+#endif
+#define ADC_MUX_SETTLE_US       1000    /* from switching the multiplexer to a stable reading */
+
+/* hampel window and threshold, floor of 2 codes, and noise variances in codes squared */
+#define ADC_FILTER              SIGNAL_FILTER(7, 3.0, 2.0, 0.05, 16.0)
+
+
+/* start scanning every channel, period_ms apart for each of them */
+bool adc_sampler_start(uint32_t period_ms);
+
+void adc_sampler_set_period(uint32_t period_ms);
+
+/* called in the timer task when a burst is triggered, it must not block */
+void adc_sampler_on_burst(void (*callback)(void));
+
+/* copy the current statistics of the window of a channel, never blocks */
+void adc_sampler_snapshot(uint8_t channel, adc_snapshot_t *snapshot);
+
+#endif
@@ -0,0 +1,73 @@
+/* Fixed size window over the most recent raw ADC codes, see adc_window.h
+ *
+ * The sum and sum of squares are adjusted on every push so the mean and variance
+ * are O(1), and a sorted copy of the window is maintained by insertion so the
+ * median is a lookup.
+ */
+
+#include <string.h>
+#include "adc_window.h"
+
+
+void adc_window_reset(adc_window_t *window){
+    memset(window, 0, sizeof(*window));
+}
+
+
+/* index of the first element in sorted that is not less than code */
+static uint16_t lower_bound(const uint16_t *sorted, uint16_t count, uint16_t code){
+    uint16_t low = 0, high = count;
+
+    while (low < high){
+        uint16_t mid = (low + high) / 2;
+        if (sorted[mid] < code){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+
+void adc_window_push(adc_window_t *window, uint16_t code){
+    uint16_t position;
+
+    if (window->count == ADC_WINDOW_SIZE){
+        /* evict the oldest sample, which is the one about to be overwritten */
+        uint16_t oldest = window->ring[window->head];
+        window->sum -= oldest;
+        window->sum_sq -= (uint32_t) oldest * oldest;
+        position = lower_bound(window->sorted, window->count, oldest);
+        memmove(&window->sorted[position], &window->sorted[position + 1], (window->count - position - 1) * sizeof(uint16_t));
+        window->count--;
+    }
+
+    window->ring[window->head] = code;
+    window->head = (window->head + 1) % ADC_WINDOW_SIZE;
+    window->sum += code;
+    window->sum_sq += (uint32_t) code * code;
+
+    position = lower_bound(window->sorted, window->count, code);
+    memmove(&window->sorted[position + 1], &window->sorted[position], (window->count - position) * sizeof(uint16_t));
+    window->sorted[position] = code;
+    window->count++;
+    window->total++;
+}
+
+
+void adc_window_snapshot(const adc_window_t *window, adc_snapshot_t *snapshot){
+    snapshot->count = window->count;
+    snapshot->total = window->total;
+    if (window->count == 0){
+        snapshot->latest = 0;
+        snapshot->median = 0;
+        snapshot->mean = 0;
+        snapshot->variance = 0;
+        return;
+    }
+    snapshot->latest = window->ring[(window->head + ADC_WINDOW_SIZE - 1) % ADC_WINDOW_SIZE];
+    snapshot->median = window->sorted[window->count / 2];
+    snapshot->mean = (float) window->sum / window->count;
+    snapshot->variance = (float) window->sum_sq / window->count - snapshot->mean * snapshot->mean;
+}
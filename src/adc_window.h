@@ -0,0 +1,43 @@
+/* Fixed size window over the most recent raw ADC codes, keeping the statistics
+ * up to date as each sample is pushed so that a reader only has to copy them.
+ */
+
+#ifndef __ADC_WINDOW_H__
+#define __ADC_WINDOW_H__
+
+#include <stdint.h>
+
+#define ADC_WINDOW_SIZE     64      /* raw codes kept, a 10 bit code squared times this must fit in 32 bits */
+
+
+typedef struct {
+    uint16_t count;                 /* samples currently in the window */
+    uint32_t total;                 /* samples pushed since the window was reset */
+    uint16_t latest;                /* most recent raw code */
+    uint16_t median;
+    float mean;
+    float variance;
+    float filtered;                 /* smoothed level with spikes removed, filled in by the adc sampler */
+    int32_t filtered_q16;           /* the same in Q16, for the fixed point build */
+} adc_snapshot_t;
+
+
+typedef struct {
+    uint16_t ring[ADC_WINDOW_SIZE]; /* samples in arrival order */
+    uint16_t sorted[ADC_WINDOW_SIZE];   /* the same samples in ascending order, for the median */
+    uint16_t head;                  /* next slot to write in ring */
+    uint16_t count;
+    uint32_t sum;
+    uint32_t sum_sq;
+    uint32_t total;
+} adc_window_t;
+
+
+void adc_window_reset(adc_window_t *window);
+
+/* add a sample, evicting the oldest one once the window is full */
+void adc_window_push(adc_window_t *window, uint16_t code);
+
+void adc_window_snapshot(const adc_window_t *window, adc_snapshot_t *snapshot);
+
+#endif
@@ -0,0 +1,303 @@
+/* Custom characteristics specific to the air quality sensor, visible in Eve. The
+ * shared ones come from custom_characteristics.h in esp-homekit-common-functions.
+ * The measurements that Eve graphs, the CO exposure and the gas statistics, are in
+ * its HOMEKIT_CUSTOM_UUID family, at F00001xx above the ones it defines, the
+ * settings and diagnostics of this sensor in a family of their own.
+ */
+
+#ifndef __AIR_QUALITY_CHARACTERISTICS_H__
+#define __AIR_QUALITY_CHARACTERISTICS_H__
+
+#include <homekit/types.h>
+#include <custom_characteristics.h>
+
+#define AIR_QUALITY_CUSTOM_UUID(value) (value "-6c2e-4a8d-9b3f-5d1a7e0c4b92")
+
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_AQI_STANDARD AIR_QUALITY_CUSTOM_UUID("F0000101")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_AQI_STANDARD(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_AQI_STANDARD, \
+    .description = "AQI Standard (0 US EPA, 1 EU CAQI, 2 UK DAQI)", \
+    .format = homekit_format_uint8, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_paired_write \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {2}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_UINT8_(_value), \
+    ##__VA_ARGS__
+
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_AQI_INDEX AIR_QUALITY_CUSTOM_UUID("F0000102")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_AQI_INDEX(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_AQI_INDEX, \
+    .description = "AQI Index", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {500}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_MQ135_RO AIR_QUALITY_CUSTOM_UUID("F0000103")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_MQ135_RO(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_MQ135_RO, \
+    .description = "MQ135 Ro", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {10000000}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_SAMPLED_MIN_FREE_HEAP AIR_QUALITY_CUSTOM_UUID("F0000104")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_SAMPLED_MIN_FREE_HEAP(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_SAMPLED_MIN_FREE_HEAP, \
+    .description = "Sampled Min Free Heap", \
+    .format = homekit_format_uint32, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .value = HOMEKIT_UINT32_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_MIN_STACK_FREE AIR_QUALITY_CUSTOM_UUID("F0000105")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_MIN_STACK_FREE(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_MIN_STACK_FREE, \
+    .description = "Min Stack Free", \
+    .format = homekit_format_uint32, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .value = HOMEKIT_UINT32_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_MAX_STAGE_KCYCLES AIR_QUALITY_CUSTOM_UUID("F0000106")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_MAX_STAGE_KCYCLES(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_MAX_STAGE_KCYCLES, \
+    .description = "Max Stage kCycles", \
+    .format = homekit_format_uint32, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .value = HOMEKIT_UINT32_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_POLL_MIN_PERIOD AIR_QUALITY_CUSTOM_UUID("F0000107")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_POLL_MIN_PERIOD(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_POLL_MIN_PERIOD, \
+    .description = "Poll Min Period (s)", \
+    .format = homekit_format_uint16, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_paired_write \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {1}, \
+    .max_value = (float[]) {600}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_UINT16_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_POLL_MAX_PERIOD AIR_QUALITY_CUSTOM_UUID("F0000108")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_POLL_MAX_PERIOD(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_POLL_MAX_PERIOD, \
+    .description = "Poll Max Period (s)", \
+    .format = homekit_format_uint16, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_paired_write \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {1}, \
+    .max_value = (float[]) {600}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_UINT16_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_TRACE_MODE AIR_QUALITY_CUSTOM_UUID("F0000109")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_TRACE_MODE(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_TRACE_MODE, \
+    .description = "Trace (0 off, 1 UDP, 2 flash)", \
+    .format = homekit_format_uint8, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_paired_write \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {2}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_UINT8_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CO_8H_TWA HOMEKIT_CUSTOM_UUID("F000010C")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_CO_8H_TWA(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_CO_8H_TWA, \
+    .description = "CO 8h TWA", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {100}, \
+    .min_step = (float[]) {0.1}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+/* statistics of each gas over the last hour and day, see window_stats.h. They all
+ * share the one declaration, with the type and description given per gas.
+ */
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_HOUR_AVERAGE     HOMEKIT_CUSTOM_UUID("F000010D")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_DAY_AVERAGE      HOMEKIT_CUSTOM_UUID("F000010E")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_DAY_MAX          HOMEKIT_CUSTOM_UUID("F000010F")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CO_HOUR_AVERAGE      HOMEKIT_CUSTOM_UUID("F0000110")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CO_DAY_AVERAGE       HOMEKIT_CUSTOM_UUID("F0000111")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CO_DAY_MAX           HOMEKIT_CUSTOM_UUID("F0000112")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_HOUR_AVERAGE    HOMEKIT_CUSTOM_UUID("F0000113")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_DAY_AVERAGE     HOMEKIT_CUSTOM_UUID("F0000114")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_DAY_MAX         HOMEKIT_CUSTOM_UUID("F0000115")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_HOUR_AVERAGE     HOMEKIT_CUSTOM_UUID("F0000116")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_DAY_AVERAGE      HOMEKIT_CUSTOM_UUID("F0000117")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_DAY_MAX          HOMEKIT_CUSTOM_UUID("F0000118")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_HOUR_AVERAGE     HOMEKIT_CUSTOM_UUID("F0000119")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_DAY_AVERAGE      HOMEKIT_CUSTOM_UUID("F000011A")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_DAY_MAX          HOMEKIT_CUSTOM_UUID("F000011B")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_HOUR_MIN         HOMEKIT_CUSTOM_UUID("F000011C")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_HOUR_MAX         HOMEKIT_CUSTOM_UUID("F000011D")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_DAY_MIN          HOMEKIT_CUSTOM_UUID("F000011E")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CO_HOUR_MIN          HOMEKIT_CUSTOM_UUID("F000011F")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CO_HOUR_MAX          HOMEKIT_CUSTOM_UUID("F0000120")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CO_DAY_MIN           HOMEKIT_CUSTOM_UUID("F0000121")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_HOUR_MIN        HOMEKIT_CUSTOM_UUID("F0000122")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_HOUR_MAX        HOMEKIT_CUSTOM_UUID("F0000123")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_DAY_MIN         HOMEKIT_CUSTOM_UUID("F0000124")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_HOUR_MIN         HOMEKIT_CUSTOM_UUID("F0000125")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_HOUR_MAX         HOMEKIT_CUSTOM_UUID("F0000126")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_DAY_MIN          HOMEKIT_CUSTOM_UUID("F0000127")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_HOUR_MIN         HOMEKIT_CUSTOM_UUID("F0000128")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_HOUR_MAX         HOMEKIT_CUSTOM_UUID("F0000129")
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_DAY_MIN          HOMEKIT_CUSTOM_UUID("F000012A")
+
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_GAS_STATISTIC(_type, _description, _value, ...) \
+    .type = _type, \
+    .description = _description, \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {10000}, \
+    .min_step = (float[]) {0.1}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+/* each MQ sensor on the multiplexer other than the MQ135 is a service of its own, so
+ * the same characteristic types repeat. The description is the key the value is saved
+ * to flash under, so it has to differ between channels.
+ */
+#define HOMEKIT_SERVICE_CUSTOM_MQ_CHANNEL AIR_QUALITY_CUSTOM_UUID("F0000201")
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_MQ_CHANNEL_PPM AIR_QUALITY_CUSTOM_UUID("F000010A")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_MQ_CHANNEL_PPM(_description, _value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_MQ_CHANNEL_PPM, \
+    .description = _description, \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {10000}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_MQ_CHANNEL_RO AIR_QUALITY_CUSTOM_UUID("F000010B")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_MQ_CHANNEL_RO(_description, _value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_MQ_CHANNEL_RO, \
+    .description = _description, \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {10000000}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+/* fast transients caught by burst_capture, and the trigger of a capture */
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_PEAK_CO AIR_QUALITY_CUSTOM_UUID("F000011C")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_BURST_PEAK_CO(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_PEAK_CO, \
+    .description = "Burst Peak CO (ppm)", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {10000}, \
+    .min_step = (float[]) {0.1}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_PEAK_LPG AIR_QUALITY_CUSTOM_UUID("F000011D")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_BURST_PEAK_LPG(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_PEAK_LPG, \
+    .description = "Burst Peak LPG (ppm)", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {10000}, \
+    .min_step = (float[]) {0.1}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_TIME_TO_PEAK AIR_QUALITY_CUSTOM_UUID("F000011E")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_BURST_TIME_TO_PEAK(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_TIME_TO_PEAK, \
+    .description = "Burst Time to Peak (s)", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {60}, \
+    .min_step = (float[]) {0.01}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_TRIGGER_LEVEL AIR_QUALITY_CUSTOM_UUID("F000011F")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_BURST_TRIGGER_LEVEL(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_TRIGGER_LEVEL, \
+    .description = "Burst Trigger Level (ADC, 0 off)", \
+    .format = homekit_format_uint16, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_paired_write \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {1023}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_UINT16_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_TRIGGER_SLOPE AIR_QUALITY_CUSTOM_UUID("F0000120")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_BURST_TRIGGER_SLOPE(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_BURST_TRIGGER_SLOPE, \
+    .description = "Burst Trigger Slope (ADC/s, 0 off)", \
+    .format = homekit_format_uint16, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_paired_write \
+    | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {1000}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_UINT16_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_EXPORT AIR_QUALITY_CUSTOM_UUID("F0000121")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_HISTORY_EXPORT(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_EXPORT, \
+    .description = "History Export (h)", \
+    .format = homekit_format_uint16, \
+    .permissions = homekit_permissions_paired_read \
+    | homekit_permissions_paired_write, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {720}, \
+    .min_step = (float[]) {1}, \
+    .value = HOMEKIT_UINT16_(_value), \
+    ##__VA_ARGS__
+
+#endif
@@ -0,0 +1,155 @@
+/* Air quality index calculation, see air_quality_index.h
+ */
+
+#include <math.h>
+#include "air_quality_index.h"
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+
+typedef struct {
+    const aqi_breakpoint_t *breakpoints;
+    uint8_t count;
+} aqi_scale_t;
+
+
+/* US EPA, CO 8 hour ppm and PM10 24 hour ug/m3 */
+static const aqi_breakpoint_t us_epa_co[] = {
+    {  0.0,  4.4,   0,  50, 1 },
+    {  4.5,  9.4,  51, 100, 2 },
+    {  9.5, 12.4, 101, 150, 3 },
+    { 12.5, 15.4, 151, 200, 4 },
+    { 15.5, 30.4, 201, 300, 5 },
+    { 30.5, 50.4, 301, 500, 5 },
+};
+
+static const aqi_breakpoint_t us_epa_pm10[] = {
+    {   0,  54,   0,  50, 1 },
+    {  55, 154,  51, 100, 2 },
+    { 155, 254, 101, 150, 3 },
+    { 255, 354, 151, 200, 4 },
+    { 355, 424, 201, 300, 5 },
+    { 425, 604, 301, 500, 5 },
+};
+
+/* EU CAQI hourly background index, CO converted from ug/m3 at 1.145 mg/m3 per ppm,
+ * the top band continues the slope of the one below */
+static const aqi_breakpoint_t eu_caqi_co[] = {
+    {  0.00,   4.37,   0,  25, 1 },
+    {  4.37,   6.55,  25,  50, 2 },
+    {  6.55,   8.73,  50,  75, 3 },
+    {  8.73,  17.47,  75, 100, 4 },
+    { 17.47, 100.00, 100, 336, 5 },
+};
+
+static const aqi_breakpoint_t eu_caqi_pm10[] = {
+    {   0,   25,   0,  25, 1 },
+    {  25,   50,  25,  50, 2 },
+    {  50,   90,  50,  75, 3 },
+    {  90,  180,  75, 100, 4 },
+    { 180, 1000, 100, 328, 5 },
+};
+
+/* UK DAQI, PM10 24 hour ug/m3, CO is not part of the index */
+static const aqi_breakpoint_t uk_daqi_pm10[] = {
+    {   0,   16,  1,  1, 1 },
+    {  17,   33,  2,  2, 2 },
+    {  34,   50,  3,  3, 2 },
+    {  51,   58,  4,  4, 3 },
+    {  59,   66,  5,  5, 3 },
+    {  67,   75,  6,  6, 3 },
+    {  76,   83,  7,  7, 4 },
+    {  84,   91,  8,  8, 4 },
+    {  92,  100,  9,  9, 4 },
+    { 101, 1000, 10, 10, 5 },
+};
+
+
+static const aqi_scale_t aqi_scales[AQI_STANDARD_COUNT][AQI_POLLUTANT_COUNT] = {
+    [AQI_STANDARD_US_EPA] = {
+        [AQI_POLLUTANT_CO]   = { us_epa_co, COUNT_OF(us_epa_co) },
+        [AQI_POLLUTANT_PM10] = { us_epa_pm10, COUNT_OF(us_epa_pm10) },
+    },
+    [AQI_STANDARD_EU_CAQI] = {
+        [AQI_POLLUTANT_CO]   = { eu_caqi_co, COUNT_OF(eu_caqi_co) },
+        [AQI_POLLUTANT_PM10] = { eu_caqi_pm10, COUNT_OF(eu_caqi_pm10) },
+    },
+    [AQI_STANDARD_UK_DAQI] = {
+        [AQI_POLLUTANT_PM10] = { uk_daqi_pm10, COUNT_OF(uk_daqi_pm10) },
+    },
+};
+
+
+static uint8_t aqi_standard = AQI_STANDARD;
+
+
+void aqi_set_standard(uint8_t standard){
+    if (standard < AQI_STANDARD_COUNT){
+        aqi_standard = standard;
+    }
+}
+
+
+uint8_t aqi_get_standard(void){
+    return aqi_standard;
+}
+
+
+float aqi_sub_index(uint8_t pollutant, float concentration, uint8_t *level){
+    const aqi_scale_t *scale;
+    const aqi_breakpoint_t *band;
+    uint8_t low = 0, high;
+
+    *level = 1;
+    if (pollutant >= AQI_POLLUTANT_COUNT || isnan(concentration)){
+        return -1;
+    }
+    scale = &aqi_scales[aqi_standard][pollutant];
+    if (scale->count == 0){
+        return -1;
+    }
+
+    /* last band starting at or below the concentration */
+    high = scale->count;
+    while (high - low > 1){
+        uint8_t mid = (low + high) / 2;
+        if (scale->breakpoints[mid].c_low <= concentration){
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    band = &scale->breakpoints[low];
+    *level = band->level;
+
+    if (concentration <= band->c_low){
+        return band->i_low;
+    }
+    if (concentration >= band->c_high){
+        /* above the top band, or in the rounding gap before the next band */
+        return band->i_high;
+    }
+    return band->i_low + (band->i_high - band->i_low) * (concentration - band->c_low) / (band->c_high - band->c_low);
+}
+
+
+void aqi_calculate(const float *concentration, aqi_result_t *result){
+    uint8_t pollutant, level;
+    float index;
+
+    result->index = 0;
+    result->level = 1;
+    result->dominant = AQI_POLLUTANT_NONE;
+    for (pollutant = 0; pollutant < AQI_POLLUTANT_COUNT; pollutant++){
+        index = aqi_sub_index(pollutant, concentration[pollutant], &level);
+        result->sub_index[pollutant] = index;
+        if (index < 0){
+            continue;
+        }
+        if (result->dominant == AQI_POLLUTANT_NONE || level > result->level || (level == result->level && index > result->index)){
+            result->index = index;
+            result->level = level;
+            result->dominant = pollutant;
+        }
+    }
+}
@@ -0,0 +1,54 @@
+/* Air quality index calculation driven by const breakpoint tables, one table per
+ * pollutant for each supported standard. Each pollutant's sub-index is found by a
+ * binary search over its breakpoints and linear interpolation within the band,
+ * the overall index is the worst sub-index.
+ */
+
+#ifndef __AIR_QUALITY_INDEX_H__
+#define __AIR_QUALITY_INDEX_H__
+
+#include <stdint.h>
+
+/* standards */
+#define AQI_STANDARD_US_EPA         0
+#define AQI_STANDARD_EU_CAQI        1
+#define AQI_STANDARD_UK_DAQI        2
+#define AQI_STANDARD_COUNT          3
+
+#ifndef AQI_STANDARD
+#define AQI_STANDARD                AQI_STANDARD_US_EPA     /* default, can be changed at runtime */
+#endif
+
+/* pollutants */
+#define AQI_POLLUTANT_CO            0       /* ppm */
+#define AQI_POLLUTANT_PM10          1       /* ug/m3 */
+#define AQI_POLLUTANT_COUNT         2
+#define AQI_POLLUTANT_NONE          0xff
+
+
+typedef struct {
+    float c_low, c_high;            /* concentration band */
+    float i_low, i_high;            /* index over the band */
+    uint8_t level;                  /* homekit air quality, 1 excellent to 5 poor */
+} aqi_breakpoint_t;
+
+
+typedef struct {
+    float index;                    /* worst sub-index, in the units of the standard */
+    uint8_t level;                  /* homekit air quality of the worst sub-index */
+    uint8_t dominant;               /* pollutant giving the index, AQI_POLLUTANT_NONE if none */
+    float sub_index[AQI_POLLUTANT_COUNT];
+} aqi_result_t;
+
+
+void aqi_set_standard(uint8_t standard);
+
+uint8_t aqi_get_standard(void);
+
+/* sub-index of one pollutant in the current standard, negative if the standard does not rate it */
+float aqi_sub_index(uint8_t pollutant, float concentration, uint8_t *level);
+
+/* concentration is indexed by AQI_POLLUTANT_*, NAN for pollutants not measured */
+void aqi_calculate(const float *concentration, aqi_result_t *result);
+
+#endif
@@ -0,0 +1,104 @@
+/* Deferred binary logging, see binlog.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+#include "binlog.h"
+#include "deferred_work.h"
+#include "sensor_hal.h"
+
+#define BINLOG_PACKET_RECORDS       (BINLOG_RING_SIZE / 2)
+
+
+static binlog_record_t binlog_ring[BINLOG_RING_SIZE];
+static uint16_t binlog_head = 0;
+static uint16_t binlog_count = 0;
+static uint32_t binlog_dropped = 0;
+
+static struct {
+    binlog_packet_header_t header;
+    binlog_record_t record[BINLOG_PACKET_RECORDS];
+} binlog_packet;
+
+
+void binlog_write(binlog_id_t id, uint8_t level, uint8_t count, const uint32_t *arg){
+    uint32_t now = sensor_hal->now_ms();
+    binlog_record_t *record;
+
+    if (count > BINLOG_MAX_ARGS){
+        count = BINLOG_MAX_ARGS;
+    }
+
+    taskENTER_CRITICAL();
+    if (binlog_count == BINLOG_RING_SIZE){
+        binlog_dropped++;
+        taskEXIT_CRITICAL();
+        return;
+    }
+    record = &binlog_ring[(binlog_head + binlog_count) % BINLOG_RING_SIZE];
+    binlog_count++;
+    record->time_ms = now;
+    record->id = id;
+    record->level = level;
+    record->count = count;
+    memcpy(record->arg, arg, count * sizeof(uint32_t));
+    taskEXIT_CRITICAL();
+}
+
+
+/* move up to a packet of records out of the ring, returns how many */
+static uint16_t binlog_take(void){
+    uint16_t count = 0;
+
+    taskENTER_CRITICAL();
+    while (binlog_count > 0 && count < BINLOG_PACKET_RECORDS){
+        binlog_packet.record[count++] = binlog_ring[binlog_head];
+        binlog_head = (binlog_head + 1) % BINLOG_RING_SIZE;
+        binlog_count--;
+    }
+    binlog_packet.header.dropped = binlog_dropped;
+    taskEXIT_CRITICAL();
+    return count;
+}
+
+
+static void binlog_drain(void);
+static deferred_work_t binlog_work = DEFERRED_WORK("Binlog", binlog_drain, BINLOG_DRAIN_PERIOD_MS);
+static int binlog_socket = -1;
+
+
+static void binlog_drain(void){
+    struct sockaddr_in address;
+    int broadcast = 1;
+    uint16_t count;
+
+    if (binlog_socket < 0){
+        /* records stay in the ring until the network is up */
+        binlog_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (binlog_socket < 0){
+            return;
+        }
+        setsockopt(binlog_socket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+    }
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(BINLOG_PORT);
+    address.sin_addr.s_addr = INADDR_BROADCAST;
+    while ((count = binlog_take()) > 0){
+        binlog_packet.header.count = count;
+        sendto(binlog_socket, &binlog_packet, sizeof(binlog_packet.header) + count * sizeof(binlog_record_t), 0,
+            (struct sockaddr *) &address, sizeof(address));
+    }
+}
+
+
+void binlog_init(void){
+    binlog_packet.header.magic = BINLOG_MAGIC;
+    binlog_packet.header.version = BINLOG_VERSION;
+    if (!deferred_work_add(&binlog_work)){
+        printf("%s: failed to add the drain\n", __func__);
+    }
+}
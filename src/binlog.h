@@ -0,0 +1,117 @@
+/* Deferred binary logging for the sensor loop. A log call stores a fixed size
+ * record of the format id and its raw 32 bit arguments in a RAM ring, no
+ * formatting is done on the device. The deferred work task drains the ring as UDP
+ * broadcasts, which tools/binlog_decode.py turns back into text using the format
+ * table below. Calls above BINLOG_LEVEL are removed by the preprocessor, arguments
+ * included.
+ */
+
+#ifndef __BINLOG_H__
+#define __BINLOG_H__
+
+#include <stdint.h>
+
+#define BINLOG_LEVEL_ERROR          1
+#define BINLOG_LEVEL_WARN           2
+#define BINLOG_LEVEL_INFO           3
+#define BINLOG_LEVEL_DEBUG          4
+
+#ifndef BINLOG_LEVEL
+#define BINLOG_LEVEL                BINLOG_LEVEL_INFO
+#endif
+
+#define BINLOG_MAX_ARGS             6
+#define BINLOG_RING_SIZE            32          /* records held until the drain sends them */
+#define BINLOG_DRAIN_PERIOD_MS      1000
+#define BINLOG_PORT                 45680       /* next to the perf report port */
+#define BINLOG_MAGIC                0x474f4c42  /* "BLOG" */
+#define BINLOG_VERSION              1
+
+
+/* every message, the decoder reads this table from this file. Ids are the position
+ * in the table, so add new messages at the end. Arguments are %u, %i or %x for
+ * integers and %f for floats passed through binlog_f, strings are not supported.
+ */
+#define BINLOG_FORMATS(X) \
+    X(MQ_ADC,               "ADC filtered %f, mean %f, median %u, variance %f over %u samples") \
+    X(MQ_RATIO,             "RS_RO Ratio is %f") \
+    X(MQ_READING,           "correction factor %f, air quality %u, index %f, Rs %f") \
+    X(MQ_PPM,               "LPG %f, CO %f, PM10 %f, CH4 %f, NH4 %f") \
+    X(DHT_READING,          "Got readings: temperature %f, humidity %f") \
+    X(DHT_FAILED,           "Couldnt read data from temperate & humidity sensor, status %u") \
+    X(AIR_QUALITY_LEVEL,    "Got air quality level: %u") \
+    X(BURST_CAPTURE,        "burst from %f to %f, %u ms to peak, LPG %f, CO %f") \
+    X(GAS_MINUTE_STATS,     "gas %u over the last minute: min %f, max %f, mean %f, time weighted %f")
+
+#define BINLOG_ID(id, format)       BINLOG_##id,
+typedef enum {
+    BINLOG_FORMATS(BINLOG_ID)
+    BINLOG_FORMAT_COUNT
+} binlog_id_t;
+#undef BINLOG_ID
+
+
+/* fixed size record, little endian as sent by the ESP8266 */
+typedef struct {
+    uint32_t time_ms;
+    uint16_t id;
+    uint8_t level;
+    uint8_t count;
+    uint32_t arg[BINLOG_MAX_ARGS];
+} binlog_record_t;
+
+
+/* header of each UDP datagram, followed by count records */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t dropped;               /* records lost to a full ring since boot */
+} binlog_packet_header_t;
+
+
+/* raw bits of a float argument */
+static inline uint32_t binlog_f(float value){
+    union { float f; uint32_t u; } bits = { .f = value };
+    return bits.u;
+}
+
+
+/* start the periodic drain, records written before this are kept until the ring is full */
+void binlog_init(void);
+
+void binlog_write(binlog_id_t id, uint8_t level, uint8_t count, const uint32_t *arg);
+
+
+/* the leading 0 allows messages without arguments, it is skipped */
+#define BINLOG_WRITE(level, id, ...) \
+    binlog_write(BINLOG_##id, level, sizeof((uint32_t[]){0, ##__VA_ARGS__}) / sizeof(uint32_t) - 1, \
+        (uint32_t[]){0, ##__VA_ARGS__} + 1)
+
+#define BINLOG_NONE(id, ...)        do {} while (0)
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_ERROR
+#define BINLOG_ERROR(id, ...)       BINLOG_WRITE(BINLOG_LEVEL_ERROR, id, ##__VA_ARGS__)
+#else
+#define BINLOG_ERROR                BINLOG_NONE
+#endif
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_WARN
+#define BINLOG_WARN(id, ...)        BINLOG_WRITE(BINLOG_LEVEL_WARN, id, ##__VA_ARGS__)
+#else
+#define BINLOG_WARN                 BINLOG_NONE
+#endif
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_INFO
+#define BINLOG_INFO(id, ...)        BINLOG_WRITE(BINLOG_LEVEL_INFO, id, ##__VA_ARGS__)
+#else
+#define BINLOG_INFO                 BINLOG_NONE
+#endif
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_DEBUG
+#define BINLOG_DEBUG(id, ...)       BINLOG_WRITE(BINLOG_LEVEL_DEBUG, id, ##__VA_ARGS__)
+#else
+#define BINLOG_DEBUG                BINLOG_NONE
+#endif
+
+#endif
@@ -0,0 +1,155 @@
+/* Capture of fast gas transients, see burst_capture.h
+ *
+ * The sampler timer and the sensor task hand the buffers over through the state:
+ * only the timer writes them while armed or capturing, and only the sensor task
+ * reads them once the capture is done, until it moves the state on to the holdoff.
+ */
+
+#include "burst_capture.h"
+
+
+typedef enum {
+    BURST_ARMED = 0,
+    BURST_CAPTURING,
+    BURST_DONE,                     /* waiting for the sensor task to take the result */
+    BURST_HOLDOFF,
+} burst_state_t;
+
+
+static uint16_t pre_code[BURST_PRE_SAMPLES];
+static uint32_t pre_ms[BURST_PRE_SAMPLES];
+static uint8_t pre_head;
+static uint8_t pre_count;
+static uint16_t post_code[BURST_POST_SAMPLES];
+static uint16_t post_count;
+static uint32_t trigger_ms;
+static uint32_t holdoff_start_ms;
+static volatile uint8_t burst_state = BURST_ARMED;
+
+static volatile uint16_t trigger_level = BURST_TRIGGER_LEVEL;
+static volatile uint16_t trigger_slope = BURST_TRIGGER_SLOPE;
+static uint8_t level_run;           /* samples in a row over the level */
+static uint8_t slope_run;           /* samples in a row rising faster than the slope */
+
+
+void burst_capture_set_trigger(uint16_t level, uint16_t slope){
+    trigger_level = level;
+    trigger_slope = slope;
+}
+
+
+static uint8_t burst_run(uint8_t run, bool over){
+    if (!over){
+        return 0;
+    }
+    return run < UINT8_MAX ? run + 1 : run;
+}
+
+
+bool burst_capture_sample(uint16_t code, uint32_t now_ms){
+    uint16_t level = trigger_level, slope = trigger_slope;
+    bool slope_over = false;
+    uint32_t elapsed;
+    uint8_t back;
+
+    if (burst_state == BURST_CAPTURING || burst_state == BURST_DONE){
+        /* the history of the capture is kept until its result has been taken */
+        return false;
+    }
+
+    if (slope > 0 && pre_count >= BURST_SLOPE_SAMPLES){
+        back = (pre_head + BURST_PRE_SAMPLES - BURST_SLOPE_SAMPLES) % BURST_PRE_SAMPLES;
+        elapsed = now_ms - pre_ms[back];
+        slope_over = elapsed > 0 && code > pre_code[back] && (uint32_t) (code - pre_code[back]) * 1000 >= (uint32_t) slope * elapsed;
+    }
+    level_run = burst_run(level_run, level > 0 && code >= level);
+    slope_run = burst_run(slope_run, slope_over);
+
+    pre_code[pre_head] = code;
+    pre_ms[pre_head] = now_ms;
+    pre_head = (pre_head + 1) % BURST_PRE_SAMPLES;
+    if (pre_count < BURST_PRE_SAMPLES){
+        pre_count++;
+    }
+
+    if (burst_state == BURST_HOLDOFF){
+        if (now_ms - holdoff_start_ms < BURST_HOLDOFF_MS){
+            return false;
+        }
+        burst_state = BURST_ARMED;
+    }
+    /* only on reaching the count, so a level that stays crossed does not trigger again */
+    if (level_run != BURST_CONFIRM && slope_run != BURST_CONFIRM){
+        return false;
+    }
+    trigger_ms = now_ms;
+    post_count = 0;
+    burst_state = BURST_CAPTURING;
+    return true;
+}
+
+
+bool burst_capture_add(uint16_t code){
+    if (burst_state != BURST_CAPTURING){
+        return true;
+    }
+    post_code[post_count++] = code;
+    if (post_count < BURST_POST_SAMPLES){
+        return false;
+    }
+    burst_state = BURST_DONE;
+    return true;
+}
+
+
+bool burst_capture_result(burst_result_t *result){
+    uint32_t sum = 0, best = 0, peak_ms, onset_ms = trigger_ms;
+    uint16_t i, best_end = 0;
+    uint8_t oldest, half, j, index;
+    float threshold;
+
+    if (burst_state != BURST_DONE){
+        return false;
+    }
+
+    /* the older half of the history is taken to be from before the rise */
+    oldest = (pre_head + BURST_PRE_SAMPLES - pre_count) % BURST_PRE_SAMPLES;
+    half = pre_count > 1 ? pre_count / 2 : pre_count;
+    for (j = 0; j < half; j++){
+        sum += pre_code[(oldest + j) % BURST_PRE_SAMPLES];
+    }
+    result->baseline = half ? (float) sum / half : post_code[0];
+
+    sum = 0;
+    for (i = 0; i < post_count; i++){
+        sum += post_code[i];
+        if (i >= BURST_PEAK_SAMPLES){
+            sum -= post_code[i - BURST_PEAK_SAMPLES];
+        }
+        if (i + 1 >= BURST_PEAK_SAMPLES && sum > best){
+            best = sum;
+            best_end = i;
+        }
+    }
+    result->peak = (float) best / BURST_PEAK_SAMPLES;
+    /* the first sample is a period after the trigger, the peak is the middle of its samples */
+    peak_ms = trigger_ms + (best_end + 1) * BURST_PERIOD_MS - (BURST_PEAK_SAMPLES - 1) * BURST_PERIOD_MS / 2;
+
+    /* back from the trigger through the history while the code is still above the start of the rise */
+    threshold = result->baseline + (result->peak - result->baseline) * BURST_ONSET_FRACTION;
+    for (j = 0; j < pre_count; j++){
+        index = (pre_head + BURST_PRE_SAMPLES - 1 - j) % BURST_PRE_SAMPLES;
+        if (pre_code[index] <= threshold){
+            break;
+        }
+        onset_ms = pre_ms[index];
+    }
+
+    result->trigger_ms = trigger_ms;
+    result->time_to_peak_ms = peak_ms - onset_ms;
+    result->samples = post_count;
+
+    holdoff_start_ms = trigger_ms + post_count * BURST_PERIOD_MS;
+    burst_state = BURST_HOLDOFF;
+    return true;
+}
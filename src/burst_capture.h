@@ -0,0 +1,55 @@
+/* Capture of fast gas transients. At the normal sample rate the raw codes of the
+ * MQ135 are kept in a short ring, and each is checked against a trigger: the code
+ * rising through a level, or rising faster than a slope. Either has to hold for
+ * BURST_CONFIRM samples in a row, so a single garbage frame does not trigger, and a
+ * level that stays crossed does not trigger again. On a trigger the adc sampler
+ * reads the MQ135 alone at BURST_PERIOD_MS into a fixed buffer for BURST_POST_MS.
+ *
+ * The sampler timer only records codes, all the work on them is done when the
+ * sensor task picks the result up: the peak of the capture, and the time to it
+ * from the start of the rise, which is found in the history from before the
+ * trigger. Every buffer is static, nothing is allocated.
+ */
+
+#ifndef __BURST_CAPTURE_H__
+#define __BURST_CAPTURE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BURST_PRE_SAMPLES       32      /* raw codes kept from before a trigger, at the normal rate */
+#define BURST_PERIOD_MS         10      /* one tick, the fastest the sampler timer runs */
+#define BURST_POST_MS           4000
+#define BURST_POST_SAMPLES      (BURST_POST_MS / BURST_PERIOD_MS)
+#define BURST_SLOPE_SAMPLES     4       /* the slope is taken over this many samples at the normal rate */
+#define BURST_CONFIRM           2       /* samples in a row over the trigger */
+#define BURST_PEAK_SAMPLES      4       /* the peak is the highest mean of this many samples in a row */
+#define BURST_ONSET_FRACTION    0.1     /* of the rise from the baseline to the peak, where the rise starts */
+#define BURST_HOLDOFF_MS        30000   /* after a result before the next trigger */
+
+#define BURST_TRIGGER_LEVEL     0       /* default adc code, 0 to trigger on the slope only */
+#define BURST_TRIGGER_SLOPE     40      /* default adc codes a second, 0 to trigger on the level only */
+
+
+typedef struct {
+    uint32_t trigger_ms;
+    float baseline;                 /* mean code of the older half of the history */
+    float peak;                     /* highest mean code over BURST_PEAK_SAMPLES */
+    uint32_t time_to_peak_ms;       /* from the start of the rise */
+    uint16_t samples;               /* captured after the trigger */
+} burst_result_t;
+
+
+/* both 0 turns the trigger off */
+void burst_capture_set_trigger(uint16_t level, uint16_t slope);
+
+/* a code at the normal rate, returns true when it triggers a burst */
+bool burst_capture_sample(uint16_t code, uint32_t now_ms);
+
+/* a code at the burst rate, returns true when the capture is complete */
+bool burst_capture_add(uint16_t code);
+
+/* true once for each complete capture, the trigger is armed again after the holdoff */
+bool burst_capture_result(burst_result_t *result);
+
+#endif
@@ -0,0 +1,451 @@
+/* Persistent settings in flash, see config_store.h
+ *
+ * A record is a header followed by an item for every setting. Records are
+ * programmed with the magic left erased and the magic written last, so one
+ * interrupted by a reset is never taken as valid, and a checksum covers the rest.
+ * The space an interrupted record took is skipped, the next one is appended
+ * after it.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <spiflash.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include "config_store.h"
+#include "sensor_hal.h"
+#include "deferred_work.h"
+#if CONFIG_FLASH_SECTORS == 0
+#include <shared_functions.h>
+#endif
+
+#define CONFIG_RECORD_MAGIC     0x4353
+#define CONFIG_BLANK_MAGIC      0xffff
+#define CONFIG_RECORD_VERSION   1
+#define CONFIG_REGION_SIZE      (CONFIG_FLASH_SECTORS * CONFIG_SECTOR_SIZE)
+#define CONFIG_RECORD_SIZE(n)   (sizeof(config_header_t) + (n) * sizeof(config_item_t))
+
+#if CONFIG_FLASH_SECTORS == 1
+#error "CONFIG_FLASH_SECTORS must be at least 2, the newest record is kept while the next sector is erased"
+#endif
+#if CONFIG_STORE_MAX_ENTRIES > 32
+#error "CONFIG_STORE_MAX_ENTRIES is limited by the dirty mask"
+#endif
+
+
+typedef struct {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t count;                  /* items that follow */
+    uint32_t sequence;
+    uint32_t checksum;              /* of everything after the magic but the checksum itself */
+} config_header_t;
+
+typedef struct {
+    uint8_t id;
+    uint8_t format;                 /* homekit_format_t of the value */
+    uint16_t reserved;
+    uint32_t value;                 /* the int, bool or the bits of the float */
+} config_item_t;
+
+typedef struct {
+    config_header_t header;
+    config_item_t item[CONFIG_STORE_MAX_ENTRIES];
+} config_record_t;
+
+
+static const config_entry_t *config_entries;
+static uint8_t config_count;
+static uint32_t config_written[CONFIG_STORE_MAX_ENTRIES];  /* values in the newest record */
+static uint32_t config_written_mask = 0;                   /* entries the newest record has */
+static volatile uint32_t config_dirty = 0;
+static uint32_t config_first_change_ms;
+static uint32_t config_last_change_ms;
+static uint32_t config_offset = 0;                         /* of the next record in the region */
+static uint32_t config_sequence = 0;
+static config_record_t config_record;
+static SemaphoreHandle_t config_lock = NULL;
+static SemaphoreHandle_t config_commit_lock = NULL;
+static void config_store_write(void);
+static deferred_work_t config_work = DEFERRED_WORK("Config", config_store_write, 0);
+
+
+static bool config_format_supported(homekit_format_t format){
+    switch (format){
+        case homekit_format_bool:
+        case homekit_format_uint8:
+        case homekit_format_uint16:
+        case homekit_format_uint32:
+        case homekit_format_int:
+        case homekit_format_float:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static uint32_t config_value_encode(homekit_value_t value){
+    uint32_t raw;
+
+    switch (value.format){
+        case homekit_format_float:
+            memcpy(&raw, &value.float_value, sizeof(raw));
+            return raw;
+        case homekit_format_bool:
+            return value.bool_value;
+        default:
+            return value.int_value;
+    }
+}
+
+
+static void config_value_decode(homekit_value_t *value, uint32_t raw){
+    switch (value->format){
+        case homekit_format_float:
+            memcpy(&value->float_value, &raw, sizeof(raw));
+            break;
+        case homekit_format_bool:
+            value->bool_value = raw != 0;
+            break;
+        default:
+            value->int_value = raw;
+            break;
+    }
+}
+
+
+#if CONFIG_FLASH_SECTORS > 0
+
+/* FNV-1a over the header after the magic and up to the checksum, then the items */
+static uint32_t config_checksum(const config_record_t *record){
+    const uint8_t *byte = (const uint8_t *) record;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = offsetof(config_header_t, version); i < offsetof(config_header_t, checksum); i++){
+        hash = (hash ^ byte[i]) * 16777619u;
+    }
+    for (i = sizeof(config_header_t); i < CONFIG_RECORD_SIZE(record->header.count); i++){
+        hash = (hash ^ byte[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+static bool config_header_blank(const config_header_t *header){
+    const uint8_t *byte = (const uint8_t *) header;
+    size_t i;
+
+    for (i = 0; i < sizeof(*header); i++){
+        if (byte[i] != 0xff){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* read a whole record into config_record, true if it is complete and intact */
+static bool config_read_record(uint32_t offset, const config_header_t *header){
+    if (header->magic != CONFIG_RECORD_MAGIC || header->version != CONFIG_RECORD_VERSION){
+        return false;
+    }
+    spiflash_read(CONFIG_FLASH_BASE_ADDR + offset, (uint8_t *) &config_record, CONFIG_RECORD_SIZE(header->count));
+    return config_record.header.checksum == config_checksum(&config_record);
+}
+
+
+/* set the characteristics from config_record */
+static void config_apply(void){
+    const config_item_t *item;
+    homekit_characteristic_t *characteristic;
+    uint8_t i, j;
+
+    for (i = 0; i < config_record.header.count; i++){
+        item = &config_record.item[i];
+        for (j = 0; j < config_count && config_entries[j].id != item->id; j++){
+        }
+        if (j == config_count){
+            continue;
+        }
+        characteristic = config_entries[j].characteristic;
+        if (characteristic->value.format != item->format){
+            /* the setting has changed type, keep the default */
+            continue;
+        }
+        config_value_decode(&characteristic->value, item->value);
+        config_written[j] = item->value;
+        config_written_mask |= 1UL << j;
+    }
+}
+
+
+/* find the newest record and set the characteristics from it, false if there is none */
+static bool config_load(void){
+    config_header_t header;
+    uint32_t sector_end[CONFIG_FLASH_SECTORS];
+    uint32_t offset, end, newest = CONFIG_REGION_SIZE, newest_sequence = 0;
+    uint8_t sector;
+
+    for (sector = 0; sector < CONFIG_FLASH_SECTORS; sector++){
+        offset = sector * CONFIG_SECTOR_SIZE;
+        end = offset + CONFIG_SECTOR_SIZE;
+        while (offset + sizeof(header) <= end){
+            spiflash_read(CONFIG_FLASH_BASE_ADDR + offset, (uint8_t *) &header, sizeof(header));
+            if (config_header_blank(&header)){
+                break;
+            }
+            if (header.count == 0 || header.count > CONFIG_STORE_MAX_ENTRIES || offset + CONFIG_RECORD_SIZE(header.count) > end){
+                /* not written by this store, so nothing more can be appended to the sector */
+                offset = end;
+                break;
+            }
+            if (config_read_record(offset, &header)
+                && (newest == CONFIG_REGION_SIZE || (int32_t) (header.sequence - newest_sequence) > 0)){
+                newest = offset;
+                newest_sequence = header.sequence;
+            }
+            offset += CONFIG_RECORD_SIZE(header.count);
+        }
+        sector_end[sector] = offset;
+    }
+
+    if (newest < CONFIG_REGION_SIZE){
+        spiflash_read(CONFIG_FLASH_BASE_ADDR + newest, (uint8_t *) &header, sizeof(header));
+        config_read_record(newest, &header);
+        config_apply();
+        config_sequence = newest_sequence + 1;
+        /* after the newest record, or the next sector if its sector is full */
+        config_offset = sector_end[newest / CONFIG_SECTOR_SIZE] % CONFIG_REGION_SIZE;
+    }
+    printf("%s: next record at %u, sequence %u\n", __func__, config_offset, config_sequence);
+    return newest < CONFIG_REGION_SIZE;
+}
+
+
+/* write config_record after the newest record, false on a flash error */
+static bool config_append(void){
+    uint32_t address, size;
+    bool ok = true;
+
+    size = CONFIG_RECORD_SIZE(config_count);
+    if (config_offset % CONFIG_SECTOR_SIZE + size > CONFIG_SECTOR_SIZE){
+        config_offset = (config_offset / CONFIG_SECTOR_SIZE + 1) * CONFIG_SECTOR_SIZE % CONFIG_REGION_SIZE;
+    }
+    address = CONFIG_FLASH_BASE_ADDR + config_offset;
+    if (config_offset % CONFIG_SECTOR_SIZE == 0){
+        /* the newest record is in the sector before, so nothing current is lost */
+        ok = spiflash_erase_sector(address);
+    }
+
+    config_record.header.magic = CONFIG_BLANK_MAGIC;
+    config_record.header.version = CONFIG_RECORD_VERSION;
+    config_record.header.count = config_count;
+    config_record.header.sequence = config_sequence++;
+    config_record.header.checksum = config_checksum(&config_record);
+    ok = ok && spiflash_write(address, (uint8_t *) &config_record, size);
+    config_record.header.magic = CONFIG_RECORD_MAGIC;
+    ok = ok && spiflash_write(address, (uint8_t *) &config_record, 4);
+    /* an interrupted or failed record is skipped like one cut short by a reset */
+    config_offset = (config_offset + size) % CONFIG_REGION_SIZE;
+    if (!ok){
+        printf("%s: failed to write record %u\n", __func__, config_record.header.sequence);
+    }
+    return ok;
+}
+
+#else
+
+/* without a region every setting is kept in sysparam, which the sdk reserves */
+static bool config_load(void){
+    uint8_t i;
+
+    for (i = 0; i < config_count; i++){
+        load_characteristic_from_flash(config_entries[i].characteristic);
+        config_written[i] = config_value_encode(config_entries[i].characteristic->value);
+    }
+    config_written_mask = (1UL << config_count) - 1;
+    printf("%s: no flash region, settings are kept in sysparam\n", __func__);
+    return true;
+}
+
+
+/* write the settings of config_record that have changed, still one sysparam write each */
+static bool config_append(void){
+    homekit_characteristic_t *characteristic;
+    homekit_value_t value;
+    uint8_t i;
+
+    for (i = 0; i < config_count; i++){
+        if (config_written[i] == config_record.item[i].value){
+            continue;
+        }
+        characteristic = config_entries[i].characteristic;
+        value = characteristic->value;
+        config_value_decode(&value, config_record.item[i].value);
+        save_characteristic_to_flash(characteristic, value);
+    }
+    return true;
+}
+
+#endif
+
+
+/* from now until the dirty settings are due */
+static uint32_t config_store_wait(void){
+    uint32_t now = sensor_hal->now_ms();
+    uint32_t quiet = now - config_last_change_ms, waited = now - config_first_change_ms;
+    uint32_t debounce = quiet < CONFIG_STORE_DEBOUNCE_MS ? CONFIG_STORE_DEBOUNCE_MS - quiet : 0;
+    uint32_t limit = waited < CONFIG_STORE_MAX_DELAY_MS ? CONFIG_STORE_MAX_DELAY_MS - waited : 0;
+
+    return debounce < limit ? debounce : limit;
+}
+
+
+static void config_store_write(void){
+    if (config_store_due()){
+        config_store_commit();
+    } else if (config_dirty){
+        /* changed again since this run was scheduled */
+        deferred_work_schedule(&config_work, config_store_wait());
+    }
+}
+
+
+bool config_store_init(const config_entry_t *entries, uint8_t count){
+    bool found;
+    uint8_t i;
+
+    if (count > CONFIG_STORE_MAX_ENTRIES){
+        printf("%s: %u settings, only %u are stored\n", __func__, count, CONFIG_STORE_MAX_ENTRIES);
+        count = CONFIG_STORE_MAX_ENTRIES;
+    }
+    for (i = 0; i < count; i++){
+        if (!config_format_supported(entries[i].characteristic->value.format)){
+            printf("%s: %s cannot be stored\n", __func__, entries[i].characteristic->description);
+        }
+    }
+    config_entries = entries;
+    config_count = count;
+    config_written_mask = 0;
+    config_dirty = 0;
+    config_offset = 0;
+    config_sequence = 0;
+
+    config_lock = xSemaphoreCreateMutex();
+    config_commit_lock = xSemaphoreCreateMutex();
+    if (config_lock == NULL || config_commit_lock == NULL){
+        printf("%s: failed to create locks\n", __func__);
+        config_lock = NULL;
+        return false;
+    }
+
+    found = config_load();
+
+    if (!deferred_work_add(&config_work)){
+        printf("%s: failed to add the writer\n", __func__);
+    }
+    return found;
+}
+
+
+void config_store_set(homekit_characteristic_t *characteristic){
+    uint32_t now = sensor_hal->now_ms();
+    uint8_t i;
+
+    if (config_lock == NULL){
+        printf("%s: not initialised, %s not stored\n", __func__, characteristic->description);
+        return;
+    }
+    for (i = 0; i < config_count && config_entries[i].characteristic != characteristic; i++){
+    }
+    if (i == config_count){
+        printf("%s: %s is not a stored setting\n", __func__, characteristic->description);
+        return;
+    }
+
+    xSemaphoreTake(config_lock, portMAX_DELAY);
+    if (!config_dirty){
+        config_first_change_ms = now;
+    }
+    config_last_change_ms = now;
+    config_dirty |= 1UL << i;
+    xSemaphoreGive(config_lock);
+
+    /* every change moves the write on, so a burst of them is written once it is over */
+    deferred_work_schedule(&config_work, config_store_wait());
+}
+
+
+bool config_store_due(void){
+    uint32_t now = sensor_hal->now_ms();
+
+    if (!config_dirty){
+        return false;
+    }
+    return now - config_last_change_ms >= CONFIG_STORE_DEBOUNCE_MS || now - config_first_change_ms >= CONFIG_STORE_MAX_DELAY_MS;
+}
+
+
+bool config_store_commit(void){
+    config_item_t *item;
+    uint32_t all = 0;
+    bool changed = false, ok = true;
+    uint8_t i;
+
+    if (config_lock == NULL){
+        return false;
+    }
+    xSemaphoreTake(config_commit_lock, portMAX_DELAY);
+
+    /* take the values under the lock, the flash is written without it */
+    xSemaphoreTake(config_lock, portMAX_DELAY);
+    for (i = 0; i < config_count; i++){
+        item = &config_record.item[i];
+        item->id = config_entries[i].id;
+        item->format = config_entries[i].characteristic->value.format;
+        item->reserved = 0xffff;
+        item->value = config_value_encode(config_entries[i].characteristic->value);
+        all |= 1UL << i;
+        if (!(config_written_mask & (1UL << i)) || item->value != config_written[i]){
+            changed = true;
+        }
+    }
+    config_dirty = 0;
+    xSemaphoreGive(config_lock);
+
+    if (!changed){
+        /* set back to the values already in flash */
+        xSemaphoreGive(config_commit_lock);
+        return true;
+    }
+
+    ok = config_append();
+
+    if (ok){
+        for (i = 0; i < config_count; i++){
+            config_written[i] = config_record.item[i].value;
+        }
+        config_written_mask = all;
+    } else {
+        printf("%s: failed to write the settings\n", __func__);
+        /* try again after the debounce */
+        xSemaphoreTake(config_lock, portMAX_DELAY);
+        config_first_change_ms = config_last_change_ms = sensor_hal->now_ms();
+        config_dirty |= all;
+        xSemaphoreGive(config_lock);
+        deferred_work_schedule(&config_work, CONFIG_STORE_DEBOUNCE_MS);
+    }
+    xSemaphoreGive(config_commit_lock);
+    return ok;
+}
+
+
+void config_store_flush(void){
+    if (config_dirty){
+        config_store_commit();
+    }
+}
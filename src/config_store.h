@@ -0,0 +1,59 @@
+/* Persistent settings, kept in a reserved region of flash as an append only log.
+ *
+ * Setting a characteristic only marks it dirty in RAM. The deferred work task
+ * waits until no setting has changed for CONFIG_STORE_DEBOUNCE_MS, at most
+ * CONFIG_STORE_MAX_DELAY_MS after the first change, and then appends one record
+ * holding every setting. A slider dragged in the Home app or a burst of baseline
+ * updates is so one small flash write instead of a sysparam write per value. When
+ * a record does not fit in the rest of its sector the next sector is erased and
+ * used, round robin over the region, so erases are spread evenly. The newest
+ * complete record is the one loaded, and since each record holds every setting
+ * the older ones can always be erased.
+ *
+ * The region has to be clear of both OTA slots and the homekit storage, so it is
+ * only used when the Makefile sets one. Without it the settings are still
+ * debounced the same way, and each one that changed is written to sysparam.
+ */
+
+#ifndef __CONFIG_STORE_H__
+#define __CONFIG_STORE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <homekit/homekit.h>
+
+#ifndef CONFIG_FLASH_SECTORS
+#define CONFIG_FLASH_SECTORS        0           /* sysparam unless the Makefile sets a region, else at least 2 */
+#endif
+
+#define CONFIG_SECTOR_SIZE          4096
+#define CONFIG_STORE_MAX_ENTRIES    16
+#define CONFIG_STORE_DEBOUNCE_MS    5000        /* quiet time before dirty settings are written */
+#define CONFIG_STORE_MAX_DELAY_MS   30000       /* longest a change waits while settings keep changing */
+
+
+typedef struct {
+    uint8_t id;                     /* key of the value in flash, never reuse one for another setting */
+    homekit_characteristic_t *characteristic;
+} config_entry_t;
+
+#define CONFIG_ENTRY(_id, _characteristic) { .id = (_id), .characteristic = (_characteristic) }
+
+
+/* load the newest record into the characteristics and add the writer to the deferred work,
+   returns false if there was no record, e.g. on the first start with a region */
+bool config_store_init(const config_entry_t *entries, uint8_t count);
+
+/* the value of the characteristic has changed and is to be written */
+void config_store_set(homekit_characteristic_t *characteristic);
+
+/* true when the dirty settings have waited long enough */
+bool config_store_due(void);
+
+/* append a record now if anything has changed, returns false on a flash error */
+bool config_store_commit(void);
+
+/* write any dirty settings straight away, e.g. before a restart */
+void config_store_flush(void);
+
+#endif
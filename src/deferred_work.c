@@ -0,0 +1,99 @@
+/* The shared low priority task for slow work, see deferred_work.h
+ */
+
+#include <stdio.h>
+#include <task.h>
+#include "deferred_work.h"
+
+
+static deferred_work_t *deferred_items[DEFERRED_WORK_MAX_ITEMS];
+static uint8_t deferred_item_count = 0;
+static TaskHandle_t deferred_task_handle = NULL;
+
+
+static void deferred_work_task(void *_args){
+    TickType_t now, wait;
+    deferred_work_t *work;
+    bool due;
+    uint8_t i;
+
+    while (1){
+        now = xTaskGetTickCount();
+        wait = portMAX_DELAY;
+        for (i = 0; i < deferred_item_count; i++){
+            work = deferred_items[i];
+            taskENTER_CRITICAL();
+            due = work->scheduled && (int32_t) (work->due - now) <= 0;
+            if (due){
+                work->scheduled = false;
+            } else if (work->scheduled && work->due - now < wait){
+                wait = work->due - now;
+            }
+            taskEXIT_CRITICAL();
+
+            if (due){
+                work->run();
+                taskENTER_CRITICAL();
+                if (work->period_ms && !work->scheduled){
+                    work->due = xTaskGetTickCount() + pdMS_TO_TICKS(work->period_ms);
+                    work->scheduled = true;
+                }
+                taskEXIT_CRITICAL();
+                /* the run took time, so look at every item again before waiting */
+                wait = 0;
+            }
+        }
+        if (wait){
+            ulTaskNotifyTake(pdTRUE, wait);
+        }
+    }
+}
+
+
+bool deferred_work_add(deferred_work_t *work){
+    uint8_t i;
+
+    for (i = 0; i < deferred_item_count; i++){
+        if (deferred_items[i] == work){
+            return true;
+        }
+    }
+    if (deferred_item_count == DEFERRED_WORK_MAX_ITEMS){
+        printf("%s: no room for %s\n", __func__, work->name);
+        return false;
+    }
+    work->scheduled = false;
+    if (work->period_ms){
+        work->due = xTaskGetTickCount() + pdMS_TO_TICKS(work->period_ms);
+        work->scheduled = true;
+    }
+    /* the task only reads the items below the count */
+    taskENTER_CRITICAL();
+    deferred_items[deferred_item_count++] = work;
+    taskEXIT_CRITICAL();
+
+    if (deferred_task_handle == NULL
+        && xTaskCreate(deferred_work_task, "Deferred", DEFERRED_WORK_STACK, NULL, 1, &deferred_task_handle) != pdPASS){
+        printf("%s: failed to create the task\n", __func__);
+        deferred_task_handle = NULL;
+        return false;
+    }
+    xTaskNotifyGive(deferred_task_handle);
+    return true;
+}
+
+
+void deferred_work_schedule(deferred_work_t *work, uint32_t delay_ms){
+    taskENTER_CRITICAL();
+    work->due = xTaskGetTickCount() + pdMS_TO_TICKS(delay_ms);
+    work->scheduled = true;
+    taskEXIT_CRITICAL();
+    if (deferred_task_handle != NULL){
+        xTaskNotifyGive(deferred_task_handle);
+    }
+}
+
+
+void deferred_work_request(deferred_work_t *work){
+    deferred_work_schedule(work, 0);
+}
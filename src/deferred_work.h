@@ -0,0 +1,44 @@
+/* One low priority task for the slow work of several modules, writing flash and
+ * sending over UDP, in place of a writer task and its stack for each of them.
+ *
+ * A module adds a work item once and then schedules it to run, straight away or
+ * after a delay. Scheduling an item again before it has run moves it, so requests
+ * made while it waits are merged into one run, and a debounce is a schedule on each
+ * change. An item with a period is also run that often, and is scheduled again
+ * after each run. Items run one at a time, so they must not block for long, and a
+ * run of one delays the rest.
+ */
+
+#ifndef __DEFERRED_WORK_H__
+#define __DEFERRED_WORK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <FreeRTOS.h>
+
+#define DEFERRED_WORK_STACK         384     /* words, enough for a UDP send or a flash write */
+#define DEFERRED_WORK_MAX_ITEMS     8
+
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+    uint32_t period_ms;             /* 0 to run only when scheduled */
+    TickType_t due;                 /* when the item is next run, if scheduled */
+    bool scheduled;
+} deferred_work_t;
+
+#define DEFERRED_WORK(_name, _run, _period_ms) { .name = (_name), .run = (_run), .period_ms = (_period_ms) }
+
+
+/* add an item, the task is created with the first one. A periodic item is first run
+   a period after it is added */
+bool deferred_work_add(deferred_work_t *work);
+
+/* run the item delay_ms from now, replacing any earlier schedule, from any task but not an interrupt */
+void deferred_work_schedule(deferred_work_t *work, uint32_t delay_ms);
+
+/* run the item as soon as the task is free */
+void deferred_work_request(deferred_work_t *work);
+
+#endif
@@ -0,0 +1,41 @@
+/* Decoder of DHT22 replies captured as falling edge timestamps, see dht22.h
+ */
+
+#include "dht22.h"
+
+
+dht22_status_t dht22_decode(const uint32_t *edge, uint8_t count, uint32_t ticks_per_us, float *temperature, float *humidity){
+    uint8_t data[DHT22_BITS / 8] = { 0 };
+    uint32_t period;
+    int16_t raw;
+    uint8_t bit;
+
+    if (count < DHT22_EDGES){
+        return DHT22_TIMEOUT;
+    }
+
+    /* the low and high acknowledgement between the first two edges */
+    period = (edge[1] - edge[0]) / ticks_per_us;
+    if (period < DHT22_RESPONSE_MIN_US || period > DHT22_RESPONSE_MAX_US){
+        return DHT22_NO_RESPONSE;
+    }
+
+    /* every bit is a fixed low and a variable high from one falling edge to the next */
+    for (bit = 0; bit < DHT22_BITS; bit++){
+        period = (edge[bit + 2] - edge[bit + 1]) / ticks_per_us;
+        if (period < DHT22_BIT_MIN_US || period > DHT22_BIT_MAX_US){
+            return DHT22_BAD_TIMING;
+        }
+        data[bit / 8] = (data[bit / 8] << 1) | (period > DHT22_BIT_THRESHOLD_US);
+    }
+
+    if (((data[0] + data[1] + data[2] + data[3]) & 0xff) != data[4]){
+        return DHT22_BAD_CHECKSUM;
+    }
+
+    /* tenths, the temperature with a sign bit rather than two's complement */
+    *humidity = ((data[0] << 8) | data[1]) / 10.0f;
+    raw = ((data[2] & 0x7f) << 8) | data[3];
+    *temperature = (data[2] & 0x80 ? -raw : raw) / 10.0f;
+    return DHT22_OK;
+}
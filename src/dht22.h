@@ -0,0 +1,48 @@
+/* DHT22 (AM2302) temperature and humidity sensor read without busy waiting. The
+ * falling edges of the reply are timestamped by a GPIO interrupt into a small
+ * buffer while the reading task sleeps, and decoded and checked afterwards in task
+ * context. dht22.c holds the decoder, which has no hardware dependencies so that it
+ * can be run on a host against synthesized edge timings, the capture is in
+ * dht22_esp8266.c.
+ */
+
+#ifndef __DHT22_H__
+#define __DHT22_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* protocol timings, in microseconds */
+#define DHT22_START_MS          10      /* host holds the line low to request a reading, from 1 to 20 ms is accepted */
+#define DHT22_CAPTURE_MS        20      /* a reply takes at most 5.5 ms, anything longer has timed out */
+#define DHT22_RESPONSE_MIN_US   120     /* the 80 us low and 80 us high acknowledgement */
+#define DHT22_RESPONSE_MAX_US   200
+#define DHT22_BIT_MIN_US        50      /* 50 us low then 26 us high for a 0, 70 us high for a 1 */
+#define DHT22_BIT_THRESHOLD_US  100
+#define DHT22_BIT_MAX_US        160
+
+#define DHT22_BITS              40
+#define DHT22_EDGES             (DHT22_BITS + 2)    /* falling edges of a reply, the acknowledgement then the end of each bit */
+
+
+typedef enum {
+    DHT22_OK = 0,
+    DHT22_BUSY,                     /* a read is already in progress */
+    DHT22_TIMEOUT,                  /* fewer than DHT22_EDGES edges within DHT22_CAPTURE_MS */
+    DHT22_NO_RESPONSE,              /* the acknowledgement was out of range */
+    DHT22_BAD_TIMING,               /* a bit was out of range */
+    DHT22_BAD_CHECKSUM,
+} dht22_status_t;
+
+
+/* decode the falling edge timestamps of a reply, counted in ticks_per_us ticks and
+ * wrapping, into degrees C and percent relative humidity */
+dht22_status_t dht22_decode(const uint32_t *edge, uint8_t count, uint32_t ticks_per_us, float *temperature, float *humidity);
+
+/* configure the data line, which needs an external pull up */
+bool dht22_init(uint8_t gpio);
+
+/* request, capture and decode a reading, sleeping rather than polling the line */
+dht22_status_t dht22_read(float *temperature, float *humidity);
+
+#endif
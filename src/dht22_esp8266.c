@@ -0,0 +1,78 @@
+/* Interrupt driven capture of DHT22 replies on the ESP8266, see dht22.h
+ */
+
+#include <stdio.h>
+#include <espressif/esp_common.h>
+#include <esp8266.h>
+#include <esp/gpio.h>
+#include <xtensa_ops.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "dht22.h"
+
+
+typedef enum {
+    DHT22_IDLE,
+    DHT22_START,                    /* line held low, the reading task sleeps for DHT22_START_MS */
+    DHT22_CAPTURE,                  /* line released, edges are recorded until DHT22_EDGES or DHT22_CAPTURE_MS */
+} dht22_state_t;
+
+
+static uint8_t dht22_gpio;
+static volatile dht22_state_t dht22_state = DHT22_IDLE;
+static volatile uint8_t dht22_edge_count;
+static uint32_t dht22_edge[DHT22_EDGES];   /* cpu cycle count at each falling edge */
+static TaskHandle_t dht22_reader;
+
+
+static void IRAM dht22_edge_isr(uint8_t gpio){
+    BaseType_t woken = pdFALSE;
+    uint32_t ccount;
+
+    RSR(ccount, ccount);
+    if (dht22_state != DHT22_CAPTURE || dht22_edge_count >= DHT22_EDGES){
+        return;
+    }
+    dht22_edge[dht22_edge_count++] = ccount;
+    if (dht22_edge_count == DHT22_EDGES){
+        vTaskNotifyGiveFromISR(dht22_reader, &woken);
+        portEND_SWITCHING_ISR(woken);
+    }
+}
+
+
+bool dht22_init(uint8_t gpio){
+    dht22_gpio = gpio;
+    /* open drain, so releasing the line lets the pull up take it high and the sensor drive it */
+    gpio_enable(gpio, GPIO_OUT_OPEN_DRAIN);
+    gpio_write(gpio, 1);
+    gpio_set_interrupt(gpio, GPIO_INTTYPE_EDGE_NEG, dht22_edge_isr);
+    return true;
+}
+
+
+dht22_status_t dht22_read(float *temperature, float *humidity){
+    dht22_status_t status;
+
+    if (dht22_state != DHT22_IDLE){
+        return DHT22_BUSY;
+    }
+    dht22_reader = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);    /* drop a notification left by a capture that completed after its timeout */
+
+    dht22_state = DHT22_START;
+    gpio_write(dht22_gpio, 0);
+    vTaskDelay(pdMS_TO_TICKS(DHT22_START_MS) + 1);     /* a delay ends up to a tick early, so one more */
+
+    dht22_edge_count = 0;
+    dht22_state = DHT22_CAPTURE;
+    gpio_write(dht22_gpio, 1);
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DHT22_CAPTURE_MS));
+    dht22_state = DHT22_IDLE;
+
+    status = dht22_decode(dht22_edge, dht22_edge_count, sdk_system_get_cpu_freq(), temperature, humidity);
+    if (status != DHT22_OK){
+        printf("%s: status %u after %u edges\n", __func__, status, dht22_edge_count);
+    }
+    return status;
+}
@@ -0,0 +1,65 @@
+/* Latest temperature and humidity shared without locks, see env_snapshot.h
+ */
+
+#include "env_snapshot.h"
+#include "sensor_hal.h"
+
+#define barrier() __asm__ __volatile__("" ::: "memory")
+
+
+static volatile uint32_t env_sequence = 0;
+static env_reading_t env_reading;
+
+
+static void env_snapshot_write(const env_reading_t *reading){
+    env_sequence++;
+    barrier();
+    env_reading = *reading;
+    env_reading.sequence = env_sequence + 1;
+    barrier();
+    env_sequence++;
+}
+
+
+void env_snapshot_publish(float temperature, float humidity){
+    env_reading_t reading = {
+        .temperature = temperature,
+        .humidity = humidity,
+        .timestamp_ms = sensor_hal->now_ms(),
+        .valid = true,
+    };
+    env_snapshot_write(&reading);
+}
+
+
+void env_snapshot_fail(void){
+    env_reading_t reading;
+
+    /* only the publishing side writes, so it can read its own data directly */
+    reading = env_reading;
+    reading.valid = false;
+    env_snapshot_write(&reading);
+}
+
+
+bool env_snapshot_read(env_reading_t *reading){
+    uint32_t sequence;
+
+    while (1){
+        sequence = env_sequence;
+        if (sequence & 1){
+            /* a write is in progress, let the writer finish */
+            sensor_hal->delay_ms(1);
+            continue;
+        }
+        barrier();
+        *reading = env_reading;
+        barrier();
+        if (env_sequence == sequence){
+            break;
+        }
+    }
+
+    reading->stale = reading->sequence == 0 || sensor_hal->now_ms() - reading->timestamp_ms > ENV_STALE_MS;
+    return reading->valid && !reading->stale;
+}
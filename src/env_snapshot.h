@@ -0,0 +1,41 @@
+/* Latest temperature and humidity, published by the DHT side and read by any task
+ * without locks. A sequence counter is made odd while the data is being written, a
+ * reader copies the data and retries if the counter was odd or changed meanwhile,
+ * so it can never see a torn reading.
+ */
+
+#ifndef __ENV_SNAPSHOT_H__
+#define __ENV_SNAPSHOT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "signal_filter.h"
+
+#define ENV_STALE_MS                60000   /* readings older than this are not used */
+#define ENV_DEFAULT_TEMPERATURE     20.0    /* used when there is no fresh reading, the MQ135 datasheet conditions */
+#define ENV_DEFAULT_HUMIDITY        65.0
+
+/* the DHT22 readings are cleaned of garbage frames and lightly smoothed before they are published */
+#define ENV_TEMPERATURE_FILTER      SIGNAL_FILTER(5, 4.0, 0.3, 0.01, 0.01)
+#define ENV_HUMIDITY_FILTER         SIGNAL_FILTER(5, 4.0, 1.0, 0.5, 1.0)
+
+
+typedef struct {
+    float temperature;
+    float humidity;
+    uint32_t timestamp_ms;          /* when the last successful reading was taken */
+    uint32_t sequence;              /* changes with every publish, for change detection */
+    bool valid;                     /* the last read of the sensor succeeded */
+    bool stale;                     /* no successful reading within ENV_STALE_MS, set by env_snapshot_read */
+} env_reading_t;
+
+
+void env_snapshot_publish(float temperature, float humidity);
+
+/* record a failed read of the sensor, the last good values are kept */
+void env_snapshot_fail(void);
+
+/* copy the latest reading, returns true if it is valid and fresh */
+bool env_snapshot_read(env_reading_t *reading);
+
+#endif
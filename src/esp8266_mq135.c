@@ -6,51 +6,110 @@
 #include <stdio.h>
 #include <math.h>
 #include "esp8266_mq135.h"
-#include <espressif/esp_common.h>
-#include <esp8266.h>
-#include <FreeRTOS.h>
-#include <task.h>
+#include "gas_table.h"
+#include "sensor_hal.h"
+#include "adc_sampler.h"
+#include "env_snapshot.h"
+#include "binlog.h"
+#ifdef MQ135_FIXED_POINT
+#include "fixed_math.h"
+#endif
 
 
 
-float Ro = 41763.0;    // this has to be tuned 10K Ohm
-float co_val = 0;
-float lpg_val = 0;
-float pm10_val = 0;
-float methane_val = 0;
-float nh4_val = 0;
-uint8_t air_quality_val = 0;
+#define MQ135       (&mq_channels[MQ_CHANNEL_MQ135])
 
+/* correction factor of the environment snapshot it was last calculated for */
+static float correction_factor = 1.0;
+static uint32_t correction_q12 = 4096;
+static uint32_t correction_sequence = 0;
+static bool correction_default = false;
 
-unsigned long SLEEP_TIME = 50000; // Sleep time between reads (in milliseconds)
 
-float Rs = 0;           // variable to store the value coming from the sensor
-float valMQ =0.0;
-float lastMQ =0.0;
+/* start the clean air baseline from the Ro the channel has now */
+static void MQBaselineStart(mq_channel_t *channel){
+
+   channel->baseline_committed_ro = channel->ro;
+   channel->baseline_day_start = sensor_hal->now_ms();
+}
 
-/* Values derived from exponential regression of respective gas datapoints from the datasheet.
- *  The values represent the a & b values in the a*x^b
- */
-float           LPGCurve[2]  =  {632.8357,-2.025202};   //two points are taken from the curve.
-                                                    //with these two points, a line is formed which is "approximately equivalent"
-                                                    //to the original curve.
-                                                    //data format:{ x, y, slope}; point1: (lg200, 0.21), point2: (lg10000, -0.59)
 
-float           COCurve[2] = {116.6020682, -2.769034857};
-float           PM10Curve[2] ={3896.4,-1.886306};    //two points are taken from the curve.
-                                                    //with these two points, a line is formed which is "approximately equivalent"
-                                                    //to the original curve.
-                                                    //data format:{ x, y, slope}; point1: (lg200, 0.53), point2:(lg10000,-0.22)
+bool MQInit(float stored_ro){
 
-float           CH4Curve[2]    = {4084.538, -2.410099};
+   bool calibrated = false;
+
+   adc_sampler_start(ADC_SAMPLE_PERIOD_MS);
+   if (stored_ro > 0) {
+      MQ135->ro = stored_ro;                           //restored from flash, no need to wait for calibration
+      printf ("stored value for Ro is %f\n", MQ135->ro);
+   } else {
+      MQ135->ro = MQCalibration(MQ135);                //Calibrating the sensor. Please make sure the sensor is in clean air 
+      printf ("calibrated value for Ro is %f\n", MQ135->ro); //when you perform the calibration  
+      calibrated = true;
+   }
+   MQBaselineStart(MQ135);
+   return calibrated;
+}
 
-float           NH4Curve[2]    = {102.2348, -2.554241};
 
+void MQChannelInit(mq_channel_t *channel, float stored_ro){
 
-void MQInit(){
+   adc_snapshot_t snapshot;
 
-   Ro = MQCalibration(MQ_SENSOR_ANALOG_PIN);         //Calibrating the sensor. Please make sure the sensor is in clean air 
-   printf ("calibrated value for Ro is %f\n", Ro);   //when you perform the calibration  
+   if (stored_ro > 0) {
+      channel->ro = stored_ro;
+      channel->calibrating = false;
+      MQBaselineStart(channel);
+      printf("%s: stored value for %s Ro is %f\n", __func__, channel->name, channel->ro);
+   } else {
+      adc_sampler_snapshot(channel->adc_channel, &snapshot);
+      channel->calibration_start = snapshot.total;
+      channel->calibrating = true;
+      printf("%s: calibrating %s, make sure it is in clean air\n", __func__, channel->name);
+   }
+}
+
+
+bool MQBaselineUpdate(mq_channel_t *channel, float rs){
+
+   int day;
+   float clean_rs = 0, target;
+
+   if (channel->calibrating || !(rs > 0) || isinf(rs)) {
+      return false;
+   }
+   if (rs > channel->baseline_day_max[channel->baseline_day]) {
+      channel->baseline_day_max[channel->baseline_day] = rs;
+   }
+   if (sensor_hal->now_ms() - channel->baseline_day_start < BASELINE_DAY_MS) {
+      return false;
+   }
+
+   /* a day has passed, start the next one and re-estimate Ro from the cleanest air seen */
+   channel->baseline_day_start += BASELINE_DAY_MS;
+   channel->baseline_day = (channel->baseline_day + 1) % BASELINE_DAYS;
+   channel->baseline_day_max[channel->baseline_day] = 0;
+   if (channel->baseline_days_complete < BASELINE_DAYS) {
+      channel->baseline_days_complete++;
+   }
+   if (channel->baseline_days_complete < BASELINE_MIN_DAYS) {
+      return false;
+   }
+
+   for (day=0;day<BASELINE_DAYS;day++) {
+      if (channel->baseline_day_max[day] > clean_rs) {
+         clean_rs = channel->baseline_day_max[day];
+      }
+   }
+   target = clean_rs / channel->clean_air_factor;
+   channel->ro += (target - channel->ro) * BASELINE_STEP;
+   printf("%s: %s clean air Rs %f, Ro %f\n", __func__, channel->name, clean_rs, channel->ro);
+
+   if (fabsf(channel->ro - channel->baseline_committed_ro) < channel->baseline_committed_ro * BASELINE_COMMIT_DRIFT) {
+      return false;
+   }
+   channel->baseline_committed_ro = channel->ro;
+   return true;
 }
 
 
@@ -60,157 +119,371 @@ float get_correction_factor(float temperature, float humidity){
         * Based on the linearization of the temperature dependency curve
         * under and above 20 degrees Celsius, asuming a linear dependency on humidity,
         * provided by Balk77 https://github.com/GeorgK/MQ135/pull/6/files
+        * This is the reference the correction tables are built from.
         */
 
 
-        if (temperature < 20){
-            return CORA * temperature * temperature - CORB * temperature + CORC - (humidity - 33.0) * CORD;
+        if (temperature < CORRECTION_T_SPLIT){
+            return CORRECTION_COLD(temperature, humidity);
 	}
 	else {
-        return CORE * temperature + CORF * humidity + CORG;
+        return CORRECTION_WARM(temperature, humidity);
 	}
 }
 
 
-void MQGetReadings(float temperature, float humidity){
-  
-	float rs_ro_ratio=0;
-	float correction_factor=0;
-
-	Rs = MQRead(MQ_SENSOR_ANALOG_PIN);
-	correction_factor = get_correction_factor(temperature, humidity);
-	Rs = Rs / correction_factor;
-	rs_ro_ratio = Rs/Ro;
-  	printf("RS_RO Ratio is %f\n", rs_ro_ratio);
-	co_val = MQGetGasPercentage(rs_ro_ratio,GAS_CO);
-  	lpg_val = MQGetGasPercentage(rs_ro_ratio,GAS_LPG);
-   	pm10_val = MQGetGasPercentage(rs_ro_ratio,GAS_PM10);
-   	methane_val = MQGetGasPercentage(rs_ro_ratio,GAS_CH4);
-	nh4_val = MQGetGasPercentage(rs_ro_ratio,GAS_NH4);
-
-	air_quality_val =0;
-
-	if (co_val >=15.4 && air_quality_val < 5){
-		air_quality_val = 5;
-	} else if (co_val >= 12.5 && air_quality_val < 4){
-		air_quality_val = 4;
-        } else if (co_val >= 9.5 && air_quality_val < 3){
-                air_quality_val = 3;
-        } else if (co_val >= 4.5 && air_quality_val < 2){
-                air_quality_val = 2;  
-        } else if (air_quality_val == 0){
-                air_quality_val = 1;    
-	}
-		
-        if (pm10_val >= 355 && air_quality_val < 5){
-                air_quality_val = 5;
-        } else if (pm10_val >= 255 && air_quality_val < 4){
-                air_quality_val = 4;
-        } else if (pm10_val >= 155 && air_quality_val < 3){
-                air_quality_val = 3;
-        } else if (pm10_val >= 55 && air_quality_val < 2){
-                air_quality_val = 2;
-        } else if (air_quality_val == 0){
-                air_quality_val = 1;
-        }
-
-	printf("corrcetion factor %f, air_quality_val %i, Rs %f, CO %f, LPG %f, PM10 %f, methane %f, NH4 %f\n", correction_factor, air_quality_val, Rs, co_val, lpg_val, pm10_val, methane_val, nh4_val);
+/* correction factor in Q12 at every grid point, evaluated by the compiler so the
+ * tables are plain constants. Rows are CORRECTION_T_STEP degrees apart starting at
+ * CORRECTION_T_MIN for the cold table and CORRECTION_T_SPLIT for the warm one,
+ * columns CORRECTION_H_STEP percent apart starting at 0.
+ */
+#define CORRECTION_Q12(x)           ((uint16_t) ((x) * 4096 + 0.5))
+#define CORRECTION_ROW(model, t)    { CORRECTION_Q12(model(t, 0)), CORRECTION_Q12(model(t, 20)), CORRECTION_Q12(model(t, 40)), \
+                                      CORRECTION_Q12(model(t, 60)), CORRECTION_Q12(model(t, 80)), CORRECTION_Q12(model(t, 100)) }
+
+static const uint16_t correction_cold[CORRECTION_ROWS][CORRECTION_COLUMNS] = {
+	CORRECTION_ROW(CORRECTION_COLD, -40), CORRECTION_ROW(CORRECTION_COLD, -35), CORRECTION_ROW(CORRECTION_COLD, -30),
+	CORRECTION_ROW(CORRECTION_COLD, -25), CORRECTION_ROW(CORRECTION_COLD, -20), CORRECTION_ROW(CORRECTION_COLD, -15),
+	CORRECTION_ROW(CORRECTION_COLD, -10), CORRECTION_ROW(CORRECTION_COLD, -5), CORRECTION_ROW(CORRECTION_COLD, 0),
+	CORRECTION_ROW(CORRECTION_COLD, 5), CORRECTION_ROW(CORRECTION_COLD, 10), CORRECTION_ROW(CORRECTION_COLD, 15),
+	CORRECTION_ROW(CORRECTION_COLD, 20),          //the limit from below, so the last cell interpolates the cold model
+};
+
+static const uint16_t correction_warm[CORRECTION_ROWS][CORRECTION_COLUMNS] = {
+	CORRECTION_ROW(CORRECTION_WARM, 20), CORRECTION_ROW(CORRECTION_WARM, 25), CORRECTION_ROW(CORRECTION_WARM, 30),
+	CORRECTION_ROW(CORRECTION_WARM, 35), CORRECTION_ROW(CORRECTION_WARM, 40), CORRECTION_ROW(CORRECTION_WARM, 45),
+	CORRECTION_ROW(CORRECTION_WARM, 50), CORRECTION_ROW(CORRECTION_WARM, 55), CORRECTION_ROW(CORRECTION_WARM, 60),
+	CORRECTION_ROW(CORRECTION_WARM, 65), CORRECTION_ROW(CORRECTION_WARM, 70), CORRECTION_ROW(CORRECTION_WARM, 75),
+	CORRECTION_ROW(CORRECTION_WARM, 80),
+};
+
+
+/*****************************  MQCorrectionLookup ********************************
+Input:   temperature - degrees C, clamped to CORRECTION_T_MIN..CORRECTION_T_MAX
+         humidity    - percent, clamped to 0..100
+Output:  the correction factor in Q12
+Remarks: Bilinear interpolation in the table for the side of CORRECTION_T_SPLIT the
+         temperature is on, with positions and values in Q12. The warm model and the
+         humidity term are linear so those are exact, below 20 degrees the error of
+         the quadratic is at most CORA * CORRECTION_T_STEP^2 / 4 = 0.0022, plus
+         0.0004 of rounding, half a Q12 step in the table and in each of the two
+         interpolations, against factors of 0.8 to 3.1. tools/sensor_test checks
+         both bounds against get_correction_factor.
+************************************************************************************/ 
+static uint32_t MQCorrectionLookup(float temperature, float humidity)
+{
+	const uint16_t (*table)[CORRECTION_COLUMNS];
+	uint32_t t, h, row, column, ft, fh, low, high;
+
+	if (temperature < CORRECTION_T_MIN) {
+		temperature = CORRECTION_T_MIN;
+	}
+	if (temperature > CORRECTION_T_MAX) {
+		temperature = CORRECTION_T_MAX;
+	}
+	if (!(humidity > 0)) {
+		humidity = 0;
+	}
+	if (humidity > 100) {
+		humidity = 100;
+	}
+
+	if (temperature < CORRECTION_T_SPLIT) {
+		table = correction_cold;
+		t = (temperature - CORRECTION_T_MIN) * (4096.0 / CORRECTION_T_STEP) + 0.5;
+	} else {
+		table = correction_warm;
+		t = (temperature - CORRECTION_T_SPLIT) * (4096.0 / CORRECTION_T_STEP) + 0.5;
+	}
+	h = humidity * (4096.0 / CORRECTION_H_STEP) + 0.5;
+
+	row = t >> 12;
+	ft = t & 0xfff;
+	if (row >= CORRECTION_ROWS - 1) {
+		row = CORRECTION_ROWS - 2;
+		ft = 4096;
+	}
+	column = h >> 12;
+	fh = h & 0xfff;
+	if (column >= CORRECTION_COLUMNS - 1) {
+		column = CORRECTION_COLUMNS - 2;
+		fh = 4096;
+	}
+
+	/* factors are below 4, so each Q12 * Q12 product stays well within 32 bits */
+	low = (table[row][column] * (4096 - fh) + table[row][column + 1] * fh + 2048) >> 12;
+	high = (table[row + 1][column] * (4096 - fh) + table[row + 1][column + 1] * fh + 2048) >> 12;
+	return (low * (4096 - ft) + high * ft + 2048) >> 12;
+}
+
+
+/* a fresh snapshot of the adc sampler */
+static void MQSnapshot(const mq_channel_t *channel, adc_snapshot_t *snapshot)
+{
+  adc_sampler_snapshot(channel->adc_channel, snapshot);
+  BINLOG_DEBUG(MQ_ADC, binlog_f(snapshot->filtered), binlog_f(snapshot->mean), snapshot->median, binlog_f(snapshot->variance), snapshot->count);
+}
+
+
+static float MQCorrectionFactor(void){
+
+	env_reading_t env;
+
+	if (!env_snapshot_read(&env)) {
+		/* no fresh reading, correct for the conditions the curves were measured in */
+		if (!correction_default) {
+			printf("%s: no fresh temperature and humidity, using defaults\n", __func__);
+			correction_q12 = MQCorrectionLookup(ENV_DEFAULT_TEMPERATURE, ENV_DEFAULT_HUMIDITY);
+			correction_factor = correction_q12 / 4096.0f;
+			correction_default = true;
+			correction_sequence = 0;
+		}
+	} else if (correction_default || env.sequence != correction_sequence) {
+		correction_q12 = MQCorrectionLookup(env.temperature, env.humidity);
+		correction_factor = correction_q12 / 4096.0f;
+		correction_default = false;
+		correction_sequence = env.sequence;
+	}
+	return correction_factor;
+}
+
+
+#ifdef MQ135_FIXED_POINT
+
+/* curves in Q16 as log2(ppm) = log2(a) + b * log2(Rs/Ro), converted from gas_table once */
+static int32_t curve_log2_a[GAS_COUNT];
+static int32_t curve_b[GAS_COUNT];
+static bool curves_converted = false;
+
+/* log2(Ro) in Q16 and the Ro it was taken of, Ro only moves once a day */
+static int32_t ro_log2;
+static float ro_log2_of = 0;
+
+
+/* a Q16 base 2 logarithm back to a float, with about 16 significant bits at any magnitude */
+static float MQFixedToFloat(int32_t value_log2)
+{
+	int32_t fraction_bits = 16 - (value_log2 >> 16);
+
+	if (fraction_bits > 31) {
+		fraction_bits = 31;
+	}
+	if (fraction_bits < 0) {
+		fraction_bits = 0;
+	}
+	return ldexpf(fx_exp2(value_log2, fraction_bits), -fraction_bits);
+}
+
+
+/*****************************  MQGetReadingsFixed *********************************
+Input:   readings - rs, correction_factor, rs_ro_ratio and ppm are filled in
+         snapshot - of the adc sampler
+Output:  none
+Remarks: The same chain as the float build, Rs = RL * (1024 - adc) / adc corrected and
+         divided by Ro then raised to the power of each curve, all carried out on Q16
+         base 2 logarithms so that every step is an integer add, subtract or multiply.
+         Floats only appear where the readings are filled in, and in the rare updates
+         of the correction factor, of Ro and of the curves.
+************************************************************************************/
+static void MQGetReadingsFixed(mq_readings_t *readings, const adc_snapshot_t *snapshot)
+{
+	int gas;
+	int32_t adc, rs_log2, ratio_log2;
+
+	if (!curves_converted) {
+		for (gas=0;gas<GAS_COUNT;gas++) {
+			curve_log2_a[gas] = lroundf(gas_table[gas].curve.ln_a * (float) (65536 / M_LN2));
+			curve_b[gas] = lroundf(gas_table[gas].curve.b * 65536);
+		}
+		curves_converted = true;
+	}
+	if (MQ135->ro != ro_log2_of) {
+		/* Ro in Q8, well within 32 bits for any sensor */
+		ro_log2 = fx_log2(MQ135->ro < 16000000 ? (uint32_t) (MQ135->ro * 256 + 0.5f) : 16000000U * 256) - (8 << 16);
+		ro_log2_of = MQ135->ro;
+	}
+
+	adc = snapshot->filtered_q16;
+	if (adc < 1) {
+		adc = 1;
+	}
+	if (adc > (1024 << 16) - 1) {
+		adc = (1024 << 16) - 1;
+	}
+	rs_log2 = fx_log2(RL_VALUE) + fx_log2((1024 << 16) - adc) - fx_log2(adc);
+	rs_log2 -= fx_log2(correction_q12) - (12 << 16);
+	ratio_log2 = rs_log2 - ro_log2;
+
+	readings->rs = MQFixedToFloat(rs_log2);
+	readings->rs_ro_ratio = MQFixedToFloat(ratio_log2);
+	for (gas=0;gas<GAS_COUNT;gas++) {
+		readings->ppm[gas] = MQFixedToFloat(curve_log2_a[gas] + (int32_t) (((int64_t) curve_b[gas] * ratio_log2 + 32768) >> 16));
+	}
+}
+
+#endif
+
+
+bool MQGetReadings(mq_readings_t *readings){
+
+	int gas;
+	float concentration[AQI_POLLUTANT_COUNT];
+	aqi_result_t aqi;
+	adc_snapshot_t snapshot;
+
+	MQSnapshot(MQ135, &snapshot);
+	if (snapshot.count == 0) {
+		/* a stored Ro skips the calibration, so the sampler may not have run yet */
+		return false;
+	}
+	readings->samples = snapshot.total;
+	readings->correction_factor = MQCorrectionFactor();
+#ifdef MQ135_FIXED_POINT
+	MQGetReadingsFixed(readings, &snapshot);
+#else
+	readings->rs = MQResistanceCalculation(MQ135->rl, snapshot.filtered) / readings->correction_factor;
+	readings->rs_ro_ratio = readings->rs/MQ135->ro;
+	MQGetGasConcentrations(readings->rs_ro_ratio, readings->ppm);
+#endif
+	BINLOG_DEBUG(MQ_RATIO, binlog_f(readings->rs_ro_ratio));
+
+	/* the air quality is rated on the gases that map to a pollutant of the index */
+	for (gas=0;gas<AQI_POLLUTANT_COUNT;gas++) {
+		concentration[gas] = NAN;
+	}
+	for (gas=0;gas<GAS_COUNT;gas++) {
+		if (gas_table[gas].aqi_pollutant != AQI_POLLUTANT_NONE) {
+			concentration[gas_table[gas].aqi_pollutant] = readings->ppm[gas];
+		}
+	}
+	aqi_calculate(concentration, &aqi);
+	readings->air_quality = aqi.level;
+	readings->aqi_index = aqi.index;
+
+	BINLOG_INFO(MQ_READING, binlog_f(readings->correction_factor), readings->air_quality, binlog_f(readings->aqi_index), binlog_f(readings->rs));
+	BINLOG_INFO(MQ_PPM, binlog_f(readings->ppm[GAS_LPG]), binlog_f(readings->ppm[GAS_CO]), binlog_f(readings->ppm[GAS_PM10]),
+		binlog_f(readings->ppm[GAS_CH4]), binlog_f(readings->ppm[GAS_NH4]));
+	return true;
+}
+
+
+
+bool MQChannelRead(mq_channel_t *channel, float *rs, float *ppm){
+
+	adc_snapshot_t snapshot;
+	bool calibrated = false;
+
+	MQSnapshot(channel, &snapshot);
+	if (channel->calibrating) {
+		if (snapshot.total - channel->calibration_start < ADC_WINDOW_SIZE) {
+			*rs = *ppm = NAN;
+			return false;
+		}
+		/* a full window of fresh samples, the same as MQCalibration without the wait */
+		channel->ro = MQResistanceCalculation(channel->rl, snapshot.mean) / channel->clean_air_factor;
+		channel->calibrating = false;
+		MQBaselineStart(channel);
+		printf("%s: calibrated value for %s Ro is %f\n", __func__, channel->name, channel->ro);
+		calibrated = true;
+	}
+	if (snapshot.count == 0) {
+		*rs = *ppm = NAN;
+		return calibrated;
+	}
+
+	*rs = MQResistanceCalculation(channel->rl, snapshot.filtered) / MQCorrectionFactor();
+	*ppm = expf(channel->curve_ln_a + channel->curve_b * logf(*rs / channel->ro));
+	return calibrated;
 }
 
 
 
 /****************** MQResistanceCalculation **************************************** 
-Input:   raw_adc - raw value read from adc, which represents the voltage
+Input:   rl      - load resistance of the sensor
+         raw_adc - raw value read from adc, or an average of them, which represents the voltage
 Output:  the calculated sensor resistance
 Remarks: The sensor and the load resistor forms a voltage divider. Given the voltage
          across the load resistor and its resistance, the resistance of the sensor
          could be derived.
 ************************************************************************************/ 
-float MQResistanceCalculation(int raw_adc)
+float MQResistanceCalculation(float rl, float raw_adc)
 {
-  printf("RS value is %i\n", raw_adc);
-  return ( ((float)RL_VALUE*(1024-raw_adc)/raw_adc));
+  return ( (rl*(1024-raw_adc)/raw_adc));
 }
 
 /***************************** MQCalibration ****************************************
-Input:   mq_pin - analog channel
+Input:   channel - sensor to calibrate
 Output:  Ro of the sensor
-Remarks: This function assumes that the sensor is in clean air. It use  
+Remarks: This function assumes that the sensor is in clean air. It waits for the
+         background sampler to fill a window with samples taken after the call, uses
          MQResistanceCalculation to calculates the sensor resistance in clean air 
-         and then divides it with RO_CLEAN_AIR_FACTOR. RO_CLEAN_AIR_FACTOR is about 
-         10, which differs slightly between different sensors.
+         and then divides it with the clean air factor of the channel, which for
+         the MQ135 is RO_CLEAN_AIR_FACTOR. That is about 10, which differs slightly
+         between different sensors.
 ************************************************************************************/ 
-float MQCalibration(int mq_pin)
+float MQCalibration(const mq_channel_t *channel)
 {
-  int i;
+  adc_snapshot_t snapshot;
+  uint32_t start;
   float val=0;
- 
-  for (i=0;i<CALIBARAION_SAMPLE_TIMES;i++) {            //take multiple samples
-    val += MQResistanceCalculation(sdk_system_adc_read());
-    vTaskDelay(CALIBRATION_SAMPLE_INTERVAL);
+
+  adc_sampler_snapshot(channel->adc_channel, &snapshot);
+  start = snapshot.total;
+  while (snapshot.total - start < ADC_WINDOW_SIZE) {    //wait for a full window of fresh samples
+    sensor_hal->delay_ms(ADC_SAMPLE_PERIOD_MS * (ADC_WINDOW_SIZE - (snapshot.total - start)));
+    adc_sampler_snapshot(channel->adc_channel, &snapshot);
   }
-  val = val/CALIBARAION_SAMPLE_TIMES;                   //calculate the average value
+  val = MQResistanceCalculation(channel->rl, snapshot.mean);   //resistance at the average value
   printf("Calibrated Value is %f\n", val);
-  val = val/RO_CLEAN_AIR_FACTOR;                        //divided by RO_CLEAN_AIR_FACTOR yields the Ro 
+  val = val/channel->clean_air_factor;                  //divided by the clean air factor yields the Ro 
                                                         //according to the chart in the datasheet 
   
   return val; 
 }
 
 /*****************************  MQRead *********************************************
-Input:   mq_pin - analog channel
+Input:   channel - sensor to read
 Output:  Rs of the sensor
 Remarks: This function use MQResistanceCalculation to caculate the sensor resistenc (Rs).
          The Rs changes as the sensor is in the different consentration of the target
-         gas. The sample times and the time interval between samples could be configured
-         by changing the definition of the macros.
+         gas. The samples are taken in the background by the adc sampler, so this only
+         reads its smoothed level, with spikes removed, and never waits.
 ************************************************************************************/ 
-float MQRead(int mq_pin)
+float MQRead(const mq_channel_t *channel)
 {
-  int i;
-  float rs=0;
- 
-  for (i=0;i<READ_SAMPLE_TIMES;i++) {
-    rs += MQResistanceCalculation(sdk_system_adc_read());
-    vTaskDelay(READ_SAMPLE_INTERVAL);
-  }
- 
-  rs = rs/READ_SAMPLE_TIMES;	
-  
-  return rs;  
+  adc_snapshot_t snapshot;
+
+  MQSnapshot(channel, &snapshot);
+  return MQResistanceCalculation(channel->rl, snapshot.filtered);
 }
-/*****************************  MQGetGasPercentage **********************************
+/*****************************  MQGetGasConcentrations ******************************
 Input:   rs_ro_ratio - Rs divided by Ro
-         gas_id      - target gas type
-Output:  ppm of the target gas
-Remarks: This function passes different curves to the MQGetPercentage function which 
-         calculates the ppm (parts per million) of the target gas.
+         ppm         - array of GAS_COUNT results, indexed by GAS_LPG..GAS_NH4
+Output:  ppm of every target gas
+Remarks: Evaluates a*x^b for the curve of each gas_table entry as exp(ln(a) + b*ln(x)). The logarithm of the
+         ratio is shared by all curves, so a reading costs one logf and one expf per
+         gas instead of a full powf per gas.
 ************************************************************************************/ 
-int MQGetGasPercentage(float rs_ro_ratio, int gas_id)
+void MQGetGasConcentrations(float rs_ro_ratio, float *ppm)
 {
-  if ( gas_id == GAS_LPG ) {
-     return MQGetPercentage(rs_ro_ratio,LPGCurve);
-  } else if ( gas_id == GAS_CO ) {
-     return MQGetPercentage(rs_ro_ratio,COCurve);
-  } else if ( gas_id == GAS_PM10 ) {
-     return MQGetPercentage(rs_ro_ratio,PM10Curve);
-  } else if ( gas_id == GAS_CH4 ) {
-     return MQGetPercentage(rs_ro_ratio,CH4Curve); 
-  } else if ( gas_id == GAS_NH4 ) {
-     return MQGetPercentage(rs_ro_ratio,NH4Curve);
+  int gas;
+  float ln_ratio = logf(rs_ro_ratio);
+
+  for (gas=0;gas<GAS_COUNT;gas++) {
+    ppm[gas] = expf(gas_table[gas].curve.ln_a + gas_table[gas].curve.b * ln_ratio);
   }
-     
- 
-  return 0;
 }
 
-/*****************************  MQGetPercentage **********************************
-Input:   rs_ro_ratio - Rs divided by Ro
-         pcurve      - pointer to the curve of the target gas
-Output:  ppm of the target gas
-Remarks: USing the a * b coeffients in the equation a*x^b the ppm value is derived
+/*****************************  MQGetConcentrationsAt ******************************
+Input:   raw_adc - adc level of the MQ135, e.g. the peak of a burst capture
+         ppm     - array of GAS_COUNT results, indexed by GAS_LPG..GAS_NH4
+Output:  ppm of every target gas at that level
+Remarks: The same chain as MQGetReadings, with the current correction factor and
+         Ro, in floats in either build as it is only run once for each burst.
 ************************************************************************************/ 
-int  MQGetPercentage(float rs_ro_ratio, float *pcurve)
+void MQGetConcentrationsAt(float raw_adc, float *ppm)
 {
-  return pcurve[0] * powf(rs_ro_ratio, pcurve[1]);
+  float rs = MQResistanceCalculation(MQ135->rl, raw_adc) / MQCorrectionFactor();
+
+  MQGetGasConcentrations(rs / MQ135->ro, ppm);
 }
@@ -3,24 +3,30 @@
  * 
  */
 
-#define   MQ_SENSOR_ANALOG_PIN         0  //define which analog input channel you are going to use- on the ESP8266 there is only one
+#ifndef __ESP8266_MQ135_H__
+#define __ESP8266_MQ135_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define   MQ_CHANNEL_MQ135             0  //mq_channels entry and multiplexer input of the MQ135, the only one without a multiplexer
 
 #define         RL_VALUE                     5300     //define the load resistance on the board, in kilo ohms
 #define         RO_CLEAN_AIR_FACTOR          9.83  //RO_CLEAR_AIR_FACTOR=(Sensor resistance in clean air)/RO,
                                                      //which is derived from the chart in datasheet
 /***********************Software Related Macros************************************/
-#define         CALIBARAION_SAMPLE_TIMES     50    //define how many samples you are going to take in the calibration phase
-#define         CALIBRATION_SAMPLE_INTERVAL  5   //define the time interal(in milisecond) between each samples in the
-                                                     //cablibration phase
-#define         READ_SAMPLE_INTERVAL         50    //define how many samples you are going to take in normal operation
-#define         READ_SAMPLE_TIMES            5     //define the time interal(in milisecond) between each samples in 
-                                                     //normal operation
+                                                     //sample rate and window size are set in adc_sampler.h and adc_window.h
+#define         BASELINE_DAYS                7     //days of clean air history used to re-estimate Ro
+#define         BASELINE_MIN_DAYS            2     //complete days needed before Ro is adjusted
+#define         BASELINE_DAY_MS              (24UL * 60 * 60 * 1000)
+#define         BASELINE_STEP                0.25  //fraction of the difference to the baseline applied each day
+#define         BASELINE_COMMIT_DRIFT        0.05  //relative change of Ro before it is worth saving again
 #define         GAS_LPG                      0
 #define         GAS_CO                       1
 #define         GAS_PM10                     2
 #define         GAS_CH4                      3
 #define         GAS_NH4                      4
-//static const char *GAS_ENUM[5]            ={"LPG", "CO", "PM10", "CH4", "NH4"};
+#define         GAS_COUNT                    5                  //entries in gas_table
 
 
 /*   Parameters to model temperature and humidity dependence
@@ -33,65 +39,172 @@
 #define     CORF	-0.001923077
 #define     CORG	1.130128205
 
-                                                                                            
-extern float Ro;    // this has to be tuned 10K Ohm
-extern float co_val;
-extern float lpg_val;
-extern float pm10_val;
-extern float methane_val ;
-extern float nh4_val;
-extern uint8_t air_quality_val;
+/* the model below and above 20 degrees, both linear in humidity */
+#define     CORRECTION_COLD(t, h)	(CORA * (t) * (t) - CORB * (t) + CORC - ((h) - 33.0) * CORD)
+#define     CORRECTION_WARM(t, h)	(CORE * (t) + CORF * (h) + CORG)
+
+/*   Grid of the correction table, covering the range of the DHT22
+*/
+#define     CORRECTION_T_MIN        -40
+#define     CORRECTION_T_SPLIT      20      //the model is discontinuous here, each side has its own table
+#define     CORRECTION_T_MAX        80
+#define     CORRECTION_T_STEP       5
+#define     CORRECTION_H_STEP       20      //exact for any step, the model is linear in humidity
+#define     CORRECTION_ROWS         ((CORRECTION_T_SPLIT - CORRECTION_T_MIN) / CORRECTION_T_STEP + 1)
+#define     CORRECTION_COLUMNS      (100 / CORRECTION_H_STEP + 1)
+
+
+/* one MQ sensor on an input of the multiplexer, with its own calibration. Only the
+ * MQ135 on MQ_CHANNEL_MQ135 is rated through gas_table and the air quality index,
+ * the others each report the one gas of their curve.
+ */
+typedef struct {
+    const char *name;
+    uint8_t adc_channel;                /* multiplexer input */
+    float rl;                           /* load resistance on the board, in the units of RL_VALUE */
+    float clean_air_factor;             /* Rs/Ro in clean air, from the chart in the datasheet */
+    float curve_ln_a, curve_b;          /* ppm = a * (Rs/Ro)^b of the channel's gas, unused for the MQ135 */
+
+    float ro;
+    bool calibrating;                   /* no stored Ro, one is taken from the first full window */
+    uint32_t calibration_start;         /* samples of the channel when calibration started */
+    float baseline_day_max[BASELINE_DAYS];  /* clean air baseline, the highest corrected Rs of each day */
+    uint8_t baseline_day;
+    uint8_t baseline_days_complete;
+    uint32_t baseline_day_start;
+    float baseline_committed_ro;
+} mq_channel_t;
+
+#define MQ_CHANNEL(_name, _adc_channel, _rl, _clean_air_factor, _ln_a, _b) { .name = (_name), .adc_channel = (_adc_channel), \
+    .rl = (_rl), .clean_air_factor = (_clean_air_factor), .curve_ln_a = (_ln_a), .curve_b = (_b) }
+
+
+/* everything derived from one reading, ppm is indexed by GAS_LPG..GAS_NH4 */
+typedef struct {
+    float rs;
+    float correction_factor;
+    float rs_ro_ratio;
+    float ppm[GAS_COUNT];
+    uint8_t air_quality;            /* homekit level, 1 excellent to 5 poor */
+    float aqi_index;                /* numeric index of the selected air quality standard */
+    uint32_t samples;               /* adc samples taken up to this reading */
+} mq_readings_t;
+
+/* every sensor on the multiplexer, defined in mq_channels.c, ADC_MUX_CHANNELS of them */
+extern mq_channel_t mq_channels[];
 
-void MQInit();
+/*****************************  MQInit *********************************************
+Input:   stored_ro - Ro of the MQ135 saved by a previous run, 0 if there is none
+Output:  true if the sensor was calibrated and Ro should be saved
+Remarks: Starts the adc sampler on every channel and uses the stored Ro when there
+         is one, so there is a reading as soon as the sampler has taken its first
+         sample, see MQGetReadings. Otherwise runs MQCalibration. The other channels are set up with MQChannelInit.
+************************************************************************************/ 
+bool MQInit(float stored_ro);
+
+/*****************************  MQChannelInit **************************************
+Input:   channel   - sensor other than the MQ135
+         stored_ro - Ro saved by a previous run, 0 if there is none
+Output:  none
+Remarks: Without a stored Ro the channel calibrates itself from the first full
+         window of samples, see MQChannelRead, rather than waiting for one here.
+************************************************************************************/ 
+void MQChannelInit(mq_channel_t *channel, float stored_ro);
+
+/*****************************  MQChannelRead **************************************
+Input:   channel - sensor other than the MQ135
+         rs      - set to the corrected Rs, for MQBaselineUpdate
+         ppm     - set to the concentration of the channel's gas
+Output:  true when Ro was calibrated by this call and should be saved
+Remarks: Never blocks. While a calibration is still waiting for its window, or
+         before the first sample of the channel, rs and ppm are NaN.
+************************************************************************************/ 
+bool MQChannelRead(mq_channel_t *channel, float *rs, float *ppm);
+
+/*****************************  MQBaselineUpdate ***********************************
+Input:   channel - sensor the reading came from
+         rs      - corrected Rs of the latest reading
+Output:  true when Ro has drifted by more than BASELINE_COMMIT_DRIFT since it was
+         last saved, and should be saved again
+Remarks: Keeps the highest Rs of each of the last BASELINE_DAYS days. Rs is highest
+         in the cleanest air, so once a day Ro is moved a step towards that maximum
+         divided by the clean air factor. This corrects a calibration done in dirty
+         air and follows the slow drift of the sensor.
+************************************************************************************/ 
+bool MQBaselineUpdate(mq_channel_t *channel, float rs);
 
-void MQGetReadings(float temparature, float humidity);
+/*****************************  MQGetReadings *************************************
+Input:   readings - filled with the latest results
+Output:  false, with readings left as they were, until the adc sampler has taken
+         its first sample of the MQ135
+Remarks: Takes temperature and humidity from the environment snapshot. The correction
+         factor is only recalculated when the snapshot has changed, and the datasheet
+         conditions are used when there is no fresh reading. Built with
+         MQ135_FIXED_POINT the chain from the adc level to the ppm runs on Q16
+         logarithms in integers, only the air quality index is still rated in floats.
+************************************************************************************/ 
+bool MQGetReadings(mq_readings_t *readings);
 
 
 
 /****************** MQResistanceCalculation **************************************** 
-Input: raw_adc - raw value read from adc, which represents the voltage Output: the calculated sensor resistance Remarks: The sensor and the load resistor forms 
-Input:   raw_adc - raw value read from adc, which represents the voltage
+Input:   rl      - load resistance of the sensor
+         raw_adc - raw value read from adc, or an average of them, which represents the voltage
 Output:  the calculated sensor resistance
 Remarks: The sensor and the load resistor forms a voltage divider. Given the voltage
          across the load resistor and its resistance, the resistance of the sensor
          could be derived.
 ************************************************************************************/ 
-float MQResistanceCalculation(int raw_adc);
+float MQResistanceCalculation(float rl, float raw_adc);
 
 /***************************** MQCalibration ****************************************
-Input:   mq_pin - analog channel
+Input:   channel - sensor to calibrate
 Output:  Ro of the sensor
-Remarks: This function assumes that the sensor is in clean air. It use  
+Remarks: This function assumes that the sensor is in clean air. It waits for the
+         background sampler to fill a window with samples taken after the call, uses
          MQResistanceCalculation to calculates the sensor resistance in clean air 
-         and then divides it with RO_CLEAN_AIR_FACTOR. RO_CLEAN_AIR_FACTOR is about 
-         10, which differs slightly between different sensors.
+         and then divides it with the clean air factor of the channel, which for
+         the MQ135 is RO_CLEAN_AIR_FACTOR. That is about 10, which differs slightly
+         between different sensors.
 ************************************************************************************/ 
-float MQCalibration(int mq_pin);
+float MQCalibration(const mq_channel_t *channel);
 
 /*****************************  MQRead *********************************************
-Input:   mq_pin - analog channel
+Input:   channel - sensor to read
 Output:  Rs of the sensor
 Remarks: This function use MQResistanceCalculation to caculate the sensor resistenc (Rs).
          The Rs changes as the sensor is in the different consentration of the target
-         gas. The sample times and the time interval between samples could be configured
-         by changing the definition of the macros.
+         gas. The samples are taken in the background by the adc sampler, so this only
+         reads its smoothed level, with spikes removed, and never waits.
 ************************************************************************************/ 
-float MQRead(int mq_pin);
+float MQRead(const mq_channel_t *channel);
 
 
-/*****************************  MQGetGasPercentage **********************************
+/*****************************  MQGetGasConcentrations ******************************
 Input:   rs_ro_ratio - Rs divided by Ro
-         gas_id      - target gas type
-Output:  ppm of the target gas
-Remarks: This function passes different curves to the MQGetPercentage function which 
-         calculates the ppm (parts per million) of the target gas.
+         ppm         - array of GAS_COUNT results, indexed by GAS_LPG..GAS_NH4
+Output:  ppm of every target gas
+Remarks: Evaluates a*x^b for the curve of each gas_table entry as exp(ln(a) + b*ln(x)). The logarithm of the
+         ratio is shared by all curves, so a reading costs one logf and one expf per
+         gas instead of a full powf per gas.
 ************************************************************************************/ 
-int MQGetGasPercentage(float rs_ro_ratio, int gas_id);
+void MQGetGasConcentrations(float rs_ro_ratio, float *ppm);
 
-/*****************************  MQGetPercentage **********************************
-Input:   rs_ro_ratio - Rs divided by Ro
-         pcurve      - pointer to the curve of the target gas
-Output:  ppm of the target gas
-Remarks: USing the a * b coeffients in the equation a*x^b the ppm value is derived
+/*****************************  MQGetConcentrationsAt ******************************
+Input:   raw_adc - adc level of the MQ135, e.g. the peak of a burst capture
+         ppm     - array of GAS_COUNT results, indexed by GAS_LPG..GAS_NH4
+Output:  ppm of every target gas at that level
+Remarks: Corrected for temperature and humidity and rated against Ro like a reading.
 ************************************************************************************/ 
-int  MQGetPercentage(float rs_ro_ratio, float *pcurve);
+void MQGetConcentrationsAt(float raw_adc, float *ppm);
+
+/*****************************  get_correction_factor ******************************
+Input:   temperature - degrees C
+         humidity    - percent relative humidity
+Output:  the correction factor of the model, without clamping
+Remarks: The reference the correction tables are built from, readings only use the
+         tables. Kept for the host tests and bench to check the tables against.
+************************************************************************************/ 
+float get_correction_factor(float temperature, float humidity);
+
+#endif
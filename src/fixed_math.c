@@ -0,0 +1,67 @@
+/* Fixed point base 2 logarithm and exponential, see fixed_math.h
+ */
+
+#include "fixed_math.h"
+
+#define FX_SEGMENTS         64
+
+
+/* round(65536 * log2(1 + i / 64)) */
+static const uint32_t fx_log2_table[FX_SEGMENTS + 1] = {
+    0, 1466, 2909, 4331, 5732, 7112, 8473, 9814, 11136, 12440, 13727, 14996, 16248, 17484, 18704, 19909,
+    21098, 22272, 23433, 24579, 25711, 26830, 27936, 29029, 30109, 31178, 32234, 33279, 34312, 35334, 36346, 37346,
+    38336, 39316, 40286, 41246, 42196, 43137, 44068, 44990, 45904, 46809, 47705, 48593, 49472, 50344, 51207, 52063,
+    52911, 53751, 54584, 55410, 56229, 57040, 57845, 58643, 59434, 60219, 60997, 61769, 62534, 63294, 64047, 64794,
+    65536,
+};
+
+/* round(2^30 * 2^(i / 64)) */
+static const uint32_t fx_exp2_table[FX_SEGMENTS + 1] = {
+    1073741824, 1085434106, 1097253708, 1109202018, 1121280436, 1133490379, 1145833280, 1158310587,
+    1170923762, 1183674286, 1196563654, 1209593378, 1222764986, 1236080024, 1249540052, 1263146652,
+    1276901417, 1290805962, 1304861917, 1319070932, 1333434672, 1347954824, 1362633090, 1377471191,
+    1392470869, 1407633882, 1422962010, 1438457051, 1454120821, 1469955159, 1485961921, 1502142985,
+    1518500250, 1535035634, 1551751076, 1568648537, 1585730000, 1602997467, 1620452965, 1638098541,
+    1655936265, 1673968228, 1692196547, 1710623359, 1729250827, 1748081133, 1767116489, 1786359126,
+    1805811301, 1825475297, 1845353420, 1865448001, 1885761398, 1906295993, 1927054196, 1948038440,
+    1969251188, 1990694927, 2012372174, 2034285470, 2056437387, 2078830522, 2101467502, 2124350982,
+    2147483648u,
+};
+
+
+int32_t fx_log2(uint32_t value){
+    uint32_t fraction, index, rest;
+    int32_t exponent;
+
+    if (value == 0){
+        return FX_LOG2_ZERO;
+    }
+    /* value = 2^exponent * (1 + fraction / 2^31) */
+    exponent = 31 - __builtin_clz(value);
+    fraction = (value << (31 - exponent)) & 0x7fffffff;
+    index = fraction >> 25;
+    rest = (fraction >> 15) & 0x3ff;
+    return (exponent << 16) + fx_log2_table[index]
+        + (((fx_log2_table[index + 1] - fx_log2_table[index]) * rest + 512) >> 10);
+}
+
+
+uint32_t fx_exp2(int32_t exponent, uint8_t fraction_bits){
+    int32_t shift = (exponent >> 16) + fraction_bits - 30;
+    uint32_t index = (exponent >> 10) & 0x3f;
+    uint32_t rest = exponent & 0x3ff;
+    uint64_t mantissa;
+
+    /* 2^(fraction of the exponent) in Q30 */
+    mantissa = fx_exp2_table[index] + (((uint64_t) (fx_exp2_table[index + 1] - fx_exp2_table[index]) * rest + 512) >> 10);
+    if (shift >= 0){
+        if (shift > 2 || (mantissa << shift) > UINT32_MAX){
+            return UINT32_MAX;
+        }
+        return mantissa << shift;
+    }
+    if (shift < -31){
+        return 0;
+    }
+    return (mantissa + (1ULL << (-shift - 1))) >> -shift;
+}
@@ -0,0 +1,20 @@
+/* Base 2 logarithm and exponential in fixed point, for the MQ135_FIXED_POINT build
+ * of the measurement pipeline. Both use a 65 entry table with linear interpolation,
+ * the error is below 5e-5 in the logarithm and 3e-5 relative in the exponential.
+ */
+
+#ifndef __FIXED_MATH_H__
+#define __FIXED_MATH_H__
+
+#include <stdint.h>
+
+#define FX_LOG2_ZERO        INT32_MIN   /* fx_log2 of 0 */
+
+
+/* log2(value) in Q16, for a value in any Q format subtract its fraction bits << 16 */
+int32_t fx_log2(uint32_t value);
+
+/* 2^(exponent / 65536) with fraction_bits fraction bits, saturating at UINT32_MAX */
+uint32_t fx_exp2(int32_t exponent, uint8_t fraction_bits);
+
+#endif
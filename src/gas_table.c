@@ -0,0 +1,87 @@
+/* Description of every gas derived from the MQ135, see gas_table.h
+ */
+
+#include <math.h>
+#include "gas_table.h"
+#include "history_store.h"
+
+/* published through these, defined with the rest of the accessory in main.c */
+extern homekit_characteristic_t lpg_level, carbon_monoxide_level, pm10_density, methane_level, ammonium_level;
+extern homekit_characteristic_t lpg_hour_average, lpg_day_average, lpg_day_max, co_hour_average, co_day_average, co_day_max,
+    pm10_hour_average, pm10_day_average, pm10_day_max, ch4_hour_average, ch4_day_average, ch4_day_max,
+    nh4_hour_average, nh4_day_average, nh4_day_max;
+extern homekit_characteristic_t lpg_hour_min, lpg_hour_max, lpg_day_min, co_hour_min, co_hour_max, co_day_min,
+    pm10_hour_min, pm10_hour_max, pm10_day_min, ch4_hour_min, ch4_hour_max, ch4_day_min,
+    nh4_hour_min, nh4_hour_max, nh4_day_min;
+
+
+/* Values derived from exponential regression of respective gas datapoints from the datasheet.
+ *  The curves represent the a & b values in the a*x^b, a is held as ln(a) so that every curve
+ *  can be evaluated as exp(ln(a) + b*ln(x)) from a single logarithm of the ratio.
+ *  Gases with an aqi_pollutant are rated by the air quality index engine.
+ */
+const gas_descriptor_t gas_table[GAS_COUNT] = {
+    [GAS_LPG] = {
+        .name = "LPG", .curve = { 6.450211, -2.025202 },        /* a = 632.8357 */
+        .characteristic = &lpg_level,
+        .stat = { &lpg_hour_average, &lpg_day_average, &lpg_day_max, &lpg_hour_min, &lpg_hour_max, &lpg_day_min },
+        .min = 0, .max = 10000,
+        .notify_policy = { .abs_deadband = 1.0, .rel_deadband = 0.1, .min_interval_ms = 30000, .max_silence_ms = 30 * 60 * 1000 },
+        .aqi_pollutant = AQI_POLLUTANT_NONE,
+        .history_field = HISTORY_LPG,
+    },
+    [GAS_CO] = {
+        .name = "CO", .curve = { 4.758767, -2.769034857 },      /* a = 116.6020682 */
+        .characteristic = &carbon_monoxide_level,
+        .stat = { &co_hour_average, &co_day_average, &co_day_max, &co_hour_min, &co_hour_max, &co_day_min },
+        .min = 0, .max = 100,
+        .notify_policy = { .abs_deadband = 1.0, .rel_deadband = 0.05, .min_interval_ms = 6000, .max_silence_ms = 15 * 60 * 1000 },
+        .aqi_pollutant = AQI_POLLUTANT_CO,
+        .history_field = HISTORY_CO,
+    },
+    [GAS_PM10] = {
+        .name = "PM10", .curve = { 8.267808, -1.886306 },       /* a = 3896.4 */
+        .characteristic = &pm10_density,
+        .stat = { &pm10_hour_average, &pm10_day_average, &pm10_day_max, &pm10_hour_min, &pm10_hour_max, &pm10_day_min },
+        .min = 0, .max = 1000,
+        .notify_policy = { .abs_deadband = 5.0, .rel_deadband = 0.05, .min_interval_ms = 6000, .max_silence_ms = 15 * 60 * 1000 },
+        .aqi_pollutant = AQI_POLLUTANT_PM10,
+        .history_field = HISTORY_PM10,
+    },
+    [GAS_CH4] = {
+        .name = "CH4", .curve = { 8.314964, -2.410099 },        /* a = 4084.538 */
+        .characteristic = &methane_level,
+        .stat = { &ch4_hour_average, &ch4_day_average, &ch4_day_max, &ch4_hour_min, &ch4_hour_max, &ch4_day_min },
+        .min = 0, .max = 10000,
+        .notify_policy = { .abs_deadband = 1.0, .rel_deadband = 0.1, .min_interval_ms = 30000, .max_silence_ms = 30 * 60 * 1000 },
+        .aqi_pollutant = AQI_POLLUTANT_NONE,
+        .history_field = HISTORY_CH4,
+    },
+    [GAS_NH4] = {
+        .name = "NH4", .curve = { 4.627272, -2.554241 },        /* a = 102.2348 */
+        .characteristic = &ammonium_level,
+        .stat = { &nh4_hour_average, &nh4_day_average, &nh4_day_max, &nh4_hour_min, &nh4_hour_max, &nh4_day_min },
+        .min = 0, .max = 10000,
+        .notify_policy = { .abs_deadband = 1.0, .rel_deadband = 0.1, .min_interval_ms = 30000, .max_silence_ms = 30 * 60 * 1000 },
+        .aqi_pollutant = AQI_POLLUTANT_NONE,
+        .history_field = HISTORY_NH4,
+    },
+};
+
+
+float gas_clamp(const gas_descriptor_t *gas, float value){
+    /* keep within the range of the table and of the characteristic */
+    if (isnan(value) || value < gas->min){
+        value = gas->min;
+    }
+    if (value > gas->max){
+        value = gas->max;
+    }
+    if (gas->characteristic->min_value && value < *gas->characteristic->min_value){
+        value = *gas->characteristic->min_value;
+    }
+    if (gas->characteristic->max_value && value > *gas->characteristic->max_value){
+        value = *gas->characteristic->max_value;
+    }
+    return value;
+}
@@ -0,0 +1,48 @@
+/* Description of every gas derived from the MQ135, one const entry per gas holding
+ * everything needed to compute, clamp, rate and publish it.
+ */
+
+#ifndef __GAS_TABLE_H__
+#define __GAS_TABLE_H__
+
+#include <stdint.h>
+#include <homekit/homekit.h>
+#include "notify_filter.h"
+#include "esp8266_mq135.h"
+#include "air_quality_index.h"
+
+/* statistics published for every gas */
+#define GAS_STAT_HOUR_AVERAGE       0       /* time weighted, over the last hour */
+#define GAS_STAT_DAY_AVERAGE        1       /* time weighted, over the last day */
+#define GAS_STAT_DAY_MAX            2
+#define GAS_STAT_HOUR_MIN           3
+#define GAS_STAT_HOUR_MAX           4
+#define GAS_STAT_DAY_MIN            5
+#define GAS_STAT_COUNT              6
+
+
+/* curve of a gas, ppm = a * (Rs/Ro)^b, with a stored as ln(a) */
+typedef struct {
+    float ln_a;
+    float b;
+} mq_gas_curve_t;
+
+
+typedef struct {
+    const char *name;
+    mq_gas_curve_t curve;
+    homekit_characteristic_t *characteristic;
+    homekit_characteristic_t *stat[GAS_STAT_COUNT];     /* GAS_STAT_* of the gas */
+    notify_policy_t notify_policy;      /* deadbands and rate limits of notifies */
+    float min, max;                     /* range published to homekit */
+    uint8_t aqi_pollutant;              /* AQI_POLLUTANT_* the gas is rated as, AQI_POLLUTANT_NONE if it does not count */
+    uint8_t history_field;              /* history_field_t the value is recorded in */
+} gas_descriptor_t;
+
+
+extern const gas_descriptor_t gas_table[GAS_COUNT];
+
+/* keep a value within the range of the gas and of its characteristic, NaN becomes the minimum */
+float gas_clamp(const gas_descriptor_t *gas, float value);
+
+#endif
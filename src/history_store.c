@@ -0,0 +1,424 @@
+/* Log structured history of the sensor readings, see history_store.h
+ *
+ * Each page starts with a header holding its sequence number and the first record
+ * in full, the remaining records are stored as the varint encoded, zigzagged
+ * differences from the record before. Pages are programmed with the magic left
+ * erased and the magic written last, so a page interrupted by a reset is never
+ * taken as valid.
+ *
+ * An export is paced a tick a packet so lwip keeps up, which holds up the other
+ * deferred work for about half a second for each day of history.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <spiflash.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include <lwip/sockets.h>
+#include "history_store.h"
+#include "sensor_hal.h"
+#include "deferred_work.h"
+
+#if HISTORY_FLASH_SECTORS > 0
+
+#define HISTORY_PAGE_MAGIC      0x4853
+#define HISTORY_BLANK_MAGIC     0xffff
+#define HISTORY_HEADER_SIZE     (8 + sizeof(history_record_t))
+#define HISTORY_DATA_SIZE       (HISTORY_PAGE_SIZE - HISTORY_HEADER_SIZE)
+#define HISTORY_MAX_RECORD_SIZE (5 * (1 + HISTORY_FIELD_COUNT))
+
+
+typedef struct {
+    uint16_t magic;
+    uint16_t length;                /* bytes used in data */
+    uint32_t sequence;
+    history_record_t first;
+    uint8_t data[HISTORY_DATA_SIZE];
+} history_page_t;
+
+
+static history_page_t history_pages[2];     /* one being built, one waiting for the writer */
+static history_page_t history_read_page;
+static uint8_t history_building = 0;
+static volatile int8_t history_pending = -1;
+static history_record_t history_last;
+static uint32_t history_next_page = 0;
+static uint32_t history_next_sequence = 0;
+static uint32_t history_time_offset = 0;
+static SemaphoreHandle_t history_lock = NULL;
+static SemaphoreHandle_t history_read_lock = NULL;
+static void history_write(void);
+static deferred_work_t history_work = DEFERRED_WORK("History", history_write, 0);
+static void history_export_run(void);
+static deferred_work_t history_export_work = DEFERRED_WORK("History export", history_export_run, 0);
+static volatile uint32_t history_export_from;
+static int history_socket = -1;
+
+static struct {
+    history_packet_header_t header;
+    history_record_t record[HISTORY_PACKET_RECORDS];
+} history_packet;
+
+
+static uint32_t history_page_address(uint32_t page){
+    return HISTORY_FLASH_BASE_ADDR + page * HISTORY_PAGE_SIZE;
+}
+
+
+static uint8_t history_put_varint(uint8_t *buffer, uint32_t value){
+    uint8_t length = 0;
+
+    while (value >= 0x80){
+        buffer[length++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buffer[length++] = value;
+    return length;
+}
+
+
+static bool history_get_varint(const uint8_t *buffer, uint16_t length, uint16_t *offset, uint32_t *value){
+    uint8_t shift = 0;
+
+    *value = 0;
+    while (*offset < length && shift < 35){
+        uint8_t byte = buffer[(*offset)++];
+        *value |= (uint32_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)){
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+
+static uint32_t history_zigzag(int32_t value){
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+
+static int32_t history_unzigzag(uint32_t value){
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+
+/* decode the records of a page in order, returns false if the callback asked to stop */
+static bool history_page_decode(const history_page_t *page, uint32_t from, uint32_t to, history_callback_t callback, void *context, uint32_t *count){
+    history_record_t record = page->first;
+    uint16_t offset = 0;
+    uint32_t delta;
+    int field;
+
+    while (1){
+        if (record.time > to){
+            return false;
+        }
+        if (record.time >= from){
+            (*count)++;
+            if (!callback(&record, context)){
+                return false;
+            }
+        }
+        if (offset >= page->length || page->length > HISTORY_DATA_SIZE){
+            return true;
+        }
+        if (!history_get_varint(page->data, page->length, &offset, &delta)){
+            return true;
+        }
+        record.time += delta;
+        for (field = 0; field < HISTORY_FIELD_COUNT; field++){
+            if (!history_get_varint(page->data, page->length, &offset, &delta)){
+                return true;
+            }
+            record.value[field] = (uint32_t) record.value[field] + (uint32_t) history_unzigzag(delta);
+        }
+    }
+}
+
+
+static void history_write(void){
+    history_page_t *page;
+    uint32_t address;
+
+    if (history_pending < 0){
+        return;
+    }
+    page = &history_pages[history_pending];
+    address = history_page_address(history_next_page);
+
+    if (history_next_page % HISTORY_PAGES_PER_SECTOR == 0){
+        /* moving into a sector, which drops the oldest sector of history */
+        spiflash_erase_sector(address);
+    }
+    page->magic = HISTORY_BLANK_MAGIC;
+    spiflash_write(address, (uint8_t *) page, HISTORY_PAGE_SIZE);
+    page->magic = HISTORY_PAGE_MAGIC;
+    spiflash_write(address, (uint8_t *) page, 4);
+
+    history_next_page = (history_next_page + 1) % HISTORY_PAGE_COUNT;
+    history_pending = -1;
+}
+
+
+static bool history_last_record(const history_record_t *record, void *context){
+    history_last = *record;
+    return true;
+}
+
+
+bool history_init(void){
+    uint32_t page, newest = HISTORY_PAGE_COUNT, count = 0;
+    uint32_t header[2];
+
+    history_lock = xSemaphoreCreateMutex();
+    history_read_lock = xSemaphoreCreateMutex();
+    if (history_lock == NULL || history_read_lock == NULL){
+        printf("%s: failed to create locks\n", __func__);
+        return false;
+    }
+
+    for (page = 0; page < HISTORY_PAGE_COUNT; page++){
+        spiflash_read(history_page_address(page), (uint8_t *) header, sizeof(header));
+        if ((header[0] & 0xffff) != HISTORY_PAGE_MAGIC){
+            continue;
+        }
+        if (newest == HISTORY_PAGE_COUNT || (int32_t) (header[1] - history_next_sequence) >= 0){
+            newest = page;
+            history_next_sequence = header[1] + 1;
+        }
+    }
+
+    if (newest < HISTORY_PAGE_COUNT){
+        /* carry the time on from the newest record so history time never goes backwards */
+        spiflash_read(history_page_address(newest), (uint8_t *) &history_read_page, HISTORY_PAGE_SIZE);
+        history_page_decode(&history_read_page, 0, UINT32_MAX, history_last_record, NULL, &count);
+        history_time_offset = history_last.time + 1 - sensor_hal->now_ms() / 1000;
+        history_next_page = (newest + 1) % HISTORY_PAGE_COUNT;
+
+        spiflash_read(history_page_address(history_next_page), (uint8_t *) header, sizeof(header));
+        if (history_next_page % HISTORY_PAGES_PER_SECTOR != 0 && (header[0] != 0xffffffff || header[1] != 0xffffffff)){
+            /* the next page is not blank, e.g. a write was interrupted, so start the next sector */
+            history_next_page = (history_next_page / HISTORY_PAGES_PER_SECTOR + 1) * HISTORY_PAGES_PER_SECTOR % HISTORY_PAGE_COUNT;
+        }
+    }
+    printf("%s: next page %u, sequence %u, time %u\n", __func__, history_next_page, history_next_sequence, history_time());
+
+    if (!deferred_work_add(&history_work) || !deferred_work_add(&history_export_work)){
+        printf("%s: failed to add the writer\n", __func__);
+        return false;
+    }
+    return true;
+}
+
+
+uint32_t history_time(void){
+    return history_time_offset + sensor_hal->now_ms() / 1000;
+}
+
+
+/* hand the page being built to the writer, must hold history_lock */
+static void history_commit(void){
+    history_page_t *page = &history_pages[history_building];
+
+    if (page->magic != HISTORY_PAGE_MAGIC){
+        return;
+    }
+    if (history_pending >= 0){
+        printf("%s: writer is behind, page %u dropped\n", __func__, page->sequence);
+    } else {
+        history_pending = history_building;
+        history_building ^= 1;
+        deferred_work_request(&history_work);
+    }
+    history_pages[history_building].magic = HISTORY_BLANK_MAGIC;
+}
+
+
+void history_append(history_record_t *record){
+    history_page_t *page;
+    uint8_t encoded[HISTORY_MAX_RECORD_SIZE];
+    uint8_t length;
+    int field;
+
+    if (history_lock == NULL){
+        return;
+    }
+    if (record->time == 0){
+        record->time = history_time();
+    }
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    page = &history_pages[history_building];
+    if (page->magic == HISTORY_PAGE_MAGIC){
+        length = history_put_varint(encoded, record->time - history_last.time);
+        for (field = 0; field < HISTORY_FIELD_COUNT; field++){
+            /* wrapping, a field going to or from HISTORY_NO_VALUE overflows an int32 */
+            length += history_put_varint(&encoded[length], history_zigzag((uint32_t) record->value[field] - (uint32_t) history_last.value[field]));
+        }
+        if (page->length + length <= HISTORY_DATA_SIZE){
+            memcpy(&page->data[page->length], encoded, length);
+            page->length += length;
+            history_last = *record;
+            xSemaphoreGive(history_lock);
+            return;
+        }
+        history_commit();
+        page = &history_pages[history_building];
+    }
+
+    /* start a new page with this record in full */
+    memset(page, 0xff, sizeof(*page));
+    page->magic = HISTORY_PAGE_MAGIC;
+    page->length = 0;
+    page->sequence = history_next_sequence++;
+    page->first = *record;
+    history_last = *record;
+    xSemaphoreGive(history_lock);
+}
+
+
+void history_flush(void){
+    if (history_lock == NULL){
+        return;
+    }
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    history_commit();
+    xSemaphoreGive(history_lock);
+}
+
+
+uint32_t history_stream(uint32_t from, uint32_t to, history_callback_t callback, void *context){
+    uint32_t count = 0, page, i;
+    int8_t pending;
+    bool more = true;
+
+    if (history_lock == NULL){
+        return 0;
+    }
+    xSemaphoreTake(history_read_lock, portMAX_DELAY);
+
+    /* flash pages, oldest first */
+    for (i = 0, page = history_next_page; i < HISTORY_PAGE_COUNT && more; i++, page = (page + 1) % HISTORY_PAGE_COUNT){
+        spiflash_read(history_page_address(page), (uint8_t *) &history_read_page, HISTORY_PAGE_SIZE);
+        if (history_read_page.magic != HISTORY_PAGE_MAGIC){
+            continue;
+        }
+        more = history_page_decode(&history_read_page, from, to, callback, context, &count);
+    }
+
+    /* pages still in RAM */
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    pending = history_pending;
+    if (more && pending >= 0){
+        history_read_page = history_pages[pending];
+        xSemaphoreGive(history_lock);
+        more = history_page_decode(&history_read_page, from, to, callback, context, &count);
+        xSemaphoreTake(history_lock, portMAX_DELAY);
+    }
+    if (more && history_pages[history_building].magic == HISTORY_PAGE_MAGIC){
+        history_read_page = history_pages[history_building];
+        xSemaphoreGive(history_lock);
+        history_page_decode(&history_read_page, from, to, callback, context, &count);
+    } else {
+        xSemaphoreGive(history_lock);
+    }
+
+    xSemaphoreGive(history_read_lock);
+    return count;
+}
+
+
+static void history_packet_send(void){
+    struct sockaddr_in address;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(HISTORY_PORT);
+    address.sin_addr.s_addr = INADDR_BROADCAST;
+    sendto(history_socket, &history_packet, sizeof(history_packet.header) + history_packet.header.count * sizeof(history_record_t), 0,
+        (struct sockaddr *) &address, sizeof(address));
+    history_packet.header.sequence++;
+    history_packet.header.count = 0;
+    vTaskDelay(1);
+}
+
+
+static bool history_export_record(const history_record_t *record, void *context){
+    history_packet.record[history_packet.header.count++] = *record;
+    if (history_packet.header.count == HISTORY_PACKET_RECORDS){
+        history_packet_send();
+    }
+    return true;
+}
+
+
+static void history_export_run(void){
+    int broadcast = 1;
+    uint32_t count;
+
+    if (history_socket < 0){
+        history_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (history_socket < 0){
+            printf("%s: no socket\n", __func__);
+            return;
+        }
+        setsockopt(history_socket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+    }
+    history_packet.header.magic = HISTORY_PACKET_MAGIC;
+    history_packet.header.version = HISTORY_PACKET_VERSION;
+    history_packet.header.count = 0;
+    history_packet.header.sequence = 0;
+
+    count = history_stream(history_export_from, UINT32_MAX, history_export_record, NULL);
+    if (history_packet.header.count > 0){
+        history_packet_send();
+    }
+    /* the end */
+    history_packet_send();
+    printf("%s: %u records from %u\n", __func__, count, history_export_from);
+}
+
+
+void history_export(uint32_t from){
+    if (history_lock == NULL){
+        printf("%s: no history\n", __func__);
+        return;
+    }
+    history_export_from = from;
+    deferred_work_request(&history_export_work);
+}
+
+#else
+
+bool history_init(void){
+    printf("%s: no flash region, the history is off\n", __func__);
+    return false;
+}
+
+
+uint32_t history_time(void){
+    return sensor_hal->now_ms() / 1000;
+}
+
+
+void history_append(history_record_t *record){
+}
+
+
+void history_flush(void){
+}
+
+
+uint32_t history_stream(uint32_t from, uint32_t to, history_callback_t callback, void *context){
+    return 0;
+}
+
+
+void history_export(uint32_t from){
+    printf("%s: no history\n", __func__);
+}
+
+#endif
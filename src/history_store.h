@@ -0,0 +1,92 @@
+/* Log structured history of the sensor readings in a reserved region of flash.
+ *
+ * Records are delta and varint encoded into 256 byte pages held in RAM, a full
+ * page is handed to the deferred work task which erases and programs the flash,
+ * so the sensor tasks never wait on it. Sectors are
+ * used round robin, the oldest sector being erased when the region is full, which
+ * spreads erases evenly over the region.
+ *
+ * The region is only used when the Makefile sets one, it has to be clear of both
+ * OTA slots and of the homekit storage. Without it the history is off, records
+ * are dropped and nothing is streamed.
+ *
+ * history_export broadcasts the records from a given time on as UDP packets,
+ * tools/history_dump.py writes them out as CSV. tools/history_bench measures the
+ * encoding density and the append and stream rates on a simulated flash.
+ */
+
+#ifndef __HISTORY_STORE_H__
+#define __HISTORY_STORE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef HISTORY_FLASH_SECTORS
+#define HISTORY_FLASH_SECTORS       0           /* no flash region unless the Makefile sets one */
+#endif
+
+#define HISTORY_SECTOR_SIZE         4096
+#define HISTORY_PAGE_SIZE           256
+#define HISTORY_PAGES_PER_SECTOR    (HISTORY_SECTOR_SIZE / HISTORY_PAGE_SIZE)
+#define HISTORY_PAGE_COUNT          (HISTORY_FLASH_SECTORS * HISTORY_PAGES_PER_SECTOR)
+#define HISTORY_INTERVAL_MS         60000       /* how often the sensor task appends a record */
+#define HISTORY_PORT                45682       /* next to the trace port */
+#define HISTORY_PACKET_MAGIC        0x54534948  /* "HIST" */
+#define HISTORY_PACKET_VERSION      1
+#define HISTORY_PACKET_RECORDS      32
+#define HISTORY_NO_VALUE            INT32_MIN   /* a field without a reading, e.g. the DHT22 failing */
+
+
+/* fields of a record, all scaled to integers */
+typedef enum {
+    HISTORY_TEMPERATURE = 0,        /* 0.1 C */
+    HISTORY_HUMIDITY,               /* 0.1 % */
+    HISTORY_RS,                     /* ohms */
+    HISTORY_CO,                     /* 0.1 ppm */
+    HISTORY_LPG,                    /* 0.1 ppm */
+    HISTORY_PM10,                   /* 0.1 ug/m3 */
+    HISTORY_CH4,                    /* 0.1 ppm */
+    HISTORY_NH4,                    /* 0.1 ppm */
+    HISTORY_FIELD_COUNT
+} history_field_t;
+
+
+typedef struct {
+    uint32_t time;                  /* seconds, carried on across restarts */
+    int32_t value[HISTORY_FIELD_COUNT];
+} history_record_t;
+
+
+/* an export is a run of packets with sequence counting up from 0, ended by one without records */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;                 /* records that follow */
+    uint32_t sequence;
+} history_packet_header_t;
+
+
+/* called for each record streamed out, return false to stop */
+typedef bool (*history_callback_t)(const history_record_t *record, void *context);
+
+
+/* find the newest page in flash and add the writer to the deferred work, returns
+   false when there is no region */
+bool history_init(void);
+
+/* current history time in seconds */
+uint32_t history_time(void);
+
+/* add a record to the page being built, time is filled in if zero */
+void history_append(history_record_t *record);
+
+/* write out the partially filled page, e.g. before a restart */
+void history_flush(void);
+
+/* stream records with from <= time <= to in time order, returns the number streamed */
+uint32_t history_stream(uint32_t from, uint32_t to, history_callback_t callback, void *context);
+
+/* broadcast the records from a time on to HISTORY_PORT, from the deferred work task */
+void history_export(uint32_t from);
+
+#endif
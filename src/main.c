@@ -26,6 +26,11 @@
 #define FW_VERSION "1.0"
 #define TEMPERATURE_SENSOR_GPIO 5
 #define TEMPERATURE_POLL_PERIOD 10000
+#define AIR_QUALITY_POLL_PERIOD 3000
+#define DHT_MIN_POLL_PERIOD 2000    //the DHT22 cannot be read more often
+#define POLL_MIN_PERIOD 1           //seconds, default bounds of the adaptive polling
+#define POLL_MAX_PERIOD 60
+#define BURST_POLL_PERIOD 1000      //how often a finished burst capture is looked for
 
 #include <stdio.h>
 #include <math.h>
@@ -41,7 +46,6 @@
 #include <esp8266_mq135.h>
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
-#include <dht/dht.h>
 
 #include <stdout_redirect.h>
 #include <led_codes.h>
@@ -50,6 +54,24 @@
 #include <adv_button.h>
 #include <udplogger.h>
 #include <shared_functions.h>
+#include "notify_filter.h"
+#include "history_store.h"
+#include "gas_table.h"
+#include "air_quality_characteristics.h"
+#include "sensor_scheduler.h"
+#include "perf_stats.h"
+#include "env_snapshot.h"
+#include "binlog.h"
+#include "rate_controller.h"
+#include "signal_filter.h"
+#include "adc_sampler.h"
+#include "sensor_trace.h"
+#include "dht22.h"
+#include "mq_channels.h"
+#include "window_stats.h"
+#include "rtc_snapshot.h"
+#include "config_store.h"
+#include "burst_capture.h"
 
 
 // add this section to make your device OTA capable
@@ -67,7 +89,6 @@ const int status_led_gpio = 13;
 int led_off_value=1;
 
 
-
 homekit_characteristic_t wifi_reset   = HOMEKIT_CHARACTERISTIC_(CUSTOM_WIFI_RESET, false, .setter=wifi_reset_set);
 homekit_characteristic_t wifi_check_interval   = HOMEKIT_CHARACTERISTIC_(CUSTOM_WIFI_CHECK_INTERVAL, 10, .setter=wifi_check_interval_set);
 /* checks the wifi is connected and flashes status led to indicated connected */
@@ -105,10 +126,106 @@ homekit_characteristic_t lpg_level                  = HOMEKIT_CHARACTERISTIC_( C
 homekit_characteristic_t methane_level              = HOMEKIT_CHARACTERISTIC_( CUSTOM_METHANE_LEVEL, 0 );
 homekit_characteristic_t ammonium_level             = HOMEKIT_CHARACTERISTIC_( CUSTOM_AMMONIUM_LEVEL, 0 );
 
-
-
-float humidity_value, temperature_value;
-TaskHandle_t temperature_sensor_task_handle, air_quality_sensor_task_handle;
+//statistics of the gases, kept on the device so controllers read one value rather than polling
+homekit_characteristic_t co_8h_twa                  = HOMEKIT_CHARACTERISTIC_( CUSTOM_CO_8H_TWA, 0 );
+homekit_characteristic_t lpg_hour_average           = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_HOUR_AVERAGE, "LPG 1h Average", 0 );
+homekit_characteristic_t lpg_day_average            = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_DAY_AVERAGE, "LPG 24h Average", 0 );
+homekit_characteristic_t lpg_day_max                = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_DAY_MAX, "LPG 24h Max", 0 );
+homekit_characteristic_t co_hour_average            = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CO_HOUR_AVERAGE, "CO 1h Average", 0 );
+homekit_characteristic_t co_day_average             = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CO_DAY_AVERAGE, "CO 24h Average", 0 );
+homekit_characteristic_t co_day_max                 = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CO_DAY_MAX, "CO 24h Max", 0 );
+homekit_characteristic_t pm10_hour_average          = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_HOUR_AVERAGE, "PM10 1h Average", 0 );
+homekit_characteristic_t pm10_day_average           = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_DAY_AVERAGE, "PM10 24h Average", 0 );
+homekit_characteristic_t pm10_day_max               = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_DAY_MAX, "PM10 24h Max", 0 );
+homekit_characteristic_t ch4_hour_average           = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_HOUR_AVERAGE, "CH4 1h Average", 0 );
+homekit_characteristic_t ch4_day_average            = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_DAY_AVERAGE, "CH4 24h Average", 0 );
+homekit_characteristic_t ch4_day_max                = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_DAY_MAX, "CH4 24h Max", 0 );
+homekit_characteristic_t nh4_hour_average           = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_HOUR_AVERAGE, "NH4 1h Average", 0 );
+homekit_characteristic_t nh4_day_average            = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_DAY_AVERAGE, "NH4 24h Average", 0 );
+homekit_characteristic_t nh4_day_max                = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_DAY_MAX, "NH4 24h Max", 0 );
+homekit_characteristic_t lpg_hour_min               = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_HOUR_MIN, "LPG 1h Min", 0 );
+homekit_characteristic_t lpg_hour_max               = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_HOUR_MAX, "LPG 1h Max", 0 );
+homekit_characteristic_t lpg_day_min                = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_LPG_DAY_MIN, "LPG 24h Min", 0 );
+homekit_characteristic_t co_hour_min                = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CO_HOUR_MIN, "CO 1h Min", 0 );
+homekit_characteristic_t co_hour_max                = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CO_HOUR_MAX, "CO 1h Max", 0 );
+homekit_characteristic_t co_day_min                 = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CO_DAY_MIN, "CO 24h Min", 0 );
+homekit_characteristic_t pm10_hour_min              = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_HOUR_MIN, "PM10 1h Min", 0 );
+homekit_characteristic_t pm10_hour_max              = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_HOUR_MAX, "PM10 1h Max", 0 );
+homekit_characteristic_t pm10_day_min               = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_PM10_DAY_MIN, "PM10 24h Min", 0 );
+homekit_characteristic_t ch4_hour_min               = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_HOUR_MIN, "CH4 1h Min", 0 );
+homekit_characteristic_t ch4_hour_max               = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_HOUR_MAX, "CH4 1h Max", 0 );
+homekit_characteristic_t ch4_day_min                = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_CH4_DAY_MIN, "CH4 24h Min", 0 );
+homekit_characteristic_t nh4_hour_min               = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_HOUR_MIN, "NH4 1h Min", 0 );
+homekit_characteristic_t nh4_hour_max               = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_HOUR_MAX, "NH4 1h Max", 0 );
+homekit_characteristic_t nh4_day_min                = HOMEKIT_CHARACTERISTIC_( CUSTOM_GAS_STATISTIC, HOMEKIT_CHARACTERISTIC_CUSTOM_NH4_DAY_MIN, "NH4 24h Min", 0 );
+
+void aqi_standard_set (homekit_value_t value);
+homekit_characteristic_t aqi_standard               = HOMEKIT_CHARACTERISTIC_( CUSTOM_AQI_STANDARD, AQI_STANDARD, .setter=aqi_standard_set );
+homekit_characteristic_t aqi_index                  = HOMEKIT_CHARACTERISTIC_( CUSTOM_AQI_INDEX, 0 );
+homekit_characteristic_t mq135_ro                   = HOMEKIT_CHARACTERISTIC_( CUSTOM_MQ135_RO, 0 );
+void poll_min_period_set (homekit_value_t value);
+void poll_max_period_set (homekit_value_t value);
+homekit_characteristic_t poll_min_period            = HOMEKIT_CHARACTERISTIC_( CUSTOM_POLL_MIN_PERIOD, POLL_MIN_PERIOD, .setter=poll_min_period_set );
+homekit_characteristic_t poll_max_period            = HOMEKIT_CHARACTERISTIC_( CUSTOM_POLL_MAX_PERIOD, POLL_MAX_PERIOD, .setter=poll_max_period_set );
+void trace_mode_set (homekit_value_t value);
+homekit_characteristic_t trace_mode                 = HOMEKIT_CHARACTERISTIC_( CUSTOM_TRACE_MODE, TRACE_OFF, .setter=trace_mode_set );
+void burst_trigger_level_set (homekit_value_t value);
+void burst_trigger_slope_set (homekit_value_t value);
+homekit_characteristic_t burst_trigger_level        = HOMEKIT_CHARACTERISTIC_( CUSTOM_BURST_TRIGGER_LEVEL, BURST_TRIGGER_LEVEL, .setter=burst_trigger_level_set );
+homekit_characteristic_t burst_trigger_slope        = HOMEKIT_CHARACTERISTIC_( CUSTOM_BURST_TRIGGER_SLOPE, BURST_TRIGGER_SLOPE, .setter=burst_trigger_slope_set );
+void history_export_set (homekit_value_t value);
+homekit_characteristic_t history_export_hours       = HOMEKIT_CHARACTERISTIC_( CUSTOM_HISTORY_EXPORT, 0, .setter=history_export_set );
+
+//fast transients, from the burst capture
+homekit_characteristic_t burst_peak_co              = HOMEKIT_CHARACTERISTIC_( CUSTOM_BURST_PEAK_CO, 0 );
+homekit_characteristic_t burst_peak_lpg             = HOMEKIT_CHARACTERISTIC_( CUSTOM_BURST_PEAK_LPG, 0 );
+homekit_characteristic_t burst_time_to_peak         = HOMEKIT_CHARACTERISTIC_( CUSTOM_BURST_TIME_TO_PEAK, 0 );
+
+//instrumentation
+homekit_characteristic_t sampled_min_free_heap      = HOMEKIT_CHARACTERISTIC_( CUSTOM_SAMPLED_MIN_FREE_HEAP, 0 );
+homekit_characteristic_t min_stack_free             = HOMEKIT_CHARACTERISTIC_( CUSTOM_MIN_STACK_FREE, 0 );
+homekit_characteristic_t max_stage_kcycles          = HOMEKIT_CHARACTERISTIC_( CUSTOM_MAX_STAGE_KCYCLES, 0 );
+
+
+/* notify policies, values are only pushed to clients when they move by more than the deadband */
+notify_filter_t temperature_notify      = NOTIFY_FILTER( &current_temperature, .abs_deadband = 0.2, .max_silence_ms = 15 * 60 * 1000 );
+notify_filter_t humidity_notify         = NOTIFY_FILTER( &current_relative_humidity, .abs_deadband = 1.0, .max_silence_ms = 15 * 60 * 1000 );
+notify_filter_t air_quality_notify      = NOTIFY_FILTER( &air_quality, .abs_deadband = 1, .max_silence_ms = 15 * 60 * 1000 );
+notify_filter_t aqi_index_notify        = NOTIFY_FILTER( &aqi_index, .abs_deadband = 5, .rel_deadband = 0.05, .min_interval_ms = 6000, .max_silence_ms = 15 * 60 * 1000 );
+notify_filter_t gas_notify[GAS_COUNT];      /* set up from gas_table */
+notify_filter_t mq_channel_notify[ADC_MUX_CHANNELS];   /* set up from mq_channel_outputs */
+notify_filter_t mq135_ro_notify         = NOTIFY_FILTER( &mq135_ro, .min_interval_ms = 0 );
+notify_filter_t mq_channel_ro_notify[ADC_MUX_CHANNELS];    /* set up from mq_channel_outputs */
+notify_filter_t gas_stat_notify[GAS_COUNT][GAS_STAT_COUNT];     /* set up from gas_table */
+notify_filter_t co_8h_twa_notify        = NOTIFY_FILTER( &co_8h_twa, .abs_deadband = 0.5, .rel_deadband = 0.02, .min_interval_ms = 60000, .max_silence_ms = 60 * 60 * 1000 );
+notify_filter_t burst_peak_co_notify    = NOTIFY_FILTER( &burst_peak_co, .min_interval_ms = 0 );
+notify_filter_t burst_peak_lpg_notify   = NOTIFY_FILTER( &burst_peak_lpg, .min_interval_ms = 0 );
+notify_filter_t burst_time_to_peak_notify = NOTIFY_FILTER( &burst_time_to_peak, .min_interval_ms = 0 );
+const notify_policy_t gas_stat_notify_policy = { .abs_deadband = 0.5, .rel_deadband = 0.02, .min_interval_ms = 60000, .max_silence_ms = 60 * 60 * 1000 };
+const notify_policy_t ro_notify_policy = { .min_interval_ms = 0 };     /* every change of a baseline */
+
+
+#define CO_TWA_HOURS 8      //hours of the carbon monoxide exposure average
+window_stats_t gas_stats[GAS_COUNT];
+
+
+/* adaptive polling, air quality follows ln(Rs) so its thresholds are relative changes of Rs */
+rate_controller_t temperature_rate      = RATE_CONTROLLER( 0.01, 0.5, TEMPERATURE_POLL_PERIOD );
+rate_controller_t air_quality_rate      = RATE_CONTROLLER( 0.002, 0.1, AIR_QUALITY_POLL_PERIOD );
+volatile bool air_quality_woken = false;   //by a burst trigger, set in the timer task
+
+
+signal_filter_t temperature_filter      = ENV_TEMPERATURE_FILTER;
+signal_filter_t humidity_filter         = ENV_HUMIDITY_FILTER;
+
+
+mq_readings_t readings;
+bool readings_taken = false;    //readings holds a reading of this run, not zeros or a restored one
+TaskHandle_t sensor_task_handle;
+
+/* what was being served before a soft reset, from the RTC memory */
+rtc_state_t warm_state;
+bool warm_start = false;
 
 homekit_accessory_t *accessories[] = {
     HOMEKIT_ACCESSORY(.id=1, .category=homekit_accessory_category_sensor, .services=(homekit_service_t*[]){
@@ -143,6 +260,52 @@ homekit_accessory_t *accessories[] = {
             &lpg_level,
             &methane_level,
             &ammonium_level,
+            &co_8h_twa,
+            &lpg_hour_average,
+            &lpg_day_average,
+            &lpg_day_max,
+            &lpg_hour_min,
+            &lpg_hour_max,
+            &lpg_day_min,
+            &co_hour_average,
+            &co_day_average,
+            &co_day_max,
+            &co_hour_min,
+            &co_hour_max,
+            &co_day_min,
+            &pm10_hour_average,
+            &pm10_day_average,
+            &pm10_day_max,
+            &pm10_hour_min,
+            &pm10_hour_max,
+            &pm10_day_min,
+            &ch4_hour_average,
+            &ch4_day_average,
+            &ch4_day_max,
+            &ch4_hour_min,
+            &ch4_hour_max,
+            &ch4_day_min,
+            &nh4_hour_average,
+            &nh4_day_average,
+            &nh4_day_max,
+            &nh4_hour_min,
+            &nh4_hour_max,
+            &nh4_day_min,
+            &burst_peak_co,
+            &burst_peak_lpg,
+            &burst_time_to_peak,
+            &aqi_standard,
+            &aqi_index,
+            &mq135_ro,
+            &sampled_min_free_heap,
+            &min_stack_free,
+            &max_stage_kcycles,
+            &poll_min_period,
+            &poll_max_period,
+            &trace_mode,
+            &burst_trigger_level,
+            &burst_trigger_slope,
+            &history_export_hours,
             &ota_trigger,
             &wifi_reset,
             &wifi_check_interval,
@@ -151,115 +314,448 @@ homekit_accessory_t *accessories[] = {
             &lcm_beta,
             NULL
         }),
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ7
+        HOMEKIT_SERVICE(CUSTOM_MQ_CHANNEL, .characteristics=(homekit_characteristic_t*[]){
+            HOMEKIT_CHARACTERISTIC(NAME, "MQ7 Sensor"),
+            &mq7_ppm,
+            &mq7_ro,
+            NULL
+        }),
+#endif
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ4
+        HOMEKIT_SERVICE(CUSTOM_MQ_CHANNEL, .characteristics=(homekit_characteristic_t*[]){
+            HOMEKIT_CHARACTERISTIC(NAME, "MQ4 Sensor"),
+            &mq4_ppm,
+            &mq4_ro,
+            NULL
+        }),
+#endif
         NULL
     }),
     NULL
 };
 
-void temperature_sensor_task(void *_args) {
+bool poll_period_adapt (rate_controller_t *controller, float value, uint8_t level){
+    
+    /* returns true if the period of the running job was changed */
+    sensor_job_t *job = sensor_scheduler_current();
+    uint32_t period = rate_controller_update(controller, value, level);
+    
+    if (job == NULL || period == job->period_ms){
+        return false;
+    }
+    sensor_scheduler_set_period(job, period);
+    return true;
+}
+
+
+void poll_periods_apply (){
+    
+    uint32_t min_period = poll_min_period.value.int_value * 1000;
+    uint32_t max_period = poll_max_period.value.int_value * 1000;
+    
+    /* the setters run in the homekit task */
+    taskENTER_CRITICAL();
+    rate_controller_set_bounds(&air_quality_rate, min_period, max_period);
+    rate_controller_set_bounds(&temperature_rate, min_period > DHT_MIN_POLL_PERIOD ? min_period : DHT_MIN_POLL_PERIOD, max_period);
+    taskEXIT_CRITICAL();
+}
+
+
+void poll_min_period_set (homekit_value_t value){
+    
+    if (value.format != homekit_format_uint16 || value.int_value < 1 || value.int_value > poll_max_period.value.int_value) {
+        printf("%s: invalid value\n", __func__);
+        return;
+    }
+    poll_min_period.value = value;
+    poll_periods_apply();
+    config_store_set(&poll_min_period);
+}
+
+
+void poll_max_period_set (homekit_value_t value){
+    
+    if (value.format != homekit_format_uint16 || value.int_value < 1 || value.int_value < poll_min_period.value.int_value) {
+        printf("%s: invalid value\n", __func__);
+        return;
+    }
+    poll_max_period.value = value;
+    poll_periods_apply();
+    config_store_set(&poll_max_period);
+}
+
+
+void trace_mode_set (homekit_value_t value){
+    
+    if (value.format != homekit_format_uint8 || !trace_set_mode(value.int_value)) {
+        printf("%s: invalid value\n", __func__);
+        return;
+    }
+    trace_mode.value = value;
+    config_store_set(&trace_mode);
+}
+
+
+void burst_trigger_apply (){
+    
+    burst_capture_set_trigger(burst_trigger_level.value.int_value, burst_trigger_slope.value.int_value);
+}
+
+
+void burst_trigger_level_set (homekit_value_t value){
+    
+    if (value.format != homekit_format_uint16 || value.int_value > 1023) {
+        printf("%s: invalid value\n", __func__);
+        return;
+    }
+    burst_trigger_level.value = value;
+    burst_trigger_apply();
+    config_store_set(&burst_trigger_level);
+}
+
+
+void burst_trigger_slope_set (homekit_value_t value){
+    
+    if (value.format != homekit_format_uint16 || value.int_value > 1000) {
+        printf("%s: invalid value\n", __func__);
+        return;
+    }
+    burst_trigger_slope.value = value;
+    burst_trigger_apply();
+    config_store_set(&burst_trigger_slope);
+}
+
+
+void history_export_set (homekit_value_t value){
+    
+    /* broadcast the last hours of history, see tools/history_dump.py */
+    uint32_t now = history_time(), span;
+    
+    if (value.format != homekit_format_uint16 || value.int_value > 720) {
+        printf("%s: invalid value\n", __func__);
+        return;
+    }
+    history_export_hours.value = value;
+    if (value.int_value > 0) {
+        span = value.int_value * 3600;
+        history_export(now > span ? now - span : 0);
+    }
+}
+
+
+void burst_capture_job (){
+    
+    /* the sampler has finished a capture, rate its peak like a reading */
+    burst_result_t result;
+    float ppm[GAS_COUNT];
+    
+    if (!burst_capture_result(&result) || mq_channels[MQ_CHANNEL_MQ135].ro <= 0) {
+        return;
+    }
+    MQGetConcentrationsAt(result.peak, ppm);
+    ppm[GAS_CO] = gas_clamp(&gas_table[GAS_CO], ppm[GAS_CO]);
+    ppm[GAS_LPG] = gas_clamp(&gas_table[GAS_LPG], ppm[GAS_LPG]);
+    BINLOG_INFO(BURST_CAPTURE, binlog_f(result.baseline), binlog_f(result.peak), result.time_to_peak_ms,
+                binlog_f(ppm[GAS_LPG]), binlog_f(ppm[GAS_CO]));
+    notify_filter_stage(&burst_peak_co_notify, HOMEKIT_FLOAT(ppm[GAS_CO]));
+    notify_filter_stage(&burst_peak_lpg_notify, HOMEKIT_FLOAT(ppm[GAS_LPG]));
+    notify_filter_stage(&burst_time_to_peak_notify, HOMEKIT_FLOAT(result.time_to_peak_ms / 1000.0f));
+    notify_filter_commit();
+}
+
+
+void temperature_sensor_job() {
     
     bool success;
+    dht22_status_t status;
+    float humidity_value = 0, temperature_value = 0;
+    uint32_t start = perf_start();
     
-    /*gpio_set_pullup(TEMPERATURE_SENSOR_GPIO, false, false); */
+    status = dht22_read(&temperature_value, &humidity_value);
+    success = status == DHT22_OK;
+    perf_record(PERF_STAGE_DHT, start);
+    trace_dht(temperature_value, humidity_value, success);
     
-    while (1) {
-        success = dht_read_float_data(
-                                      DHT_TYPE_DHT22, TEMPERATURE_SENSOR_GPIO,
-                                      &humidity_value, &temperature_value
-                                      );
+    if (success) {
+        /* the rate controller sees the raw temperature, so a real change speeds polling up before the filter accepts it */
+        poll_period_adapt(&temperature_rate, temperature_value, 0);
+        temperature_value = Q16_TO_FLOAT(signal_filter_update(&temperature_filter, Q16(temperature_value)));
+        humidity_value = Q16_TO_FLOAT(signal_filter_update(&humidity_filter, Q16(humidity_value)));
+        env_snapshot_publish(temperature_value, humidity_value);
+        BINLOG_INFO(DHT_READING, binlog_f(temperature_value), binlog_f(humidity_value));
+        notify_filter_stage(&temperature_notify, HOMEKIT_FLOAT(temperature_value));
+        notify_filter_stage(&humidity_notify, HOMEKIT_FLOAT(humidity_value));
+        notify_filter_commit();
         
-        if (success) {
-            printf("Got readings: temperature %g, humidity %g\n", temperature_value, humidity_value);
-            current_temperature.value = HOMEKIT_FLOAT(temperature_value);
-            current_relative_humidity.value = HOMEKIT_FLOAT(humidity_value);
-            
-            homekit_characteristic_notify(&current_temperature, current_temperature.value);
-            homekit_characteristic_notify(&current_relative_humidity, current_relative_humidity.value);
-            
-        } else {
-            led_code(LED_GPIO, SENSOR_ERROR);
-            printf("Couldnt read data from temperate & humidity sensor\n");
-        }
-        vTaskDelay(TEMPERATURE_POLL_PERIOD / portTICK_PERIOD_MS);
+    } else {
+        env_snapshot_fail();
+        led_code(LED_GPIO, SENSOR_ERROR);
+        BINLOG_WARN(DHT_FAILED, status);
     }
 }
 
 void temperature_sensor_init() {
-    gpio_enable(TEMPERATURE_SENSOR_GPIO, GPIO_INPUT);
-    xTaskCreate(temperature_sensor_task, "Temperature", 256, NULL, 2, &temperature_sensor_task_handle);
+    /*gpio_set_pullup(TEMPERATURE_SENSOR_GPIO, false, false); */
+    dht22_init(TEMPERATURE_SENSOR_GPIO);
+    if (warm_start && warm_state.valid_env) {
+        /* the filters carry on where they were, so the first reads are not taken as outliers */
+        signal_filter_restore(&temperature_filter, &warm_state.temperature_filter);
+        signal_filter_restore(&humidity_filter, &warm_state.humidity_filter);
+        env_snapshot_publish(warm_state.temperature, warm_state.humidity);
+    }
 }
 
 
-
-void air_quality_sensor_task(void *_args) {
+void history_job (){
     
+    uint32_t start = perf_start();
+    env_reading_t env;
+    history_record_t record;
+    bool env_valid;
     
-    while (1) {
-        MQGetReadings( temperature_value, humidity_value);
-        printf("Got air quality level: %i\n", air_quality_val);
-        
-        if (co_val < *carbon_monoxide_level.min_value ){
-            co_val = *carbon_monoxide_level.min_value;
-        }
-        if (co_val > *carbon_monoxide_level.max_value ){
-            co_val = *carbon_monoxide_level.max_value;
+    /* a failed or stale DHT22 is recorded as missing rather than as its last value */
+    env_valid = env_snapshot_read(&env);
+    record = (history_record_t){
+        .value = {
+            [HISTORY_TEMPERATURE] = env_valid ? env.temperature * 10 : HISTORY_NO_VALUE,
+            [HISTORY_HUMIDITY] = env_valid ? env.humidity * 10 : HISTORY_NO_VALUE,
+            [HISTORY_RS] = readings_taken && isfinite(readings.rs) ? readings.rs : HISTORY_NO_VALUE,
         }
-        carbon_monoxide_level.value.float_value = co_val;
-        
-        if (pm10_val < *pm10_density.min_value ){
-            pm10_val = *pm10_density.min_value;
+    };
+    
+    for (int gas = 0; gas < GAS_COUNT; gas++){
+        record.value[gas_table[gas].history_field] = readings_taken && isfinite(readings.ppm[gas]) ? readings.ppm[gas] * 10 : HISTORY_NO_VALUE;
+    }
+    history_append(&record);
+    perf_record(PERF_STAGE_HISTORY, start);
+}
+
+
+void save_ro (notify_filter_t *notify, float ro){
+    
+    /* staged, so it goes out with the rest of the cycle at its commit */
+    notify_filter_stage(notify, HOMEKIT_FLOAT(ro));
+    config_store_set(notify->characteristic);
+}
+
+
+void gas_stats_stage (int gas){
+    
+    /* once a minute, the hour and day figures move slowly */
+    window_stats_result_t minute, hour, day, exposure;
+    const gas_descriptor_t *descriptor = &gas_table[gas];
+    
+    if (window_stats_result(&gas_stats[gas], WINDOW_STATS_MINUTE, 0, &minute)){
+        /* close to the value notified every few seconds, so only logged */
+        BINLOG_INFO(GAS_MINUTE_STATS, gas, binlog_f(minute.min), binlog_f(minute.max), binlog_f(minute.mean), binlog_f(minute.twa));
+    }
+    if (window_stats_result(&gas_stats[gas], WINDOW_STATS_HOUR, 0, &hour)){
+        notify_filter_stage(&gas_stat_notify[gas][GAS_STAT_HOUR_MIN], HOMEKIT_FLOAT(gas_clamp(descriptor, hour.min)));
+        notify_filter_stage(&gas_stat_notify[gas][GAS_STAT_HOUR_AVERAGE], HOMEKIT_FLOAT(gas_clamp(descriptor, hour.twa)));
+        notify_filter_stage(&gas_stat_notify[gas][GAS_STAT_HOUR_MAX], HOMEKIT_FLOAT(gas_clamp(descriptor, hour.max)));
+    }
+    if (window_stats_result(&gas_stats[gas], WINDOW_STATS_DAY, 0, &day)){
+        notify_filter_stage(&gas_stat_notify[gas][GAS_STAT_DAY_MIN], HOMEKIT_FLOAT(gas_clamp(descriptor, day.min)));
+        notify_filter_stage(&gas_stat_notify[gas][GAS_STAT_DAY_AVERAGE], HOMEKIT_FLOAT(gas_clamp(descriptor, day.twa)));
+        notify_filter_stage(&gas_stat_notify[gas][GAS_STAT_DAY_MAX], HOMEKIT_FLOAT(gas_clamp(descriptor, day.max)));
+    }
+    /* exactly the last 8 h, not the 8 newest hourly buckets, the newest of which is still filling */
+    if (gas == GAS_CO && window_stats_span(&gas_stats[gas], CO_TWA_HOURS * 60 * 60 * 1000UL, &exposure)){
+        notify_filter_stage(&co_8h_twa_notify, HOMEKIT_FLOAT(gas_clamp(descriptor, exposure.twa)));
+    }
+}
+
+
+void air_quality_sensor_job() {
+    
+    uint32_t start = perf_start();
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    float log_rs;
+    
+    if (!MQGetReadings(&readings)){
+        /* nothing sampled yet, keep serving what there was rather than a reading of nothing */
+        return;
+    }
+    readings_taken = true;
+    perf_record(PERF_STAGE_COMPUTE, start);
+    BINLOG_INFO(AIR_QUALITY_LEVEL, readings.air_quality);
+    
+    start = perf_start();
+    for (int gas = 0; gas < GAS_COUNT; gas++){
+        readings.ppm[gas] = gas_clamp(&gas_table[gas], readings.ppm[gas]);
+        notify_filter_stage(&gas_notify[gas], HOMEKIT_FLOAT(readings.ppm[gas]));
+        if (window_stats_add(&gas_stats[gas], readings.ppm[gas], now)){
+            gas_stats_stage(gas);
         }
-        if (pm10_val > *pm10_density.max_value ){
-            pm10_val = *pm10_density.max_value;
+    }
+    notify_filter_stage(&air_quality_notify, HOMEKIT_UINT8(readings.air_quality));
+    notify_filter_stage(&aqi_index_notify, HOMEKIT_FLOAT(readings.aqi_index));
+    if (MQBaselineUpdate(&mq_channels[MQ_CHANNEL_MQ135], readings.rs)){
+        save_ro(&mq135_ro_notify, mq_channels[MQ_CHANNEL_MQ135].ro);
+    }
+    notify_filter_commit();
+    perf_record(PERF_STAGE_PUBLISH, start);
+    trace_output(&readings);
+    
+    if (air_quality_woken){
+        /* the gas is rising faster than this job was polling, follow it closely from here */
+        air_quality_woken = false;
+        rate_controller_event(&air_quality_rate);
+    }
+    /* an adc code of 0 or full scale has no finite, positive rs, and a NAN restarts the controller */
+    log_rs = readings.rs > 0 && isfinite(readings.rs) ? logf(readings.rs) : NAN;
+    if (poll_period_adapt(&air_quality_rate, log_rs, readings.air_quality)){
+        /* spread the sample window over the new period */
+        uint32_t sample_period = sensor_scheduler_current()->period_ms / ADC_WINDOW_SIZE;
+        adc_sampler_set_period(sample_period > ADC_SAMPLE_PERIOD_MIN_MS ? sample_period : ADC_SAMPLE_PERIOD_MIN_MS);
+    }
+}
+
+void aqi_standard_set (homekit_value_t value){
+    
+    if (value.format != homekit_format_uint8 || value.int_value >= AQI_STANDARD_COUNT) {
+        printf("%s: invalid value\n", __func__);
+        return;
+    }
+    aqi_standard.value = value;
+    aqi_set_standard(value.int_value);
+    config_store_set(&aqi_standard);
+}
+
+
+void mq_channels_job() {
+    
+    /* every sensor on the multiplexer but the MQ135, which has a job of its own */
+    mq_channel_t *channel;
+    const mq_channel_output_t *output;
+    float rs, ppm;
+    bool save;
+    
+    for (uint8_t i = 0; i < ADC_MUX_CHANNELS; i++){
+        if (i == MQ_CHANNEL_MQ135){
+            continue;
         }
-        pm10_density.value.float_value = pm10_val;
-        
-        
-        if (lpg_val < *lpg_level.min_value ){
-            lpg_val = *lpg_level.min_value;
+        channel = &mq_channels[i];
+        output = &mq_channel_outputs[i];
+        /* both every time, or the baseline misses the reading that finishes a calibration */
+        save = MQChannelRead(channel, &rs, &ppm);
+        save |= MQBaselineUpdate(channel, rs);
+        if (save){
+            save_ro(&mq_channel_ro_notify[i], channel->ro);
         }
-        if (lpg_val > *lpg_level.max_value ){
-            lpg_val = *lpg_level.max_value;
+        if (isnan(ppm)){
+            continue;
         }
-        lpg_level.value.float_value = lpg_val;
-        
-        if (methane_val < *methane_level.min_value ){
-            methane_val = *methane_level.min_value;
+        if (ppm > *output->ppm->max_value){
+            ppm = *output->ppm->max_value;
         }
-        if (methane_val > *methane_level.max_value ){
-            methane_val = *methane_level.max_value;
+        notify_filter_stage(&mq_channel_notify[i], HOMEKIT_FLOAT(ppm));
+    }
+    notify_filter_commit();
+}
+
+
+void air_quality_sensor_start() {
+    /* runs in the sensor task, so a calibration does not hold up accessory_init */
+    if (MQInit(mq135_ro.value.float_value)){
+        save_ro(&mq135_ro_notify, mq_channels[MQ_CHANNEL_MQ135].ro);
+        notify_filter_commit();
+    }
+    for (uint8_t i = 0; i < ADC_MUX_CHANNELS; i++){
+        if (i != MQ_CHANNEL_MQ135){
+            MQChannelInit(&mq_channels[i], mq_channel_outputs[i].ro->value.float_value);
         }
-        methane_level.value.float_value = methane_val;
-        
-        if (nh4_val < *ammonium_level.min_value ){
-            nh4_val = *ammonium_level.min_value;
+    }
+}
+
+
+void air_quality_sensor_init() {
+    led_code (LED_GPIO,FUNCTION_D );
+    if (warm_start && warm_state.ro > 0) {
+        /* newer than flash when the baseline moved since the last save, and skips the calibration */
+        mq135_ro.value = HOMEKIT_FLOAT(warm_state.ro);
+    }
+    poll_periods_apply();
+    burst_trigger_apply();
+    aqi_set_standard(aqi_standard.value.int_value);
+    for (int gas = 0; gas < GAS_COUNT; gas++){
+        gas_notify[gas].characteristic = gas_table[gas].characteristic;
+        gas_notify[gas].policy = &gas_table[gas].notify_policy;
+        for (int stat = 0; stat < GAS_STAT_COUNT; stat++){
+            gas_stat_notify[gas][stat].characteristic = gas_table[gas].stat[stat];
+            gas_stat_notify[gas][stat].policy = &gas_stat_notify_policy;
         }
-        if (nh4_val > *ammonium_level.max_value ){
-            nh4_val = *ammonium_level.max_value;
+    }
+    for (uint8_t i = 0; i < ADC_MUX_CHANNELS; i++){
+        if (i != MQ_CHANNEL_MQ135){
+            mq_channel_notify[i].characteristic = mq_channel_outputs[i].ppm;
+            mq_channel_notify[i].policy = &mq_channel_outputs[i].notify_policy;
+            mq_channel_ro_notify[i].characteristic = mq_channel_outputs[i].ro;
+            mq_channel_ro_notify[i].policy = &ro_notify_policy;
         }
-        ammonium_level.value.float_value = nh4_val;
-        
-        air_quality.value.int_value = air_quality_val;
-        homekit_characteristic_notify(&carbon_monoxide_level, HOMEKIT_FLOAT(co_val));
-        homekit_characteristic_notify(&pm10_density, HOMEKIT_FLOAT(pm10_val));
-        homekit_characteristic_notify(&air_quality, air_quality.value);
-        homekit_characteristic_notify(&lpg_level, HOMEKIT_FLOAT(lpg_val));
-        homekit_characteristic_notify(&methane_level, HOMEKIT_FLOAT(methane_val));
-        homekit_characteristic_notify(&ammonium_level, HOMEKIT_FLOAT(nh4_val));
-        vTaskDelay(3000 / portTICK_PERIOD_MS);
     }
 }
 
-void air_quality_sensor_init_task (void *_args) {
-    MQInit();
-    xTaskCreate(air_quality_sensor_task, "Air Quality Sensor", 300, NULL, 2, &air_quality_sensor_task_handle);
-    vTaskDelete (NULL);
+
+void rtc_snapshot_job (){
+    
+    rtc_state_t state = {
+        .temperature = current_temperature.value.float_value,
+        .humidity = current_relative_humidity.value.float_value,
+        .readings = readings,
+        .ro = mq_channels[MQ_CHANNEL_MQ135].ro,
+        .valid_env = temperature_filter.started,
+        .valid_air = readings.air_quality != 0,
+        .temperature_filter = temperature_filter,
+        .humidity_filter = humidity_filter,
+    };
+    
+    rtc_snapshot_save(&state);
 }
 
 
-void air_quality_sensor_init() {
-    led_code (LED_GPIO,FUNCTION_D );
-    xTaskCreate(air_quality_sensor_init_task, "Air Quality init", 512, NULL, 2, NULL);
+void warm_start_restore (){
+    
+    /* serve the last good values from the start, before HomeKit is up. They stay until the
+       sampler has a sample of this run, see air_quality_sensor_job and tools/sensor_test */
+    if (warm_state.valid_env) {
+        current_temperature.value = HOMEKIT_FLOAT(warm_state.temperature);
+        current_relative_humidity.value = HOMEKIT_FLOAT(warm_state.humidity);
+    }
+    if (warm_state.valid_air) {
+        readings = warm_state.readings;
+        for (int gas = 0; gas < GAS_COUNT; gas++){
+            gas_table[gas].characteristic->value = HOMEKIT_FLOAT(gas_clamp(&gas_table[gas], readings.ppm[gas]));
+        }
+        air_quality.value = HOMEKIT_UINT8(readings.air_quality);
+        aqi_index.value = HOMEKIT_FLOAT(readings.aqi_index);
+    }
+    if (warm_state.ro > 0) {
+        mq135_ro.value = HOMEKIT_FLOAT(warm_state.ro);
+    }
+}
+
+
+/* every periodic sensor job, run by the one sensor task */
+sensor_job_t sensor_jobs[] = {
+    SENSOR_JOB("Temperature", temperature_sensor_job, TEMPERATURE_POLL_PERIOD),
+    SENSOR_JOB("Air Quality", air_quality_sensor_job, AIR_QUALITY_POLL_PERIOD),
+#if ADC_MUX_CHANNELS > 1
+    SENSOR_JOB("MQ Channels", mq_channels_job, AIR_QUALITY_POLL_PERIOD),
+#endif
+    SENSOR_JOB("History", history_job, HISTORY_INTERVAL_MS),
+    SENSOR_JOB("Perf", perf_sample, PERF_SAMPLE_PERIOD_MS),
+    SENSOR_JOB("Snapshot", rtc_snapshot_job, RTC_SNAPSHOT_PERIOD_MS),
+    SENSOR_JOB("Burst", burst_capture_job, BURST_POLL_PERIOD),
+};
+
+
+void air_quality_burst_wake (){
+    
+    /* in the timer task, the air quality job may be up to poll_max_period away */
+    air_quality_woken = true;
+    sensor_scheduler_wake(&sensor_jobs[1]);
 }
 
 
@@ -285,13 +781,53 @@ void gpio_init (){
 }
 
 
+/* settings kept by config_store, the ids are their keys in flash so never reuse one */
+const config_entry_t settings[] = {
+    CONFIG_ENTRY( 1, &aqi_standard ),
+    CONFIG_ENTRY( 2, &mq135_ro ),
+    CONFIG_ENTRY( 3, &poll_min_period ),
+    CONFIG_ENTRY( 4, &poll_max_period ),
+    CONFIG_ENTRY( 5, &trace_mode ),
+    CONFIG_ENTRY( 8, &burst_trigger_level ),
+    CONFIG_ENTRY( 9, &burst_trigger_slope ),
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ7
+    CONFIG_ENTRY( 6, &mq7_ro ),
+#endif
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ4
+    CONFIG_ENTRY( 7, &mq4_ro ),
+#endif
+};
+
+
+void settings_init (){
+    
+    uint8_t count = sizeof(settings) / sizeof(settings[0]);
+    
+    if (!config_store_init(settings, count)) {
+        /* first start with the store, carry the settings over from sysparam */
+        printf("%s: no stored settings, loading from sysparam\n", __func__);
+        for (uint8_t i = 0; i < count; i++){
+            load_characteristic_from_flash(settings[i].characteristic);
+            config_store_set(settings[i].characteristic);
+        }
+    }
+}
+
+
 void accessory_init(){
     /* initalise anything you don't want started until wifi and pairing is confirmed */
     printf("%s: Start, Freep Heap=%d\n", __func__, xPortGetFreeHeapSize());
 
     gpio_init();
+    binlog_init();
+    perf_init(&sampled_min_free_heap, &min_stack_free, &max_stage_kcycles);
+    history_init();
+    settings_init();
+    trace_init(trace_mode.value.int_value);
     air_quality_sensor_init();
     temperature_sensor_init();
+    adc_sampler_on_burst(air_quality_burst_wake);
+    sensor_scheduler_start(sensor_jobs, sizeof(sensor_jobs) / sizeof(sensor_jobs[0]), air_quality_sensor_start, &sensor_task_handle);
 
     printf("%s: End, Freep Heap=%d\n", __func__, xPortGetFreeHeapSize());
 }
@@ -304,7 +840,7 @@ void accessory_init_not_paired (void) {
 
 void recover_from_reset (int reason){
     /* called if we restarted abnormally */
-    printf ("%s: reason %d\n", __func__, reason);
+    printf ("%s: reason %d, %s\n", __func__, reason, warm_start ? "last readings restored" : "no readings to restore");
 }
 
 
@@ -313,6 +849,8 @@ void save_characteristics (){
     /* called if we restarted abnormally */
     printf ("%s:\n", __func__);
     save_characteristic_to_flash(&wifi_check_interval, wifi_check_interval.value);
+    config_store_flush();
+    history_flush();
 }
 
 
@@ -328,6 +866,11 @@ void user_init(void) {
 
     printf ("User Init\n");
     
+    warm_start = rtc_snapshot_load(&warm_state);
+    if (warm_start) {
+        warm_start_restore();
+    }
+    
     standard_init (&name, &manufacturer, &model, &serial, &revision);
     
     wifi_config_init(DEVICE_NAME, NULL, on_wifi_ready);
@@ -0,0 +1,52 @@
+/* The MQ sensors read through the analogue multiplexer, see mq_channels.h
+ */
+
+#include "mq_channels.h"
+
+#if ADC_MUX_CHANNELS > 3
+#error "add the sensors of the extra multiplexer inputs to mq_channels"
+#elif ADC_MUX_CHANNELS > 1
+#include "air_quality_characteristics.h"
+#endif
+
+
+/* Load resistors as fitted to the usual breakout boards, clean air factors from the
+ * datasheet charts and curves fitted to them as for gas_table. Every channel is
+ * corrected with the MQ135 temperature and humidity model, which is close for the
+ * MQ-4 and rougher for the MQ-7.
+ */
+mq_channel_t mq_channels[ADC_MUX_CHANNELS] = {
+    [MQ_CHANNEL_MQ135] = MQ_CHANNEL("MQ135", MQ_CHANNEL_MQ135, RL_VALUE, RO_CLEAN_AIR_FACTOR, 0, 0),
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ7
+    [MQ_CHANNEL_MQ7] = MQ_CHANNEL("MQ7", MQ_CHANNEL_MQ7, 10000, 27.5, 4.595544, -1.518),      /* a = 99.042 */
+#endif
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ4
+    [MQ_CHANNEL_MQ4] = MQ_CHANNEL("MQ4", MQ_CHANNEL_MQ4, 10000, 4.4, 6.920376, -2.786),       /* a = 1012.7 */
+#endif
+};
+
+
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ7
+homekit_characteristic_t mq7_ppm        = HOMEKIT_CHARACTERISTIC_( CUSTOM_MQ_CHANNEL_PPM, "MQ7 CO", 0 );
+homekit_characteristic_t mq7_ro         = HOMEKIT_CHARACTERISTIC_( CUSTOM_MQ_CHANNEL_RO, "MQ7 Ro", 0 );
+#endif
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ4
+homekit_characteristic_t mq4_ppm        = HOMEKIT_CHARACTERISTIC_( CUSTOM_MQ_CHANNEL_PPM, "MQ4 CH4", 0 );
+homekit_characteristic_t mq4_ro         = HOMEKIT_CHARACTERISTIC_( CUSTOM_MQ_CHANNEL_RO, "MQ4 Ro", 0 );
+#endif
+
+
+const mq_channel_output_t mq_channel_outputs[ADC_MUX_CHANNELS] = {
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ7
+    [MQ_CHANNEL_MQ7] = {
+        .ppm = &mq7_ppm, .ro = &mq7_ro,
+        .notify_policy = { .abs_deadband = 1.0, .rel_deadband = 0.05, .min_interval_ms = 6000, .max_silence_ms = 15 * 60 * 1000 },
+    },
+#endif
+#if ADC_MUX_CHANNELS > MQ_CHANNEL_MQ4
+    [MQ_CHANNEL_MQ4] = {
+        .ppm = &mq4_ppm, .ro = &mq4_ro,
+        .notify_policy = { .abs_deadband = 1.0, .rel_deadband = 0.1, .min_interval_ms = 30000, .max_silence_ms = 30 * 60 * 1000 },
+    },
+#endif
+};
@@ -0,0 +1,31 @@
+/* The MQ sensors read through the analogue multiplexer, one entry per input, and
+ * the characteristics each of them other than the MQ135 is published through.
+ * ADC_MUX_CHANNELS of 1 is the MQ135 alone, 2 adds an MQ-7 and 3 an MQ-4. A
+ * sensor on another input needs an entry here and a service in main.c.
+ */
+
+#ifndef __MQ_CHANNELS_H__
+#define __MQ_CHANNELS_H__
+
+#include <homekit/homekit.h>
+#include "esp8266_mq135.h"
+#include "adc_sampler.h"
+#include "notify_filter.h"
+
+#define MQ_CHANNEL_MQ7          1       /* carbon monoxide */
+#define MQ_CHANNEL_MQ4          2       /* methane */
+
+
+typedef struct {
+    homekit_characteristic_t *ppm;
+    homekit_characteristic_t *ro;
+    notify_policy_t notify_policy;
+} mq_channel_output_t;
+
+
+/* indexed like mq_channels, the MQ135 publishes through gas_table so its entry is empty */
+extern const mq_channel_output_t mq_channel_outputs[ADC_MUX_CHANNELS];
+
+extern homekit_characteristic_t mq7_ppm, mq7_ro, mq4_ppm, mq4_ro;
+
+#endif
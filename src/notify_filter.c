@@ -0,0 +1,146 @@
+/* Change driven HomeKit notifications, see notify_filter.h
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "notify_filter.h"
+#include "sensor_hal.h"
+
+
+static uint32_t report_start_ms;
+static uint32_t report_sent;
+static uint32_t report_suppressed;
+static uint32_t total_sent;
+static uint32_t total_suppressed;
+static uint32_t total_batches;
+
+/* notifies staged since the last commit */
+static notify_filter_t *batch[NOTIFY_BATCH_SIZE];
+static uint8_t batch_count;
+
+
+static float value_as_float(homekit_value_t value){
+    switch (value.format){
+        case homekit_format_bool:
+            return value.bool_value;
+        case homekit_format_float:
+            return value.float_value;
+        case homekit_format_uint8:
+        case homekit_format_uint16:
+        case homekit_format_uint32:
+        case homekit_format_int:
+            return value.int_value;
+        default:
+            return NAN;
+    }
+}
+
+
+static bool notify_filter_due(const notify_filter_t *filter, float value, uint32_t now){
+    const notify_policy_t *policy = filter->policy;
+    uint32_t elapsed = now - filter->last_sent_ms;
+    float change;
+
+    if (!filter->sent_once){
+        return true;
+    }
+    if (policy->max_silence_ms && elapsed >= policy->max_silence_ms){
+        return true;
+    }
+    if (elapsed < policy->min_interval_ms){
+        return false;
+    }
+
+    change = fabsf(value - filter->last_sent);
+    if (isnan(change)){
+        /* not comparable, so treat any publish as a change */
+        return true;
+    }
+    if (policy->abs_deadband > 0 && change >= policy->abs_deadband){
+        return true;
+    }
+    if (policy->rel_deadband > 0 && change >= policy->rel_deadband * fabsf(filter->last_sent)){
+        return true;
+    }
+    return policy->abs_deadband <= 0 && policy->rel_deadband <= 0 && change > 0;
+}
+
+
+static void notify_filter_report(uint32_t now){
+    if (now - report_start_ms < NOTIFY_FILTER_REPORT_PERIOD_MS){
+        return;
+    }
+    printf("%s: sent %u notifies, suppressed %u\n", __func__, report_sent, report_suppressed);
+    report_start_ms = now;
+    report_sent = 0;
+    report_suppressed = 0;
+}
+
+
+bool notify_filter_stage(notify_filter_t *filter, homekit_value_t value){
+    uint32_t now = sensor_hal->now_ms();
+    float new_value = value_as_float(value);
+    bool due = notify_filter_due(filter, new_value, now);
+    uint8_t i;
+
+    filter->characteristic->value = value;
+    if (due){
+        for (i = 0; i < batch_count && batch[i] != filter; i++){
+        }
+        if (i == NOTIFY_BATCH_SIZE){
+            /* and give the server a tick to drain the queues before the rest is staged */
+            notify_filter_commit();
+            vTaskDelay(1);
+            i = 0;
+        }
+        /* staged twice is still sent once, with the value it has at the commit */
+        batch[i] = filter;
+        if (i == batch_count){
+            batch_count++;
+        }
+        filter->last_sent = new_value;
+        filter->last_sent_ms = now;
+        filter->sent_once = true;
+        filter->sent++;
+        report_sent++;
+        total_sent++;
+    } else {
+        filter->suppressed++;
+        report_suppressed++;
+        total_suppressed++;
+    }
+
+    notify_filter_report(now);
+    return due;
+}
+
+
+void notify_filter_commit(void){
+    uint8_t i;
+
+    if (batch_count == 0){
+        return;
+    }
+    for (i = 0; i < batch_count; i++){
+        homekit_characteristic_notify(batch[i]->characteristic, batch[i]->characteristic->value);
+    }
+    batch_count = 0;
+    total_batches++;
+}
+
+
+bool notify_filter_publish(notify_filter_t *filter, homekit_value_t value){
+    bool due = notify_filter_stage(filter, value);
+
+    notify_filter_commit();
+    return due;
+}
+
+
+void notify_filter_totals(uint32_t *sent, uint32_t *suppressed, uint32_t *batches){
+    *sent = total_sent;
+    *suppressed = total_suppressed;
+    *batches = total_batches;
+}
@@ -0,0 +1,65 @@
+/* Change driven HomeKit notifications. Every notify is encrypted and sent to each
+ * subscribed client, so values are only pushed when they have moved further than a
+ * deadband from what the clients were last told, no more often than a minimum
+ * interval, and at least once every max_silence_ms as a heartbeat. The
+ * characteristic value is always updated, so reads still see the latest reading.
+ *
+ * A sensor cycle stages each of its values and commits them together. The notifies
+ * are then made back to back from the sensor task without blocking, so unless the
+ * HomeKit server task has a higher priority the events of a cycle are queued for
+ * each client together and go out as one event message rather than one encrypted
+ * frame per value, tools/notify_bench counts the frames and bytes either way.
+ * Staging is not locked, only the sensor task publishes.
+ *
+ * A commit is at most NOTIFY_BATCH_SIZE notifies, which has to stay below the
+ * event queue esp-homekit keeps for each client, so a commit never waits on the
+ * server to drain a full queue. Check it when updating esp-homekit. A full batch is
+ * committed early and the sensor task then sleeps a tick, so the server drains it
+ * before the rest of the cycle is queued behind it.
+ */
+
+#ifndef __NOTIFY_FILTER_H__
+#define __NOTIFY_FILTER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <homekit/homekit.h>
+
+#define NOTIFY_FILTER_REPORT_PERIOD_MS  (24UL * 60 * 60 * 1000)     /* how often the suppressed count is logged */
+#define NOTIFY_BATCH_SIZE               16      /* notifies one commit can hold, a full batch is committed early */
+
+
+typedef struct {
+    float abs_deadband;             /* notify when the value moved by at least this, 0 to ignore */
+    float rel_deadband;             /* notify when the value moved by at least this fraction of the last sent value, 0 to ignore */
+    uint32_t min_interval_ms;       /* never notify more often than this */
+    uint32_t max_silence_ms;        /* notify at least this often even without a change, 0 to never force */
+} notify_policy_t;
+
+
+typedef struct {
+    homekit_characteristic_t *characteristic;
+    const notify_policy_t *policy;
+    float last_sent;
+    uint32_t last_sent_ms;
+    bool sent_once;
+    uint32_t sent;
+    uint32_t suppressed;
+} notify_filter_t;
+
+#define NOTIFY_FILTER(_characteristic, ...) { .characteristic = (_characteristic), .policy = &(const notify_policy_t) { __VA_ARGS__ } }
+
+
+/* update the characteristic and stage a notify if the policy allows, returns true if staged */
+bool notify_filter_stage(notify_filter_t *filter, homekit_value_t value);
+
+/* send every staged notify */
+void notify_filter_commit(void);
+
+/* stage and commit a single value, returns true if notified */
+bool notify_filter_publish(notify_filter_t *filter, homekit_value_t value);
+
+/* notifies sent and suppressed by all filters since start up, and the commits they were sent in */
+void notify_filter_totals(uint32_t *sent, uint32_t *suppressed, uint32_t *batches);
+
+#endif
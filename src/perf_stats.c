@@ -0,0 +1,144 @@
+/* Continuous performance and memory instrumentation, see perf_stats.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+#include "perf_stats.h"
+#include "notify_filter.h"
+
+
+static perf_report_t perf_report;
+static TaskStatus_t perf_task_status[PERF_MAX_TASKS];
+static uint32_t perf_tasks_dropped = 0;     /* tasks left out of the last report */
+/* any change is sent, at the sample period */
+static notify_filter_t perf_sampled_min_free_heap_notify = NOTIFY_FILTER( NULL, .min_interval_ms = 0 );
+static notify_filter_t perf_min_stack_free_notify = NOTIFY_FILTER( NULL, .min_interval_ms = 0 );
+static notify_filter_t perf_max_stage_kcycles_notify = NOTIFY_FILTER( NULL, .min_interval_ms = 0 );
+static int perf_socket = -1;
+
+
+void perf_record(perf_stage_id_t stage, uint32_t start){
+    perf_stage_t *stats = &perf_report.stage[stage];
+    uint32_t cycles = sensor_hal->cycles() - start;
+    uint32_t limit = 1024;
+    uint8_t bucket = 0;
+
+    while (bucket < PERF_BUCKETS - 1 && cycles >= limit){
+        limit <<= 2;
+        bucket++;
+    }
+    if (stats->bucket[bucket] < UINT16_MAX){
+        stats->bucket[bucket]++;
+    }
+    stats->count++;
+    stats->total_kcycles += (cycles + 500) / 1000;
+    if (cycles > stats->max_cycles){
+        stats->max_cycles = cycles;
+    }
+}
+
+
+void perf_init(homekit_characteristic_t *sampled_min_free_heap, homekit_characteristic_t *min_stack_free, homekit_characteristic_t *max_stage_kcycles){
+    perf_sampled_min_free_heap_notify.characteristic = sampled_min_free_heap;
+    perf_min_stack_free_notify.characteristic = min_stack_free;
+    perf_max_stage_kcycles_notify.characteristic = max_stage_kcycles;
+    perf_report.magic = PERF_REPORT_MAGIC;
+    perf_report.version = PERF_REPORT_VERSION;
+    perf_report.stage_count = PERF_STAGE_COUNT;
+    perf_report.sampled_min_free_heap = xPortGetFreeHeapSize();
+}
+
+
+static void perf_update(notify_filter_t *filter, uint32_t value){
+    if (filter->characteristic == NULL){
+        return;
+    }
+    notify_filter_stage(filter, HOMEKIT_UINT32(value));
+}
+
+
+static void perf_send_report(void){
+    struct sockaddr_in address;
+    int broadcast = 1;
+
+    if (perf_socket < 0){
+        perf_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (perf_socket < 0){
+            return;
+        }
+        setsockopt(perf_socket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+    }
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PERF_REPORT_PORT);
+    address.sin_addr.s_addr = INADDR_BROADCAST;
+    sendto(perf_socket, &perf_report, perf_report.length, 0, (struct sockaddr *) &address, sizeof(address));
+}
+
+
+void perf_sample(void){
+    uint32_t min_stack_free = UINT32_MAX, max_cycles = 0;
+    TaskStatus_t *status = perf_task_status;
+    UBaseType_t tasks, reported, i;
+
+    perf_report.uptime_s = sensor_hal->now_ms() / 1000;
+    perf_report.free_heap = xPortGetFreeHeapSize();
+    /* only as low as it was at a sample, there is no xPortGetMinimumEverFreeHeapSize */
+    if (perf_report.free_heap < perf_report.sampled_min_free_heap){
+        perf_report.sampled_min_free_heap = perf_report.free_heap;
+    }
+    notify_filter_totals(&perf_report.notify_sent, &perf_report.notify_suppressed, &perf_report.notify_batches);
+
+    /* uxTaskGetSystemState returns nothing at all if the buffer is short, so take
+       one from the heap when there are more tasks than the report holds. Two spare
+       in case tasks are created in between */
+    tasks = uxTaskGetNumberOfTasks() + 2;
+    if (tasks > PERF_MAX_TASKS){
+        status = malloc(tasks * sizeof(TaskStatus_t));
+        if (status == NULL){
+            printf("%s: no memory for the state of %u tasks\n", __func__, (uint32_t) tasks);
+            return;
+        }
+    } else {
+        tasks = PERF_MAX_TASKS;
+    }
+    tasks = uxTaskGetSystemState(status, tasks, NULL);
+
+    /* the minimum is over every task, the report holds the first PERF_MAX_TASKS */
+    reported = tasks < PERF_MAX_TASKS ? tasks : PERF_MAX_TASKS;
+    for (i = 0; i < tasks; i++){
+        if (status[i].usStackHighWaterMark < min_stack_free){
+            min_stack_free = status[i].usStackHighWaterMark;
+        }
+        if (i < reported){
+            strncpy(perf_report.task[i].name, status[i].pcTaskName, sizeof(perf_report.task[i].name));
+            perf_report.task[i].stack_free = status[i].usStackHighWaterMark;
+        }
+    }
+    if (tasks - reported != perf_tasks_dropped){
+        perf_tasks_dropped = tasks - reported;
+        printf("%s: %u tasks, %u left out of the report\n", __func__, (uint32_t) tasks, perf_tasks_dropped);
+    }
+    if (status != perf_task_status){
+        free(status);
+    }
+    perf_report.task_count = reported;
+    perf_report.length = offsetof(perf_report_t, task) + reported * sizeof(perf_report.task[0]);
+
+    for (i = 0; i < PERF_STAGE_COUNT; i++){
+        if (perf_report.stage[i].max_cycles > max_cycles){
+            max_cycles = perf_report.stage[i].max_cycles;
+        }
+    }
+
+    perf_update(&perf_sampled_min_free_heap_notify, perf_report.sampled_min_free_heap);
+    perf_update(&perf_min_stack_free_notify, tasks ? min_stack_free : 0);
+    perf_update(&perf_max_stage_kcycles_notify, max_cycles / 1000);
+    notify_filter_commit();
+    perf_send_report();
+}
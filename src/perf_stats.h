@@ -0,0 +1,78 @@
+/* Continuous performance and memory instrumentation. Each stage of the sensor loop
+ * is timed with the cycle counter into a small fixed bucket histogram, and a
+ * periodic sample tracks the lowest free heap it has seen, the stack headroom of
+ * every task and the notify counts. The esp-open-rtos heap is newlib's malloc,
+ * which keeps no minimum-ever free size as the FreeRTOS heaps do, so a dip between
+ * two samples is missed. The results are published to Eve characteristics through
+ * notify filters, like the readings, and broadcast as a binary UDP report.
+ */
+
+#ifndef __PERF_STATS_H__
+#define __PERF_STATS_H__
+
+#include <stdint.h>
+#include <homekit/homekit.h>
+#include "sensor_hal.h"
+
+#define PERF_BUCKETS            8           /* bucket n counts durations below 1024 * 4^n cycles, the last everything above */
+#define PERF_MAX_TASKS          16          /* tasks in the report, the minimum stack is taken over all of them */
+#define PERF_REPORT_PORT        45679       /* next to the udplogger port */
+#define PERF_REPORT_MAGIC       0x46524550  /* "PERF" */
+#define PERF_REPORT_VERSION     2
+#define PERF_SAMPLE_PERIOD_MS   60000
+
+
+/* timed stages of the sensor loop */
+typedef enum {
+    PERF_STAGE_DHT = 0,
+    PERF_STAGE_COMPUTE,
+    PERF_STAGE_PUBLISH,
+    PERF_STAGE_HISTORY,
+    PERF_STAGE_COUNT
+} perf_stage_id_t;
+
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_cycles;
+    uint32_t total_kcycles;
+    uint16_t bucket[PERF_BUCKETS];
+} perf_stage_t;
+
+
+/* binary report, little endian as sent by the ESP8266, every field is naturally aligned */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t uptime_s;
+    uint32_t free_heap;
+    uint32_t sampled_min_free_heap; /* lowest free_heap of the samples, not the minimum ever */
+    uint32_t notify_sent;
+    uint32_t notify_suppressed;
+    uint32_t notify_batches;        /* commits the sent notifies went out in, about one event message each */
+    uint8_t stage_count;
+    uint8_t task_count;
+    uint16_t reserved;
+    perf_stage_t stage[PERF_STAGE_COUNT];
+    struct {
+        char name[8];
+        uint16_t stack_free;        /* words never used */
+    } task[PERF_MAX_TASKS];
+} perf_report_t;
+
+
+static inline uint32_t perf_start(void){
+    return sensor_hal->cycles();
+}
+
+/* add the time since start to the histogram of a stage */
+void perf_record(perf_stage_id_t stage, uint32_t start);
+
+/* set the characteristics updated by perf_sample, any may be NULL */
+void perf_init(homekit_characteristic_t *sampled_min_free_heap, homekit_characteristic_t *min_stack_free, homekit_characteristic_t *max_stage_kcycles);
+
+/* sample heap and stacks, update the characteristics and send the UDP report */
+void perf_sample(void);
+
+#endif
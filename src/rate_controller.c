@@ -0,0 +1,63 @@
+/* Adaptive polling period, see rate_controller.h
+ */
+
+#include <math.h>
+#include "rate_controller.h"
+#include "sensor_hal.h"
+
+
+static void rate_controller_clamp(rate_controller_t *controller){
+    if (controller->period_ms < controller->min_period_ms){
+        controller->period_ms = controller->min_period_ms;
+    }
+    if (controller->period_ms > controller->max_period_ms){
+        controller->period_ms = controller->max_period_ms;
+    }
+}
+
+
+void rate_controller_set_bounds(rate_controller_t *controller, uint32_t min_period_ms, uint32_t max_period_ms){
+    if (max_period_ms < min_period_ms){
+        max_period_ms = min_period_ms;
+    }
+    controller->min_period_ms = min_period_ms;
+    controller->max_period_ms = max_period_ms;
+    rate_controller_clamp(controller);
+}
+
+
+void rate_controller_event(rate_controller_t *controller){
+    controller->period_ms = controller->min_period_ms;
+    controller->started = false;
+    controller->events++;
+}
+
+
+uint32_t rate_controller_update(rate_controller_t *controller, float value, uint8_t level){
+    uint32_t now = sensor_hal->now_ms();
+    float change, rate;
+
+    if (!controller->started || isnan(value)){
+        controller->started = !isnan(value);
+        controller->last_value = value;
+        controller->last_ms = now;
+        controller->last_level = level;
+        return controller->period_ms;
+    }
+
+    change = fabsf(value - controller->last_value);
+    rate = now != controller->last_ms ? change * 1000 / (now - controller->last_ms) : 0;
+
+    if (level != controller->last_level || change >= controller->step_threshold || rate >= controller->rate_threshold){
+        controller->period_ms = controller->min_period_ms;
+        controller->events++;
+    } else if (change < controller->step_threshold / 2 && rate < controller->rate_threshold / 2){
+        controller->period_ms *= RATE_BACKOFF;
+        rate_controller_clamp(controller);
+    }
+
+    controller->last_value = value;
+    controller->last_ms = now;
+    controller->last_level = level;
+    return controller->period_ms;
+}
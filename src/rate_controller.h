@@ -0,0 +1,45 @@
+/* Adaptive polling period. When the signal moves faster than a threshold, or its
+ * level changes, the period drops straight to the minimum so an event is followed
+ * closely. While the signal stays flat the period doubles each run up to the
+ * maximum, so a quiet room costs little CPU and radio time.
+ */
+
+#ifndef __RATE_CONTROLLER_H__
+#define __RATE_CONTROLLER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RATE_BACKOFF            2       /* period multiplier for each flat run */
+
+
+typedef struct {
+    float rate_threshold;           /* change per second that counts as an event */
+    float step_threshold;           /* change between two runs that counts as an event, however long apart */
+    uint32_t min_period_ms;
+    uint32_t max_period_ms;
+    uint32_t period_ms;
+    float last_value;
+    uint32_t last_ms;
+    uint8_t last_level;
+    bool started;
+    uint32_t events;
+} rate_controller_t;
+
+#define RATE_CONTROLLER(_rate, _step, _period_ms) { .rate_threshold = (_rate), .step_threshold = (_step), \
+    .min_period_ms = (_period_ms), .max_period_ms = (_period_ms), .period_ms = (_period_ms) }
+
+
+/* change the bounds, the current period is clamped to them */
+void rate_controller_set_bounds(rate_controller_t *controller, uint32_t min_period_ms, uint32_t max_period_ms);
+
+/* an event seen by other means, the period drops to the minimum and the next value
+   starts again from there rather than being compared with one from long before */
+void rate_controller_event(rate_controller_t *controller);
+
+/* feed the latest value and level, returns the period until the next run. A
+ * change below half of both thresholds counts as flat, in between the period is held.
+ */
+uint32_t rate_controller_update(rate_controller_t *controller, float value, uint8_t level);
+
+#endif
@@ -0,0 +1,71 @@
+/* Snapshot of the readings in RTC memory, see rtc_snapshot.h
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <espressif/esp_common.h>
+#include "rtc_snapshot.h"
+
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t saves;                 /* since the state was first written after a power on */
+    rtc_state_t state;
+    uint32_t checksum;              /* of everything before it */
+} rtc_snapshot_t;
+
+typedef char rtc_snapshot_fits[(sizeof(rtc_snapshot_t) <= (RTC_SNAPSHOT_END - RTC_SNAPSHOT_ADDR) * 4 && sizeof(rtc_snapshot_t) % 4 == 0) ? 1 : -1];
+
+
+static uint32_t rtc_snapshot_saves;
+
+
+/* FNV-1a, cheap and good enough to tell a snapshot from noise */
+static uint32_t rtc_snapshot_checksum(const rtc_snapshot_t *snapshot){
+    const uint8_t *byte = (const uint8_t *) snapshot;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < offsetof(rtc_snapshot_t, checksum); i++){
+        hash = (hash ^ byte[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+bool rtc_snapshot_save(const rtc_state_t *state){
+    rtc_snapshot_t snapshot = {
+        .magic = RTC_SNAPSHOT_MAGIC,
+        .version = RTC_SNAPSHOT_VERSION,
+        .length = sizeof(rtc_snapshot_t),
+        .saves = ++rtc_snapshot_saves,
+        .state = *state,
+    };
+
+    snapshot.checksum = rtc_snapshot_checksum(&snapshot);
+    if (!sdk_system_rtc_mem_write(RTC_SNAPSHOT_ADDR, &snapshot, sizeof(snapshot))){
+        printf("%s: failed to write RTC memory\n", __func__);
+        return false;
+    }
+    return true;
+}
+
+
+bool rtc_snapshot_load(rtc_state_t *state){
+    rtc_snapshot_t snapshot;
+
+    if (!sdk_system_rtc_mem_read(RTC_SNAPSHOT_ADDR, &snapshot, sizeof(snapshot))){
+        printf("%s: failed to read RTC memory\n", __func__);
+        return false;
+    }
+    if (snapshot.magic != RTC_SNAPSHOT_MAGIC || snapshot.version != RTC_SNAPSHOT_VERSION || snapshot.length != sizeof(rtc_snapshot_t)
+        || snapshot.checksum != rtc_snapshot_checksum(&snapshot)){
+        return false;
+    }
+    *state = snapshot.state;
+    rtc_snapshot_saves = snapshot.saves;
+    printf("%s: restored the state of save %u\n", __func__, snapshot.saves);
+    return true;
+}
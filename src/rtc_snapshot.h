@@ -0,0 +1,44 @@
+/* Snapshot of the latest readings and filter state in the RTC user memory of the
+ * ESP8266, which survives every reset but a loss of power. After a soft reset,
+ * watchdog or OTA reboot the snapshot is restored before HomeKit starts, so the
+ * accessory serves the last good values straight away instead of zeros while fresh
+ * measurements converge in the background. A magic, version, length and checksum
+ * guard against the random contents left by a power on.
+ */
+
+#ifndef __RTC_SNAPSHOT_H__
+#define __RTC_SNAPSHOT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp8266_mq135.h"
+#include "signal_filter.h"
+
+#define RTC_SNAPSHOT_ADDR       72          /* 4 byte block of the user memory, rboot keeps its state at 64 */
+#define RTC_SNAPSHOT_END        192         /* first block past the user memory */
+#define RTC_SNAPSHOT_MAGIC      0x52545353  /* "SSTR" */
+#define RTC_SNAPSHOT_VERSION    1
+#define RTC_SNAPSHOT_PERIOD_MS  15000
+
+
+/* everything restored, keep it a multiple of 4 bytes */
+typedef struct {
+    float temperature;
+    float humidity;
+    mq_readings_t readings;
+    float ro;                       /* of the MQ135 */
+    uint8_t valid_env;              /* temperature and humidity have been read */
+    uint8_t valid_air;              /* the air quality has been read */
+    uint8_t reserved[2];
+    signal_filter_t temperature_filter;
+    signal_filter_t humidity_filter;
+} rtc_state_t;
+
+
+/* write the state with a fresh checksum */
+bool rtc_snapshot_save(const rtc_state_t *state);
+
+/* read the state back, false if there is none or it does not check out */
+bool rtc_snapshot_load(rtc_state_t *state);
+
+#endif
@@ -0,0 +1,23 @@
+/* Hardware abstraction used by the sensor code, so that the measurement maths does
+ * not call the SDK or FreeRTOS directly. The firmware binds it to the ESP8266 in
+ * sensor_hal_esp8266.c, any other build can link its own definition of sensor_hal
+ * (for example one that feeds recorded or simulated ADC values).
+ */
+
+#ifndef __SENSOR_HAL_H__
+#define __SENSOR_HAL_H__
+
+#include <stdint.h>
+
+typedef struct {
+    uint16_t (*adc_read)(uint8_t channel);      /* raw 10 bit ADC code for the given analogue channel */
+    void     (*adc_select)(uint8_t channel);    /* switch the analogue multiplexer, only used with ADC_MUX_CHANNELS above 1 */
+    void     (*delay_ms)(uint32_t ms);          /* block the calling task */
+    uint32_t (*now_ms)(void);                   /* monotonic milliseconds, wraps */
+    uint32_t (*now_us)(void);                   /* monotonic microseconds, wraps */
+    uint32_t (*cycles)(void);                   /* cpu cycle counter, wraps, used for timing stages */
+} sensor_hal_t;
+
+extern const sensor_hal_t *sensor_hal;
+
+#endif
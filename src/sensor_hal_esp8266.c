@@ -0,0 +1,69 @@
+/* ESP8266 binding of the sensor hardware abstraction, see sensor_hal.h
+ */
+
+#include <espressif/esp_common.h>
+#include <esp8266.h>
+#include <xtensa_ops.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "sensor_hal.h"
+
+/* select inputs of a CD4051 style multiplexer in front of the ADC, least significant first */
+#define MUX_SELECT_A_GPIO   12
+#define MUX_SELECT_B_GPIO   14
+#define MUX_SELECT_C_GPIO   4
+
+
+static uint16_t esp8266_adc_read(uint8_t channel){
+    /* the ESP8266 only has the one analogue input, the multiplexer picks what is on it */
+    return sdk_system_adc_read();
+}
+
+
+static void esp8266_adc_select(uint8_t channel){
+    static bool enabled = false;
+
+    if (!enabled){
+        gpio_enable(MUX_SELECT_A_GPIO, GPIO_OUTPUT);
+        gpio_enable(MUX_SELECT_B_GPIO, GPIO_OUTPUT);
+        gpio_enable(MUX_SELECT_C_GPIO, GPIO_OUTPUT);
+        enabled = true;
+    }
+    gpio_write(MUX_SELECT_A_GPIO, channel & 1);
+    gpio_write(MUX_SELECT_B_GPIO, channel & 2);
+    gpio_write(MUX_SELECT_C_GPIO, channel & 4);
+}
+
+
+static void esp8266_delay_ms(uint32_t ms){
+    vTaskDelay(ms / portTICK_PERIOD_MS);
+}
+
+
+static uint32_t esp8266_now_ms(void){
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+
+static uint32_t esp8266_now_us(void){
+    return sdk_system_get_time();
+}
+
+
+static uint32_t esp8266_cycles(void){
+    uint32_t ccount;
+    RSR(ccount, ccount);
+    return ccount;
+}
+
+
+static const sensor_hal_t esp8266_hal = {
+    .adc_read = esp8266_adc_read,
+    .adc_select = esp8266_adc_select,
+    .delay_ms = esp8266_delay_ms,
+    .now_ms = esp8266_now_ms,
+    .now_us = esp8266_now_us,
+    .cycles = esp8266_cycles,
+};
+
+const sensor_hal_t *sensor_hal = &esp8266_hal;
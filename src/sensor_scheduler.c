@@ -0,0 +1,137 @@
+/* One task running every periodic sensor job from a table, see sensor_scheduler.h
+ */
+
+#include <stdio.h>
+#include <semphr.h>
+#include "sensor_scheduler.h"
+
+
+static sensor_job_t *scheduler_jobs;
+static uint8_t scheduler_job_count;
+static void (*scheduler_init)(void);
+static sensor_job_t *scheduler_current;
+static SemaphoreHandle_t scheduler_wake = NULL;    /* not a task notification, the DHT22 capture uses those */
+
+
+static TickType_t ms_to_ticks(uint32_t ms){
+    TickType_t ticks = ms / portTICK_PERIOD_MS;
+    return ticks ? ticks : 1;
+}
+
+
+void sensor_scheduler_report(void){
+    uint8_t i;
+    sensor_job_t *job;
+
+    for (i = 0; i < scheduler_job_count; i++){
+        job = &scheduler_jobs[i];
+        printf("%s: %s period %u ms, runs %u, skipped %u, late max %u ms, mean %u ms\n", __func__, job->name, job->period_ms, job->runs, job->skipped,
+               job->late_ms_max, job->runs ? job->late_ms_total / job->runs : 0);
+    }
+}
+
+
+static void sensor_scheduler_task(void *_args){
+    TickType_t now, last_report;
+    sensor_job_t *job;
+    uint32_t late;
+    uint8_t i;
+
+    if (scheduler_init){
+        scheduler_init();
+    }
+
+    now = last_report = xTaskGetTickCount();
+    for (i = 0; i < scheduler_job_count; i++){
+        scheduler_jobs[i].next = now;
+    }
+
+    while (1){
+        now = xTaskGetTickCount();
+        for (i = 0; i < scheduler_job_count; i++){
+            if (scheduler_jobs[i].woken){
+                scheduler_jobs[i].woken = false;
+                if ((int32_t) (scheduler_jobs[i].next - now) > 0){
+                    scheduler_jobs[i].next = now;
+                }
+            }
+        }
+
+        /* earliest deadline first */
+        job = &scheduler_jobs[0];
+        for (i = 1; i < scheduler_job_count; i++){
+            if ((int32_t) (scheduler_jobs[i].next - job->next) < 0){
+                job = &scheduler_jobs[i];
+            }
+        }
+
+        if ((int32_t) (job->next - now) > 0){
+            /* a wake cuts the wait short, and the earliest job is picked again */
+            xSemaphoreTake(scheduler_wake, job->next - now);
+            continue;
+        }
+
+        late = (now - job->next) * portTICK_PERIOD_MS;
+        job->late_ms_total += late;
+        if (late > job->late_ms_max){
+            job->late_ms_max = late;
+        }
+        job->runs++;
+        scheduler_current = job;
+        job->run();
+        scheduler_current = NULL;
+
+        job->next += ms_to_ticks(job->period_ms);
+        now = xTaskGetTickCount();
+        while ((int32_t) (job->next - now) <= 0){
+            /* overran a whole period, drop the missed deadlines rather than running back to back */
+            job->next += ms_to_ticks(job->period_ms);
+            job->skipped++;
+        }
+
+        if ((now - last_report) * portTICK_PERIOD_MS >= SENSOR_SCHEDULER_REPORT_MS){
+            last_report = now;
+            sensor_scheduler_report();
+        }
+    }
+}
+
+
+bool sensor_scheduler_start(sensor_job_t *jobs, uint8_t count, void (*init)(void), TaskHandle_t *handle){
+    if (count == 0){
+        return false;
+    }
+    scheduler_jobs = jobs;
+    scheduler_job_count = count;
+    scheduler_init = init;
+    scheduler_wake = xSemaphoreCreateBinary();
+    if (scheduler_wake == NULL || xTaskCreate(sensor_scheduler_task, "Sensors", SENSOR_SCHEDULER_STACK, NULL, 2, handle) != pdPASS){
+        printf("%s: failed to create the scheduler task\n", __func__);
+        return false;
+    }
+    return true;
+}
+
+
+void sensor_scheduler_wake(sensor_job_t *job){
+    job->woken = true;
+    if (scheduler_wake != NULL){
+        xSemaphoreGive(scheduler_wake);
+    }
+}
+
+
+sensor_job_t *sensor_scheduler_current(void){
+    return scheduler_current;
+}
+
+
+void sensor_scheduler_set_period(sensor_job_t *job, uint32_t period_ms){
+    TickType_t now = xTaskGetTickCount();
+
+    job->period_ms = period_ms;
+    if ((int32_t) (job->next - now) > (int32_t) ms_to_ticks(period_ms)){
+        /* shortened, so bring the next run forward rather than waiting out the old period */
+        job->next = now + ms_to_ticks(period_ms);
+    }
+}
@@ -0,0 +1,48 @@
+/* One task running every periodic sensor job from a table. Each job has an absolute
+ * deadline that advances by its period, so periods do not drift by the time the jobs
+ * take, and the lateness of every run is measured. Another task can wake a job, which
+ * then runs straight away and carries on its period from there.
+ */
+
+#ifndef __SENSOR_SCHEDULER_H__
+#define __SENSOR_SCHEDULER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#define SENSOR_SCHEDULER_STACK      384         /* words */
+#define SENSOR_SCHEDULER_REPORT_MS  (60UL * 60 * 1000)  /* how often job statistics are logged */
+
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+    uint32_t period_ms;
+    TickType_t next;                /* deadline of the next run */
+    uint32_t runs;
+    uint32_t skipped;               /* deadlines missed entirely because a run overran */
+    uint32_t late_ms_max;           /* worst start time after the deadline */
+    uint32_t late_ms_total;
+    volatile bool woken;            /* set by sensor_scheduler_wake, cleared by the scheduler */
+} sensor_job_t;
+
+#define SENSOR_JOB(_name, _run, _period_ms) { .name = (_name), .run = (_run), .period_ms = (_period_ms) }
+
+
+/* create the scheduler task, init is run in the task before the first job */
+bool sensor_scheduler_start(sensor_job_t *jobs, uint8_t count, void (*init)(void), TaskHandle_t *handle);
+
+/* change the period of a job, normally called from a job, taking effect from its next deadline */
+void sensor_scheduler_set_period(sensor_job_t *job, uint32_t period_ms);
+
+/* run a job as soon as the scheduler is free, from any task but not from an interrupt */
+void sensor_scheduler_wake(sensor_job_t *job);
+
+/* the job being run, for a job to adjust its own period */
+sensor_job_t *sensor_scheduler_current(void);
+
+void sensor_scheduler_report(void);
+
+#endif
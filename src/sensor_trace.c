@@ -0,0 +1,258 @@
+/* Recording of the sensor trace, see sensor_trace.h
+ *
+ * Records are added to a page in RAM from the sampler timer and the sensor task, a
+ * full page is handed to the deferred work task which sends or stores it, the
+ * same way as the history store.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <spiflash.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+#include "sensor_trace.h"
+#include "sensor_hal.h"
+#include "air_quality_index.h"
+#include "deferred_work.h"
+
+#define TRACE_PAGES_PER_SECTOR  (4096 / TRACE_PAGE_SIZE)
+#define TRACE_PAGE_COUNT        (TRACE_FLASH_SECTORS * TRACE_PAGES_PER_SECTOR)
+
+
+static trace_page_t trace_pages[2];         /* one being built, one waiting for the writer */
+static uint8_t trace_building = 0;
+static volatile int8_t trace_pending = -1;
+static uint32_t trace_last_ms;
+static uint32_t trace_sequence = 0;
+static volatile trace_mode_t trace_mode = TRACE_OFF;
+static trace_state_t trace_state;
+static int trace_socket = -1;
+static void trace_drain(void);
+static deferred_work_t trace_work = DEFERRED_WORK("Trace", trace_drain, 0);
+#if TRACE_FLASH_SECTORS > 0
+static uint32_t trace_next_page = 0;
+#endif
+
+
+/* hand the page being built to the writer, must be in a critical section, returns true if the writer should be woken */
+static bool trace_commit(void){
+    trace_page_t *page = &trace_pages[trace_building];
+
+    if (page->magic != TRACE_PAGE_MAGIC){
+        return false;
+    }
+    if (trace_pending >= 0){
+        /* the writer is behind, the gap shows in the page sequence numbers */
+        page->magic = TRACE_BLANK_MAGIC;
+        return false;
+    }
+    trace_pending = trace_building;
+    trace_building ^= 1;
+    trace_pages[trace_building].magic = TRACE_BLANK_MAGIC;
+    return true;
+}
+
+
+/* append a record to the page being built, must be in a critical section */
+static bool trace_append(trace_type_t type, const void *payload, uint8_t words, uint32_t now){
+    trace_page_t *page = &trace_pages[trace_building];
+    trace_record_header_t header = { .type = type, .words = words };
+    bool wake = false;
+
+    if (page->magic == TRACE_PAGE_MAGIC && (now - trace_last_ms > UINT16_MAX || page->words + 1 + words > TRACE_PAGE_WORDS)){
+        wake = trace_commit();
+        page = &trace_pages[trace_building];
+    }
+    if (page->magic != TRACE_PAGE_MAGIC){
+        page->magic = TRACE_PAGE_MAGIC;
+        page->version = TRACE_VERSION;
+        page->words = 0;
+        page->sequence = trace_sequence++;
+        page->time_ms = now;
+        trace_last_ms = now;
+        if (type != TRACE_STATE){
+            /* every page starts with the state, so a page can be replayed on its own */
+            trace_append(TRACE_STATE, &trace_state, sizeof(trace_state) / 4, now);
+        }
+    }
+
+    header.dt_ms = now - trace_last_ms;
+    trace_last_ms = now;
+    memcpy(&page->data[page->words], &header, 4);
+    memcpy(&page->data[page->words + 1], payload, words * 4);
+    page->words += 1 + words;
+    return wake;
+}
+
+
+static void trace_write(trace_type_t type, const void *payload, uint8_t words){
+    uint32_t now = sensor_hal->now_ms();
+    bool wake;
+
+    if (trace_mode == TRACE_OFF){
+        return;
+    }
+    taskENTER_CRITICAL();
+    wake = trace_append(type, payload, words, now);
+    taskEXIT_CRITICAL();
+    if (wake){
+        deferred_work_request(&trace_work);
+    }
+}
+
+
+void trace_adc(uint16_t code, uint32_t sample){
+    trace_adc_t record = { .code = code, .sample = sample };
+    trace_write(TRACE_ADC, &record, sizeof(record) / 4);
+}
+
+
+void trace_dht(float temperature, float humidity, bool valid){
+    trace_dht_t record = { .temperature = temperature, .humidity = humidity, .valid = valid };
+    trace_write(TRACE_DHT, &record, sizeof(record) / 4);
+}
+
+
+void trace_output(const mq_readings_t *readings){
+    trace_output_t record = {
+        .samples = readings->samples,
+        .rs = readings->rs,
+        .correction_factor = readings->correction_factor,
+        .rs_ro_ratio = readings->rs_ro_ratio,
+        .aqi_index = readings->aqi_index,
+        .air_quality = readings->air_quality,
+    };
+    trace_state_t state = { .ro = mq_channels[MQ_CHANNEL_MQ135].ro, .aqi_standard = aqi_get_standard() };
+
+    if (state.ro != trace_state.ro || state.aqi_standard != trace_state.aqi_standard){
+        trace_state = state;
+        trace_write(TRACE_STATE, &trace_state, sizeof(trace_state) / 4);
+    }
+    memcpy(record.ppm, readings->ppm, sizeof(record.ppm));
+    trace_write(TRACE_OUTPUT, &record, sizeof(record) / 4);
+}
+
+
+static void trace_send(int *udp_socket, const trace_page_t *page){
+    struct sockaddr_in address;
+    int broadcast = 1;
+
+    if (*udp_socket < 0){
+        *udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (*udp_socket < 0){
+            return;
+        }
+        setsockopt(*udp_socket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+    }
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(TRACE_PORT);
+    address.sin_addr.s_addr = INADDR_BROADCAST;
+    sendto(*udp_socket, page, TRACE_PAGE_SIZE, 0, (struct sockaddr *) &address, sizeof(address));
+}
+
+
+#if TRACE_FLASH_SECTORS > 0
+static void trace_store(trace_page_t *page){
+    uint32_t address = TRACE_FLASH_BASE_ADDR + trace_next_page * TRACE_PAGE_SIZE;
+
+    if (trace_next_page % TRACE_PAGES_PER_SECTOR == 0){
+        spiflash_erase_sector(address);
+    }
+    /* magic last, so a page interrupted by a reset is never taken as valid */
+    page->magic = TRACE_BLANK_MAGIC;
+    spiflash_write(address, (uint8_t *) page, TRACE_PAGE_SIZE);
+    page->magic = TRACE_PAGE_MAGIC;
+    spiflash_write(address, (uint8_t *) page, 4);
+    trace_next_page = (trace_next_page + 1) % TRACE_PAGE_COUNT;
+}
+
+
+/* carry on after the newest page in flash, so a trace spans restarts */
+static void trace_find_newest(void){
+    uint32_t header[2], page;
+    bool found = false;
+
+    for (page = 0; page < TRACE_PAGE_COUNT; page++){
+        spiflash_read(TRACE_FLASH_BASE_ADDR + page * TRACE_PAGE_SIZE, (uint8_t *) header, sizeof(header));
+        if ((header[0] & 0xffff) != TRACE_PAGE_MAGIC){
+            continue;
+        }
+        if (!found || (int32_t) (header[1] - trace_sequence) >= 0){
+            found = true;
+            trace_sequence = header[1] + 1;
+            trace_next_page = (page + 1) % TRACE_PAGE_COUNT;
+        }
+    }
+    spiflash_read(TRACE_FLASH_BASE_ADDR + trace_next_page * TRACE_PAGE_SIZE, (uint8_t *) header, sizeof(header));
+    if (trace_next_page % TRACE_PAGES_PER_SECTOR != 0 && (header[0] != 0xffffffff || header[1] != 0xffffffff)){
+        /* the next page is not blank, e.g. a write was interrupted, so start the next sector */
+        trace_next_page = (trace_next_page / TRACE_PAGES_PER_SECTOR + 1) * TRACE_PAGES_PER_SECTOR % TRACE_PAGE_COUNT;
+    }
+}
+#endif
+
+
+static void trace_drain(void){
+    trace_page_t *page;
+
+    if (trace_pending < 0){
+        /* quiet for TRACE_FLUSH_MS, send what there is */
+        taskENTER_CRITICAL();
+        trace_commit();
+        taskEXIT_CRITICAL();
+    }
+    if (trace_pending >= 0){
+        page = &trace_pages[trace_pending];
+        if (trace_mode == TRACE_UDP){
+            trace_send(&trace_socket, page);
+        }
+#if TRACE_FLASH_SECTORS > 0
+        if (trace_mode == TRACE_FLASH){
+            trace_store(page);
+        }
+#endif
+        trace_pending = -1;
+    }
+    /* every page handed over moves the flush on, while off there is nothing to flush
+       until trace_set_mode starts it again */
+    if (trace_mode != TRACE_OFF){
+        deferred_work_schedule(&trace_work, TRACE_FLUSH_MS);
+    }
+}
+
+
+bool trace_set_mode(trace_mode_t mode){
+    bool restart;
+
+    if (mode >= TRACE_MODE_COUNT || (mode == TRACE_FLASH && TRACE_FLASH_SECTORS == 0)){
+        printf("%s: mode %u not available\n", __func__, mode);
+        return false;
+    }
+    taskENTER_CRITICAL();
+    restart = trace_mode == TRACE_OFF && mode != TRACE_OFF;
+    if (mode != trace_mode){
+        /* start a fresh page in the new mode */
+        trace_pages[trace_building].magic = TRACE_BLANK_MAGIC;
+        trace_mode = mode;
+    }
+    taskEXIT_CRITICAL();
+    if (restart){
+        /* the flush stopped while tracing was off */
+        deferred_work_schedule(&trace_work, TRACE_FLUSH_MS);
+    }
+    return true;
+}
+
+
+void trace_init(trace_mode_t mode){
+#if TRACE_FLASH_SECTORS > 0
+    trace_find_newest();
+#endif
+    if (!deferred_work_add(&trace_work)){
+        printf("%s: failed to add the writer\n", __func__);
+        return;
+    }
+    trace_set_mode(mode);
+}
@@ -0,0 +1,108 @@
+/* Record of what the sensor saw, for replaying field problems and algorithm changes
+ * on a host. The trace holds the raw ADC codes and DHT22 readings that go into the
+ * pipeline, the Ro and AQI standard it ran with and the outputs it produced.
+ *
+ * A trace is a sequence of 256 byte pages, each with a header giving its sequence
+ * number and the absolute time its first record is timed from, followed by records
+ * of whole 32 bit words. Every page starts with a state record, so any page can be
+ * replayed on its own. The same pages are broadcast over UDP or written to a ring
+ * in flash, tools/replay reads either.
+ */
+
+#ifndef __SENSOR_TRACE_H__
+#define __SENSOR_TRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp8266_mq135.h"
+
+#define TRACE_PAGE_SIZE         256
+#define TRACE_PAGE_MAGIC        0x5254      /* "TR" */
+#define TRACE_BLANK_MAGIC       0xffff
+#define TRACE_VERSION           1
+#define TRACE_PAGE_WORDS        ((TRACE_PAGE_SIZE - 12) / 4)
+#define TRACE_PORT              45681       /* next to the binary log port */
+#define TRACE_FLUSH_MS          5000        /* longest a record waits in a part filled page */
+
+#ifndef TRACE_FLASH_SECTORS
+#define TRACE_FLASH_SECTORS     0           /* no flash region unless the Makefile sets one */
+#endif
+
+
+typedef enum {
+    TRACE_OFF = 0,
+    TRACE_UDP,
+    TRACE_FLASH,
+    TRACE_MODE_COUNT
+} trace_mode_t;
+
+
+typedef enum {
+    TRACE_ADC = 1,
+    TRACE_DHT,
+    TRACE_STATE,
+    TRACE_OUTPUT,
+} trace_type_t;
+
+
+/* little endian as written by the ESP8266, every field is naturally aligned */
+typedef struct {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t words;                  /* used in data */
+    uint32_t sequence;
+    uint32_t time_ms;               /* the first record is timed from this */
+    uint32_t data[TRACE_PAGE_WORDS];
+} trace_page_t;
+
+
+typedef struct {
+    uint8_t type;
+    uint8_t words;                  /* of payload after this header */
+    uint16_t dt_ms;                 /* since the record before, or the page time */
+} trace_record_header_t;
+
+
+typedef struct {
+    uint16_t code;                  /* raw, before any filtering */
+    uint16_t sample;                /* low bits of the count of samples taken, including this one */
+} trace_adc_t;
+
+
+typedef struct {
+    float temperature;              /* raw, before any filtering */
+    float humidity;
+    uint32_t valid;                 /* the read succeeded */
+} trace_dht_t;
+
+
+typedef struct {
+    float ro;
+    uint32_t aqi_standard;
+} trace_state_t;
+
+
+typedef struct {
+    uint32_t samples;               /* adc samples taken up to the reading */
+    float rs;
+    float correction_factor;
+    float rs_ro_ratio;
+    float ppm[GAS_COUNT];           /* clamped as published */
+    float aqi_index;
+    uint32_t air_quality;
+} trace_output_t;
+
+
+/* add the writer to the deferred work and start recording in the given mode */
+void trace_init(trace_mode_t mode);
+
+/* change the mode, false if it is not available in this build */
+bool trace_set_mode(trace_mode_t mode);
+
+void trace_adc(uint16_t code, uint32_t sample);
+
+void trace_dht(float temperature, float humidity, bool valid);
+
+void trace_output(const mq_readings_t *readings);
+
+#endif
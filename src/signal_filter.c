@@ -0,0 +1,117 @@
+/* Streaming outlier rejection and smoothing, see signal_filter.h
+ */
+
+#include "signal_filter.h"
+
+#define MAD_SCALE               Q16(1.4826)     /* makes the median absolute deviation estimate sigma of normal noise */
+
+
+static q16_t median(q16_t *values, uint8_t count){
+    uint8_t i, j;
+    q16_t value;
+
+    /* insertion sort, there are only a handful of values */
+    for (i = 1; i < count; i++){
+        value = values[i];
+        for (j = i; j > 0 && values[j - 1] > value; j--){
+            values[j] = values[j - 1];
+        }
+        values[j] = value;
+    }
+    return values[count / 2];
+}
+
+
+void signal_filter_reset(signal_filter_t *filter){
+    filter->head = 0;
+    filter->count = 0;
+    filter->started = false;
+    filter->rejected = 0;
+}
+
+
+void signal_filter_restore(signal_filter_t *filter, const signal_filter_t *saved){
+    uint8_t i;
+
+    signal_filter_reset(filter);
+    if (saved->window != filter->window || saved->count > filter->window){
+        /* the history was kept for a different window, the estimate is still good */
+        filter->started = saved->started;
+    } else {
+        for (i = 0; i < SIGNAL_FILTER_WINDOW; i++){
+            filter->history[i] = saved->history[i];
+        }
+        filter->head = saved->head;
+        filter->count = saved->count;
+        filter->started = saved->started;
+    }
+    filter->estimate = saved->estimate;
+    filter->variance = saved->variance;
+}
+
+
+static q16_t signal_filter_reject(signal_filter_t *filter, q16_t value){
+    q16_t sorted[SIGNAL_FILTER_WINDOW];
+    q16_t centre, deviation;
+    uint8_t i, count = filter->count;
+
+    for (i = 0; i < count; i++){
+        sorted[i] = filter->history[i];
+    }
+    centre = median(sorted, count);
+    for (i = 0; i < count; i++){
+        sorted[i] = sorted[i] > centre ? sorted[i] - centre : centre - sorted[i];
+    }
+    deviation = ((int64_t) median(sorted, count) * MAD_SCALE) >> 16;
+    if (deviation < filter->min_deviation){
+        deviation = filter->min_deviation;
+    }
+
+    if ((int64_t) (value > centre ? value - centre : centre - value) << 16 > (int64_t) filter->threshold * deviation){
+        filter->rejected++;
+        return centre;
+    }
+    return value;
+}
+
+
+q16_t signal_filter_clean(signal_filter_t *filter, q16_t value){
+    q16_t raw = value;
+    uint8_t window = filter->window < SIGNAL_FILTER_WINDOW ? filter->window : SIGNAL_FILTER_WINDOW;
+
+    /* the history holds raw values, so a real step is accepted once it has the majority */
+    if (filter->count == window){
+        value = signal_filter_reject(filter, value);
+    }
+    filter->history[filter->head] = raw;
+    filter->head = (filter->head + 1) % window;
+    if (filter->count < window){
+        filter->count++;
+    }
+    return value;
+}
+
+
+q16_t signal_filter_smooth(signal_filter_t *filter, q16_t value){
+    q16_t gain;
+    int64_t total;
+
+    if (!filter->started){
+        filter->started = true;
+        filter->estimate = value;
+        filter->variance = filter->measurement_noise;
+        return value;
+    }
+
+    filter->variance += filter->process_noise;
+    total = (int64_t) filter->variance + filter->measurement_noise;
+    gain = total > 0 ? ((int64_t) filter->variance << 16) / total : 65536;
+    filter->estimate += ((int64_t) (value - filter->estimate) * gain) >> 16;
+    filter->variance = ((int64_t) (65536 - gain) * filter->variance) >> 16;
+    return filter->estimate;
+}
+
+
+q16_t signal_filter_update(signal_filter_t *filter, q16_t value){
+    return signal_filter_smooth(filter, signal_filter_clean(filter, value));
+}
@@ -0,0 +1,56 @@
+/* Streaming filter stage for raw sensor values, in Q16 fixed point. Each value is
+ * first checked against the median of the last few raw values (a Hampel filter),
+ * one too far from it is taken to be a spike or a garbage frame and replaced by
+ * that median. The result is then smoothed by a one dimensional Kalman filter
+ * with a constant level model.
+ */
+
+#ifndef __SIGNAL_FILTER_H__
+#define __SIGNAL_FILTER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIGNAL_FILTER_WINDOW    7       /* most raw values the median can be taken over */
+
+typedef int32_t q16_t;
+
+#define Q16(x)                  ((q16_t) ((x) * 65536.0 + ((x) >= 0 ? 0.5 : -0.5)))
+#define Q16_TO_FLOAT(x)         ((x) / 65536.0f)
+
+
+typedef struct {
+    uint8_t window;                 /* raw values in the median, odd and at most SIGNAL_FILTER_WINDOW */
+    q16_t threshold;                /* how many scaled median absolute deviations make an outlier */
+    q16_t min_deviation;            /* floor of the deviation, so a flat or coarse signal is not all outliers */
+    q16_t process_noise;            /* variance the true value moves by between updates */
+    q16_t measurement_noise;        /* variance of a single raw value */
+    q16_t history[SIGNAL_FILTER_WINDOW];
+    uint8_t head;
+    uint8_t count;
+    bool started;
+    q16_t estimate;
+    q16_t variance;                 /* of the estimate */
+    uint32_t rejected;
+} signal_filter_t;
+
+#define SIGNAL_FILTER(_window, _threshold, _min_deviation, _process_noise, _measurement_noise) { \
+    .window = (_window), .threshold = Q16(_threshold), .min_deviation = Q16(_min_deviation), \
+    .process_noise = Q16(_process_noise), .measurement_noise = Q16(_measurement_noise) }
+
+
+void signal_filter_reset(signal_filter_t *filter);
+
+/* carry on from the state of a saved copy, keeping the tuning of the filter itself */
+void signal_filter_restore(signal_filter_t *filter, const signal_filter_t *saved);
+
+/* add a raw value to the outlier window, returns it or the median that replaces it */
+q16_t signal_filter_clean(signal_filter_t *filter, q16_t value);
+
+/* add a clean value to the smoother, returns the estimate */
+q16_t signal_filter_smooth(signal_filter_t *filter, q16_t value);
+
+/* both stages, returns the smoothed estimate */
+q16_t signal_filter_update(signal_filter_t *filter, q16_t value);
+
+#endif
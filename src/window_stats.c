@@ -0,0 +1,168 @@
+/* Running statistics over the last minute, hour and day, see window_stats.h
+ */
+
+#include <string.h>
+#include <math.h>
+#include "window_stats.h"
+
+
+static const struct {
+    uint32_t bucket_ms;
+    uint8_t buckets;
+    uint8_t first;                  /* index in window_stats_t.bucket */
+} window_stats_tiers[WINDOW_STATS_TIERS] = {
+    [WINDOW_STATS_MINUTE] = { 10 * 1000, WINDOW_STATS_MINUTE_BUCKETS, 0 },
+    [WINDOW_STATS_HOUR] = { 5 * 60 * 1000, WINDOW_STATS_HOUR_BUCKETS, WINDOW_STATS_MINUTE_BUCKETS },
+    [WINDOW_STATS_DAY] = { 60 * 60 * 1000, WINDOW_STATS_DAY_BUCKETS, WINDOW_STATS_MINUTE_BUCKETS + WINDOW_STATS_HOUR_BUCKETS },
+};
+
+#define WINDOW_STATS_SPAN_MS    (WINDOW_STATS_DAY_BUCKETS * 60 * 60 * 1000UL)
+
+
+static window_stats_bucket_t *window_stats_current(window_stats_t *stats, uint8_t tier){
+    return &stats->bucket[window_stats_tiers[tier].first + stats->head[tier]];
+}
+
+
+static void window_stats_merge(window_stats_bucket_t *into, const window_stats_bucket_t *from){
+    if (from->count){
+        if (into->count == 0 || from->min < into->min){
+            into->min = from->min;
+        }
+        if (into->count == 0 || from->max > into->max){
+            into->max = from->max;
+        }
+    }
+    into->sum += from->sum;
+    into->integral += from->integral;
+    into->duration_ms += from->duration_ms;
+    into->count += from->count;
+}
+
+
+/* the last value held until a time, into the current minute bucket */
+static void window_stats_hold(window_stats_t *stats, uint32_t until_ms){
+    window_stats_bucket_t *bucket = window_stats_current(stats, WINDOW_STATS_MINUTE);
+    uint32_t elapsed = until_ms - stats->last_ms;
+
+    bucket->integral += stats->last_value * elapsed;
+    bucket->duration_ms += elapsed;
+    stats->last_ms = until_ms;
+}
+
+
+/* close the current bucket of a ring, folding it into the ring above, and start the next */
+static void window_stats_roll(window_stats_t *stats, uint8_t tier){
+    if (tier + 1 < WINDOW_STATS_TIERS){
+        window_stats_merge(window_stats_current(stats, tier + 1), window_stats_current(stats, tier));
+    }
+    stats->head[tier] = (stats->head[tier] + 1) % window_stats_tiers[tier].buckets;
+    memset(window_stats_current(stats, tier), 0, sizeof(window_stats_bucket_t));
+    stats->start_ms[tier] += window_stats_tiers[tier].bucket_ms;
+}
+
+
+bool window_stats_add(window_stats_t *stats, float value, uint32_t now_ms){
+    window_stats_bucket_t *bucket;
+    bool publish = false;
+    uint8_t tier;
+
+    if (isnan(value)){
+        return false;
+    }
+    if (!stats->started || now_ms - stats->last_ms >= WINDOW_STATS_SPAN_MS){
+        /* nothing worth keeping, start again from this sample */
+        memset(stats, 0, sizeof(*stats));
+        for (tier = 0; tier < WINDOW_STATS_TIERS; tier++){
+            stats->start_ms[tier] = now_ms;
+        }
+        stats->publish_ms = now_ms;
+        stats->last_ms = now_ms;
+        stats->started = true;
+        publish = true;
+    }
+
+    while (now_ms - stats->start_ms[WINDOW_STATS_MINUTE] >= window_stats_tiers[WINDOW_STATS_MINUTE].bucket_ms){
+        window_stats_hold(stats, stats->start_ms[WINDOW_STATS_MINUTE] + window_stats_tiers[WINDOW_STATS_MINUTE].bucket_ms);
+        window_stats_roll(stats, WINDOW_STATS_MINUTE);
+        /* each ring above closes when the one below has reached its boundary */
+        for (tier = 1; tier < WINDOW_STATS_TIERS; tier++){
+            if (stats->start_ms[tier - 1] - stats->start_ms[tier] < window_stats_tiers[tier].bucket_ms){
+                break;
+            }
+            window_stats_roll(stats, tier);
+        }
+    }
+    if (now_ms - stats->publish_ms >= WINDOW_STATS_PUBLISH_MS){
+        stats->publish_ms = now_ms;
+        publish = true;
+    }
+
+    window_stats_hold(stats, now_ms);
+    bucket = window_stats_current(stats, WINDOW_STATS_MINUTE);
+    if (bucket->count == 0 || value < bucket->min){
+        bucket->min = value;
+    }
+    if (bucket->count == 0 || value > bucket->max){
+        bucket->max = value;
+    }
+    bucket->sum += value;
+    bucket->count++;
+    stats->last_value = value;
+    return publish;
+}
+
+
+static bool window_stats_fill(const window_stats_t *stats, const window_stats_bucket_t *merged, window_stats_result_t *result){
+    if (merged->count == 0){
+        return false;
+    }
+    result->min = merged->min;
+    result->max = merged->max;
+    result->mean = merged->sum / merged->count;
+    /* the samples were all taken at once, so no time is covered yet */
+    result->twa = merged->duration_ms ? merged->integral / merged->duration_ms : stats->last_value;
+    result->count = merged->count;
+    return true;
+}
+
+
+bool window_stats_result(const window_stats_t *stats, uint8_t tier, uint8_t buckets, window_stats_result_t *result){
+    window_stats_bucket_t merged = { 0 };
+    uint8_t size = window_stats_tiers[tier].buckets;
+    uint8_t i;
+
+    if (buckets == 0 || buckets > size){
+        buckets = size;
+    }
+    for (i = 0; i < buckets; i++){
+        window_stats_merge(&merged, &stats->bucket[window_stats_tiers[tier].first + (stats->head[tier] + size - i) % size]);
+    }
+    /* what has not been folded up into the ring yet */
+    for (i = 0; i < tier; i++){
+        window_stats_merge(&merged, &stats->bucket[window_stats_tiers[i].first + stats->head[i]]);
+    }
+    return window_stats_fill(stats, &merged, result);
+}
+
+
+bool window_stats_span(const window_stats_t *stats, uint32_t span_ms, window_stats_result_t *result){
+    window_stats_bucket_t merged = { 0 }, hour;
+    uint8_t size = window_stats_tiers[WINDOW_STATS_DAY].buckets;
+    uint8_t i;
+
+    /* the current hour, with what has not been folded up into it yet */
+    for (i = 0; i < WINDOW_STATS_TIERS; i++){
+        window_stats_merge(&merged, &stats->bucket[window_stats_tiers[i].first + stats->head[i]]);
+    }
+    for (i = 1; i < size && merged.duration_ms < span_ms; i++){
+        hour = stats->bucket[window_stats_tiers[WINDOW_STATS_DAY].first + (stats->head[WINDOW_STATS_DAY] + size - i) % size];
+        if (merged.duration_ms + hour.duration_ms > span_ms){
+            /* only the newest part of this hour is in the span */
+            hour.integral *= (float) (span_ms - merged.duration_ms) / hour.duration_ms;
+            hour.duration_ms = span_ms - merged.duration_ms;
+        }
+        window_stats_merge(&merged, &hour);
+    }
+    return window_stats_fill(stats, &merged, result);
+}
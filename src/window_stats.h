@@ -0,0 +1,76 @@
+/* Running statistics of a measurement over the last minute, hour and day. Samples
+ * are added to the current bucket of the minute ring and each closed bucket is
+ * folded into the current bucket of the next ring up, so adding a sample is O(1)
+ * and nothing is allocated. A window is read by merging the buckets of its ring,
+ * at most WINDOW_STATS_BUCKETS of them.
+ *
+ * Samples come at an adaptive rate, so besides the plain mean of the samples each
+ * bucket integrates the value over time, holding each sample until the next one,
+ * for a time weighted average.
+ */
+
+#ifndef __WINDOW_STATS_H__
+#define __WINDOW_STATS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* rings, each bucket of a ring is a whole number of buckets of the one below */
+#define WINDOW_STATS_MINUTE         0       /* 6 buckets of 10 s */
+#define WINDOW_STATS_HOUR           1       /* 12 buckets of 5 min */
+#define WINDOW_STATS_DAY            2       /* 24 buckets of 1 h */
+#define WINDOW_STATS_TIERS          3
+
+#define WINDOW_STATS_MINUTE_BUCKETS 6
+#define WINDOW_STATS_HOUR_BUCKETS   12
+#define WINDOW_STATS_DAY_BUCKETS    24
+#define WINDOW_STATS_BUCKETS        (WINDOW_STATS_MINUTE_BUCKETS + WINDOW_STATS_HOUR_BUCKETS + WINDOW_STATS_DAY_BUCKETS)
+#define WINDOW_STATS_PUBLISH_MS     60000   /* how often window_stats_add asks for the results to be published */
+
+
+typedef struct {
+    float min;
+    float max;
+    float sum;
+    float integral;                 /* value times milliseconds */
+    uint32_t duration_ms;           /* time the integral covers */
+    uint16_t count;
+} window_stats_bucket_t;
+
+
+typedef struct {
+    window_stats_bucket_t bucket[WINDOW_STATS_BUCKETS];     /* the minute ring, then the hour ring, then the day ring */
+    uint8_t head[WINDOW_STATS_TIERS];       /* current bucket of each ring */
+    uint32_t start_ms[WINDOW_STATS_TIERS];  /* when the current bucket of each ring started */
+    uint32_t publish_ms;            /* when window_stats_add last returned true */
+    float last_value;
+    uint32_t last_ms;
+    bool started;
+} window_stats_t;
+
+
+typedef struct {
+    float min;
+    float max;
+    float mean;                     /* of the samples */
+    float twa;                      /* time weighted average */
+    uint32_t count;
+} window_stats_result_t;
+
+
+/* add a sample, NaN is ignored. Returns true every WINDOW_STATS_PUBLISH_MS, the
+ * results move slowly and are not worth publishing more often */
+bool window_stats_add(window_stats_t *stats, float value, uint32_t now_ms);
+
+/* statistics of the newest buckets of a ring, 0 for all of them, including the
+ * part of the current bucket still in the rings below. False if there are no samples */
+bool window_stats_result(const window_stats_t *stats, uint8_t tier, uint8_t buckets, window_stats_result_t *result);
+
+/* statistics of the last span_ms, up to a day, from the current hour and as many
+ * whole hours before it as fit. The part of the span left over is taken pro rata
+ * from the hour before those, so the time weighted average covers the span exactly
+ * when that hour was steady, the other results include all of it. False if there
+ * are no samples */
+bool window_stats_span(const window_stats_t *stats, uint32_t span_ms, window_stats_result_t *result);
+
+#endif
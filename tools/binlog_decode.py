@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Listen for the binary log broadcasts of the sensor and print them as text.
+
+The format strings are read from the BINLOG_FORMATS table in src/binlog.h, so
+this must be run against the same source as the firmware.
+
+    tools/binlog_decode.py [--port 45680] [--formats src/binlog.h]
+"""
+
+import argparse
+import os
+import re
+import socket
+import struct
+
+MAGIC = 0x474f4c42
+VERSION = 1
+HEADER = struct.Struct("<IHHI")
+RECORD = struct.Struct("<IHBB6I")
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D"}
+CONVERSION = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?([a-zA-Z%])")
+
+
+def load_formats(path):
+    """format strings in table order, the position is the id"""
+    with open(path) as source:
+        text = source.read()
+    table = text[text.index("#define BINLOG_FORMATS(X)"):]
+    table = table[:table.index("\n\n")]
+    return [(name, bytes(fmt, "utf-8").decode("unicode_escape"))
+            for name, fmt in re.findall(r'X\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', table)]
+
+
+def render(fmt, args):
+    values = []
+    for conversion, arg in zip((c for c in CONVERSION.findall(fmt) if c != "%"), args):
+        if conversion in "feEgG":
+            values.append(struct.unpack("<f", struct.pack("<I", arg))[0])
+        elif conversion in "di":
+            values.append(arg - (1 << 32) if arg & 0x80000000 else arg)
+        else:
+            values.append(arg)
+    try:
+        return fmt.replace("%u", "%d") % tuple(values)
+    except (TypeError, ValueError):
+        return "%s %s" % (fmt, " ".join("%08x" % arg for arg in args))
+
+
+def decode(packet, formats, dropped):
+    magic, version, count, lost = HEADER.unpack_from(packet)
+    if magic != MAGIC or version != VERSION:
+        return dropped
+    if lost != dropped:
+        print("-- %d records dropped" % (lost - dropped))
+    for i in range(count):
+        fields = RECORD.unpack_from(packet, HEADER.size + i * RECORD.size)
+        time_ms, record_id, level, nargs = fields[:4]
+        args = fields[4:4 + nargs]
+        if record_id < len(formats):
+            name, fmt = formats[record_id]
+            text = render(fmt, args)
+        else:
+            name, text = "UNKNOWN_%d" % record_id, " ".join("%08x" % arg for arg in args)
+        print("%10.3f %s %-18s %s" % (time_ms / 1000.0, LEVELS.get(level, "?"), name, text))
+    return lost
+
+
+def main():
+    default_formats = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "binlog.h")
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=45680)
+    parser.add_argument("--formats", default=default_formats, help="binlog.h the firmware was built from")
+    options = parser.parse_args()
+
+    formats = load_formats(options.formats)
+    listener = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("", options.port))
+    dropped = 0
+    while True:
+        packet, sender = listener.recvfrom(2048)
+        dropped = decode(packet, formats, dropped)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,372 @@
+/* Runs the config store on a simulated flash, to compare writing every change with
+ * the debounced commits and to check that a power cut never loses the settings.
+ *
+ *     config_bench [-d days] [-c power cuts] [-s seed]
+ *
+ * The workload is a simulated device: a slider dragged in the Home app each day,
+ * a daily baseline update of the Ro of three MQ sensors, tracing switched on and
+ * off every few days and the AQI standard changed and changed back. Flash time is
+ * from typical SPI NOR figures, the host time is that of the store itself. Each
+ * power cut stops a commit part way through programming or erasing, the store is
+ * then started again and must load either every old or every new value. The exit
+ * status is 0 when every restart loaded a consistent set of values.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "config_store.h"
+#include "sensor_hal.h"
+#include "deferred_work.h"
+
+#define FLASH_ERASE_US          45000       /* 4 KB sector */
+#define FLASH_PAGE_PROGRAM_US   700         /* up to 256 bytes within a page */
+#define FLASH_PAGE_SIZE         256
+#define BENCH_STEP_MS           250
+
+
+/* the flash region of the store, NOR so programming can only clear bits */
+static uint8_t flash[CONFIG_FLASH_SECTORS * CONFIG_SECTOR_SIZE];
+static uint32_t flash_erases[CONFIG_FLASH_SECTORS];
+static uint32_t flash_programmed;
+static uint64_t flash_busy_us;
+static long flash_cut_after = -1;           /* bytes still programmed before the power is cut, -1 never */
+static bool flash_cut_in_erase;
+static bool flash_power_off;
+
+static uint32_t bench_now_ms;
+
+
+static uint32_t bench_now(void){
+    return bench_now_ms;
+}
+
+static const sensor_hal_t bench_hal = {
+    .now_ms = bench_now,
+};
+
+const sensor_hal_t *sensor_hal = &bench_hal;
+
+
+bool deferred_work_add(deferred_work_t *work){
+    /* the bench commits itself rather than from the deferred work task */
+    return true;
+}
+
+void deferred_work_schedule(deferred_work_t *work, uint32_t delay_ms){
+}
+
+
+static bool flash_offset(uint32_t addr, uint32_t size, uint32_t *offset){
+    if (addr < CONFIG_FLASH_BASE_ADDR || addr + size > CONFIG_FLASH_BASE_ADDR + sizeof(flash)){
+        fprintf(stderr, "flash access outside the region at 0x%x\n", addr);
+        return false;
+    }
+    *offset = addr - CONFIG_FLASH_BASE_ADDR;
+    return true;
+}
+
+
+bool spiflash_read(uint32_t addr, uint8_t *buf, uint32_t size){
+    uint32_t offset;
+
+    if (!flash_offset(addr, size, &offset)){
+        return false;
+    }
+    memcpy(buf, &flash[offset], size);
+    return true;
+}
+
+
+bool spiflash_write(uint32_t addr, uint8_t *buf, uint32_t size){
+    uint32_t offset, i;
+
+    if (flash_power_off || !flash_offset(addr, size, &offset)){
+        return false;
+    }
+    for (i = 0; i < size; i++){
+        if (flash_cut_after == 0){
+            flash_power_off = true;
+            return false;
+        }
+        if (flash_cut_after > 0){
+            flash_cut_after--;
+        }
+        flash[offset + i] &= buf[i];
+    }
+    flash_programmed += size;
+    flash_busy_us += ((offset + size - 1) / FLASH_PAGE_SIZE - offset / FLASH_PAGE_SIZE + 1) * FLASH_PAGE_PROGRAM_US;
+    return true;
+}
+
+
+bool spiflash_erase_sector(uint32_t addr){
+    uint32_t offset, i;
+
+    if (flash_power_off || !flash_offset(addr, CONFIG_SECTOR_SIZE, &offset)){
+        return false;
+    }
+    if (flash_cut_in_erase){
+        /* an interrupted erase leaves the sector anything but erased */
+        for (i = 0; i < CONFIG_SECTOR_SIZE; i++){
+            flash[offset + i] = rand();
+        }
+        flash_power_off = true;
+        return false;
+    }
+    memset(&flash[offset], 0xff, CONFIG_SECTOR_SIZE);
+    flash_erases[offset / CONFIG_SECTOR_SIZE]++;
+    flash_busy_us += FLASH_ERASE_US;
+    return true;
+}
+
+
+/* settings like those of the firmware */
+static homekit_characteristic_t aqi_standard = { .description = "AQI Standard", .value = { .format = homekit_format_uint8 } };
+static homekit_characteristic_t mq135_ro = { .description = "MQ135 Ro", .value = { .format = homekit_format_float } };
+static homekit_characteristic_t poll_min_period = { .description = "Poll Min Period", .value = { .format = homekit_format_uint16, .int_value = 1 } };
+static homekit_characteristic_t poll_max_period = { .description = "Poll Max Period", .value = { .format = homekit_format_uint16, .int_value = 60 } };
+static homekit_characteristic_t trace_mode = { .description = "Trace Mode", .value = { .format = homekit_format_uint8 } };
+static homekit_characteristic_t mq7_ro = { .description = "MQ7 Ro", .value = { .format = homekit_format_float } };
+static homekit_characteristic_t mq4_ro = { .description = "MQ4 Ro", .value = { .format = homekit_format_float } };
+
+static const config_entry_t settings[] = {
+    CONFIG_ENTRY(1, &aqi_standard),
+    CONFIG_ENTRY(2, &mq135_ro),
+    CONFIG_ENTRY(3, &poll_min_period),
+    CONFIG_ENTRY(4, &poll_max_period),
+    CONFIG_ENTRY(5, &trace_mode),
+    CONFIG_ENTRY(6, &mq7_ro),
+    CONFIG_ENTRY(7, &mq4_ro),
+};
+
+#define SETTING_COUNT   (sizeof(settings) / sizeof(settings[0]))
+
+
+typedef struct {
+    uint32_t changes;
+    uint32_t commits;
+    uint64_t busy_us_max;
+    double host_seconds;
+} bench_result_t;
+
+
+static void bench_reset(void){
+    memset(flash, 0xff, sizeof(flash));
+    memset(flash_erases, 0, sizeof(flash_erases));
+    flash_programmed = 0;
+    flash_busy_us = 0;
+    flash_cut_after = -1;
+    flash_cut_in_erase = false;
+    flash_power_off = false;
+    bench_now_ms = 0;
+    config_store_init(settings, SETTING_COUNT);
+}
+
+
+static void bench_commit(bench_result_t *result){
+    uint64_t busy_before = flash_busy_us;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    config_store_commit();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->host_seconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (flash_busy_us != busy_before){
+        result->commits++;
+        if (flash_busy_us - busy_before > result->busy_us_max){
+            result->busy_us_max = flash_busy_us - busy_before;
+        }
+    }
+}
+
+
+static void bench_set(homekit_characteristic_t *characteristic, bool debounced, bench_result_t *result){
+    config_store_set(characteristic);
+    result->changes++;
+    if (!debounced){
+        bench_commit(result);
+    }
+}
+
+
+/* the simulated device, the clock is stepped and each change made when it is due */
+static void bench_workload(uint32_t days, bool debounced, bench_result_t *result){
+    const uint32_t day_ms = 24UL * 60 * 60 * 1000;
+    uint32_t day, ms, step;
+
+    memset(result, 0, sizeof(*result));
+    bench_reset();
+    for (day = 0; day < days; day++){
+        for (ms = 0; ms < day_ms; ms += BENCH_STEP_MS){
+            bench_now_ms = day * day_ms + ms;
+
+            /* the poll period slider dragged from 1 to 12 s and back to 5 s */
+            step = ms / BENCH_STEP_MS - 9 * 60 * 60 * 1000 / BENCH_STEP_MS;
+            if (step < 18){
+                poll_min_period.value.int_value = step < 12 ? step + 1 : 17 - step;
+                bench_set(&poll_min_period, debounced, result);
+            }
+            /* the daily baseline step of each MQ sensor */
+            if (ms == 3 * 60 * 60 * 1000){
+                mq135_ro.value.float_value = 41000 + day * 7.5f;
+                bench_set(&mq135_ro, debounced, result);
+            }
+            if (ms == 3 * 60 * 60 * 1000 + 3000){
+                mq7_ro.value.float_value = 9000 + day * 2.5f;
+                bench_set(&mq7_ro, debounced, result);
+            }
+            if (ms == 3 * 60 * 60 * 1000 + 6000){
+                mq4_ro.value.float_value = 15000 - day * 3.0f;
+                bench_set(&mq4_ro, debounced, result);
+            }
+            /* a trace taken every third day */
+            if (day % 3 == 0 && (ms == 14 * 60 * 60 * 1000 || ms == 14 * 60 * 60 * 1000 + 10 * 60 * 1000)){
+                trace_mode.value.int_value = !trace_mode.value.int_value;
+                bench_set(&trace_mode, debounced, result);
+            }
+            /* the AQI standard tried and put back within seconds, which needs no write at all */
+            if (day % 7 == 0 && (ms == 20 * 60 * 60 * 1000 || ms == 20 * 60 * 60 * 1000 + 2000)){
+                aqi_standard.value.int_value = !aqi_standard.value.int_value;
+                bench_set(&aqi_standard, debounced, result);
+            }
+
+            if (debounced && config_store_due()){
+                bench_commit(result);
+            }
+        }
+    }
+    config_store_flush();
+}
+
+
+static void bench_report(const char *name, uint32_t days, const bench_result_t *result){
+    uint32_t sector, erases_min = UINT32_MAX, erases_max = 0, erases = 0;
+
+    for (sector = 0; sector < CONFIG_FLASH_SECTORS; sector++){
+        erases += flash_erases[sector];
+        erases_min = flash_erases[sector] < erases_min ? flash_erases[sector] : erases_min;
+        erases_max = flash_erases[sector] > erases_max ? flash_erases[sector] : erases_max;
+    }
+    printf("%-12s %u changes, %u commits, %u bytes, %u erases, %u to %u a sector, %.1f a sector a year\n",
+           name, result->changes, result->commits, flash_programmed, erases, erases_min, erases_max,
+           365.0 * erases_max / days);
+    printf("%-12s flash busy %.1f ms in all, %.1f ms worst commit, %.2f us host time a commit\n",
+           "", flash_busy_us / 1000.0, result->busy_us_max / 1000.0,
+           result->commits ? result->host_seconds * 1e6 / result->commits : 0.0);
+}
+
+
+static void settings_random(void){
+    aqi_standard.value.int_value = rand() % 2;
+    mq135_ro.value.float_value = 20000 + rand() % 40000;
+    poll_min_period.value.int_value = 1 + rand() % 30;
+    poll_max_period.value.int_value = 30 + rand() % 600;
+    trace_mode.value.int_value = rand() % 3;
+    mq7_ro.value.float_value = 5000 + rand() % 10000;
+    mq4_ro.value.float_value = 10000 + rand() % 10000;
+}
+
+
+static void settings_get(int32_t *values){
+    uint8_t i;
+
+    for (i = 0; i < SETTING_COUNT; i++){
+        values[i] = settings[i].characteristic->value.int_value;
+    }
+}
+
+
+static void settings_put(const int32_t *values){
+    uint8_t i;
+
+    for (i = 0; i < SETTING_COUNT; i++){
+        settings[i].characteristic->value.int_value = values[i];
+    }
+}
+
+
+/* cut the power in commits and check every restart loads one whole set of values */
+static uint32_t bench_power_cuts(uint32_t cuts){
+    int32_t old_values[SETTING_COUNT], new_values[SETTING_COUNT], loaded[SETTING_COUNT], zero[SETTING_COUNT] = { 0 };
+    uint32_t record_size = 12 + 8 * SETTING_COUNT, i, failures = 0, old_kept = 0, new_kept = 0;
+    int out = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+
+    /* the store logs every failed write and restart */
+    fflush(stdout);
+    dup2(null, STDOUT_FILENO);
+    bench_reset();
+    settings_random();
+    config_store_set(&aqi_standard);
+    config_store_commit();
+    settings_get(old_values);
+
+    for (i = 0; i < cuts; i++){
+        settings_random();
+        settings_get(new_values);
+        config_store_set(&aqi_standard);
+
+        /* about half of the commits are cut, at any byte of the record or its magic */
+        flash_cut_after = rand() % (2 * (record_size + 4));
+        flash_cut_in_erase = rand() % 8 == 0;
+        config_store_commit();
+        flash_cut_in_erase = false;
+        flash_cut_after = -1;
+        flash_power_off = false;
+
+        /* the restart, with the values in RAM lost */
+        settings_put(zero);
+        if (!config_store_init(settings, SETTING_COUNT)){
+            dprintf(out, "cut %u: nothing loaded\n", i);
+            failures++;
+            continue;
+        }
+        settings_get(loaded);
+        if (memcmp(loaded, old_values, sizeof(loaded)) == 0){
+            old_kept++;
+        } else if (memcmp(loaded, new_values, sizeof(loaded)) == 0){
+            new_kept++;
+            memcpy(old_values, new_values, sizeof(old_values));
+        } else {
+            dprintf(out, "cut %u: loaded a mix of old and new values\n", i);
+            failures++;
+            memcpy(old_values, loaded, sizeof(old_values));
+        }
+    }
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    close(null);
+    printf("%u power cuts, %u kept the old values, %u the new, %u failed\n", cuts, old_kept, new_kept, failures);
+    return failures;
+}
+
+
+int main(int argc, char **argv){
+    bench_result_t result;
+    uint32_t days = 365, cuts = 10000;
+    int option;
+
+    srand(1);
+    while ((option = getopt(argc, argv, "d:c:s:")) != -1){
+        switch (option){
+            case 'd': days = atoi(optarg); break;
+            case 'c': cuts = atoi(optarg); break;
+            case 's': srand(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-d days] [-c power cuts] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    printf("%u days, %u settings, %u sectors\n", days, (unsigned) SETTING_COUNT, CONFIG_FLASH_SECTORS);
+    bench_workload(days, false, &result);
+    bench_report("every change", days, &result);
+    bench_workload(days, true, &result);
+    bench_report("debounced", days, &result);
+
+    return bench_power_cuts(cuts) ? 1 : 0;
+}
@@ -0,0 +1,14 @@
+/* The esp-open-rtos flash calls, bound to the simulated flash of the bench.
+ */
+
+#ifndef __BENCH_SPIFLASH_H__
+#define __BENCH_SPIFLASH_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool spiflash_read(uint32_t addr, uint8_t *buf, uint32_t size);
+bool spiflash_write(uint32_t addr, uint8_t *buf, uint32_t size);
+bool spiflash_erase_sector(uint32_t addr);
+
+#endif
@@ -0,0 +1,14 @@
+/* Tasks for the config store bench, which runs single threaded and commits itself,
+ * so nothing is run from the deferred work task.
+ */
+
+#ifndef __BENCH_TASK_H__
+#define __BENCH_TASK_H__
+
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+#define portMAX_DELAY           0xffffffffUL
+
+#endif
@@ -0,0 +1,186 @@
+/* Feeds synthesized replies to dht22_decode, as the capture in dht22_esp8266.c
+ * timestamps them, and checks the readings and the status of every kind of bad
+ * reply.
+ *
+ *     dht22_test
+ *
+ * The timestamps are in cpu cycles at 80 MHz and start just before the counter
+ * wraps. Bit periods are varied within the margins of the decoder. The exit status
+ * is 0 when every check passes, a failed check aborts.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "dht22.h"
+
+#define TICKS_PER_US            80
+#define ACK_US                  160
+#define ZERO_US                 76      /* 50 us low and 26 us high */
+#define ONE_US                  120     /* 50 us low and 70 us high */
+
+
+typedef struct {
+    uint32_t edge[DHT22_EDGES + 2];
+    uint8_t count;
+} reply_t;
+
+
+/* the falling edges of a reply of the five bytes, each bit period moved by jitter_us
+   one way or the other */
+static void reply_build(reply_t *reply, const uint8_t data[5], int jitter_us){
+    uint32_t time = 0xffffffffUL - 2000 * TICKS_PER_US;
+    uint8_t bit;
+    int period;
+
+    reply->edge[0] = time;
+    time += ACK_US * TICKS_PER_US;
+    reply->edge[1] = time;
+    for (bit = 0; bit < DHT22_BITS; bit++){
+        period = data[bit / 8] & 0x80 >> bit % 8 ? ONE_US : ZERO_US;
+        period += bit & 1 ? jitter_us : -jitter_us;
+        time += period * TICKS_PER_US;
+        reply->edge[bit + 2] = time;
+    }
+    reply->count = DHT22_EDGES;
+}
+
+
+/* a reply of humidity and temperature in tenths, with its checksum */
+static void reply_of(reply_t *reply, uint16_t humidity, int16_t temperature, int jitter_us){
+    uint16_t raw = temperature < 0 ? 0x8000 | -temperature : temperature;
+    uint8_t data[5] = { humidity >> 8, humidity, raw >> 8, raw };
+
+    data[4] = data[0] + data[1] + data[2] + data[3];
+    reply_build(reply, data, jitter_us);
+}
+
+
+static dht22_status_t decode(const reply_t *reply, float *temperature, float *humidity){
+    return dht22_decode(reply->edge, reply->count, TICKS_PER_US, temperature, humidity);
+}
+
+
+static void check_good(void){
+    static const struct { uint16_t humidity; int16_t temperature; } frames[] = {
+        { 652, 235 }, { 0, 0 }, { 1000, 800 }, { 999, -400 }, { 411, -1 }, { 255, 256 },
+    };
+    float temperature, humidity;
+    reply_t reply;
+    unsigned i;
+    int jitter;
+
+    for (i = 0; i < sizeof(frames) / sizeof(frames[0]); i++){
+        for (jitter = -15; jitter <= 15; jitter += 5){
+            reply_of(&reply, frames[i].humidity, frames[i].temperature, jitter);
+            temperature = humidity = NAN;
+            assert(decode(&reply, &temperature, &humidity) == DHT22_OK);
+            assert(fabsf(humidity - frames[i].humidity / 10.0f) < 1e-4);
+            assert(fabsf(temperature - frames[i].temperature / 10.0f) < 1e-4);
+        }
+    }
+
+    /* edges captured after the reply are ignored */
+    reply_of(&reply, 652, 235, 0);
+    reply.edge[DHT22_EDGES] = reply.edge[DHT22_EDGES - 1] + 50 * TICKS_PER_US;
+    reply.count = DHT22_EDGES + 1;
+    assert(decode(&reply, &temperature, &humidity) == DHT22_OK);
+    printf("%s: ok\n", __func__);
+}
+
+
+static void check_bad_checksum(void){
+    uint8_t data[5] = { 0x02, 0x8c, 0x00, 0xeb, 0x79 };
+    float temperature = 1, humidity = 2;
+    reply_t reply;
+    uint8_t bit;
+
+    reply_build(&reply, data, 0);
+    assert(decode(&reply, &temperature, &humidity) == DHT22_OK);
+
+    /* any single flipped bit, in the data or the checksum */
+    for (bit = 0; bit < DHT22_BITS; bit++){
+        data[bit / 8] ^= 0x80 >> bit % 8;
+        reply_build(&reply, data, 0);
+        temperature = 1;
+        humidity = 2;
+        assert(decode(&reply, &temperature, &humidity) == DHT22_BAD_CHECKSUM);
+        assert(temperature == 1 && humidity == 2);
+        data[bit / 8] ^= 0x80 >> bit % 8;
+    }
+    printf("%s: ok\n", __func__);
+}
+
+
+static void check_missing_edge(void){
+    float temperature, humidity;
+    reply_t reply;
+    uint8_t missing;
+
+    /* an edge lost from anywhere leaves one too few */
+    for (missing = 0; missing < DHT22_EDGES; missing++){
+        reply_of(&reply, 652, 235, 0);
+        memmove(&reply.edge[missing], &reply.edge[missing + 1], (DHT22_EDGES - missing - 1) * sizeof(uint32_t));
+        reply.count = DHT22_EDGES - 1;
+        assert(decode(&reply, &temperature, &humidity) == DHT22_TIMEOUT);
+    }
+
+    /* with a glitch at the end making up the count, the merged bits are too long */
+    reply_of(&reply, 0xffff, 0x7fff, 0);
+    memmove(&reply.edge[10], &reply.edge[11], (DHT22_EDGES - 11) * sizeof(uint32_t));
+    reply.edge[DHT22_EDGES - 1] = reply.edge[DHT22_EDGES - 2] + 2 * TICKS_PER_US;
+    assert(decode(&reply, &temperature, &humidity) == DHT22_BAD_TIMING);
+
+    /* and a lost acknowledgement edge makes the first bit the acknowledgement */
+    reply_of(&reply, 652, 235, 0);
+    memmove(&reply.edge[1], &reply.edge[2], (DHT22_EDGES - 2) * sizeof(uint32_t));
+    reply.edge[DHT22_EDGES - 1] = reply.edge[DHT22_EDGES - 2] + ZERO_US * TICKS_PER_US;
+    assert(decode(&reply, &temperature, &humidity) == DHT22_NO_RESPONSE);
+    printf("%s: ok\n", __func__);
+}
+
+
+static void check_timeout(void){
+    float temperature, humidity;
+    reply_t reply;
+    uint8_t count;
+
+    /* no reply at all, or one cut off at DHT22_CAPTURE_MS */
+    for (count = 0; count < DHT22_EDGES; count++){
+        reply_of(&reply, 652, 235, 0);
+        reply.count = count;
+        assert(decode(&reply, &temperature, &humidity) == DHT22_TIMEOUT);
+    }
+    printf("%s: ok\n", __func__);
+}
+
+
+static void check_timing(void){
+    float temperature, humidity;
+    reply_t reply;
+
+    /* the acknowledgement and the bits just outside their limits */
+    reply_of(&reply, 652, 235, 0);
+    reply.edge[0] = reply.edge[1] - (DHT22_RESPONSE_MIN_US - 1) * TICKS_PER_US;
+    assert(decode(&reply, &temperature, &humidity) == DHT22_NO_RESPONSE);
+    reply.edge[0] = reply.edge[1] - (DHT22_RESPONSE_MAX_US + 1) * TICKS_PER_US;
+    assert(decode(&reply, &temperature, &humidity) == DHT22_NO_RESPONSE);
+
+    reply_of(&reply, 652, 235, 35);
+    assert(decode(&reply, &temperature, &humidity) == DHT22_BAD_TIMING);
+    reply_of(&reply, 0xffff, 0x7fff, -45);
+    assert(decode(&reply, &temperature, &humidity) == DHT22_BAD_TIMING);
+    printf("%s: ok\n", __func__);
+}
+
+
+int main(void){
+    check_good();
+    check_bad_checksum();
+    check_missing_edge();
+    check_timeout();
+    check_timing();
+    return 0;
+}
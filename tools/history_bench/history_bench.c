@@ -0,0 +1,266 @@
+/* Runs the history store on a simulated flash, to measure how densely it encodes a
+ * day of readings and how fast records are appended and streamed back.
+ *
+ *     history_bench [-d days] [-s seed]
+ *
+ * The workload is a record a minute as history_job makes them: temperature and
+ * humidity following the day with a little noise, the DHT22 failing now and then,
+ * Rs and the gases on a noisy baseline with a ten minute event every few hours.
+ * Pages are written as soon as the store hands them over, flash time is from
+ * typical SPI NOR figures and the host time is that of the store itself. Once the
+ * region has wrapped, the records streamed back must be exactly the newest ones
+ * appended. The exit status is 0 when they are.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "history_store.h"
+#include "sensor_hal.h"
+#include "deferred_work.h"
+
+#define FLASH_ERASE_US          45000       /* 4 KB sector */
+#define FLASH_PAGE_PROGRAM_US   700         /* up to 256 bytes within a page */
+#define MINUTE_MS               60000
+#define DAY_MINUTES             (24 * 60)
+
+
+/* the flash region of the history, NOR so programming can only clear bits */
+static uint8_t flash[HISTORY_FLASH_SECTORS * HISTORY_SECTOR_SIZE];
+static uint32_t flash_erases;
+static uint32_t flash_pages;
+static uint64_t flash_busy_us;
+
+static uint32_t bench_now_ms;
+
+
+static uint32_t bench_now(void){
+    return bench_now_ms;
+}
+
+static const sensor_hal_t bench_hal = {
+    .now_ms = bench_now,
+};
+
+const sensor_hal_t *sensor_hal = &bench_hal;
+
+
+bool deferred_work_add(deferred_work_t *work){
+    return true;
+}
+
+/* the writer runs as soon as a page is handed over, as the idle deferred work task would */
+void deferred_work_request(deferred_work_t *work){
+    work->run();
+}
+
+void vTaskDelay(TickType_t ticks){
+}
+
+
+static bool flash_offset(uint32_t addr, uint32_t size, uint32_t *offset){
+    if (addr < HISTORY_FLASH_BASE_ADDR || addr + size > HISTORY_FLASH_BASE_ADDR + sizeof(flash)){
+        fprintf(stderr, "flash access outside the region at 0x%x\n", addr);
+        return false;
+    }
+    *offset = addr - HISTORY_FLASH_BASE_ADDR;
+    return true;
+}
+
+
+bool spiflash_read(uint32_t addr, uint8_t *buf, uint32_t size){
+    uint32_t offset;
+
+    if (!flash_offset(addr, size, &offset)){
+        return false;
+    }
+    memcpy(buf, &flash[offset], size);
+    return true;
+}
+
+
+bool spiflash_write(uint32_t addr, uint8_t *buf, uint32_t size){
+    uint32_t offset, i;
+
+    if (!flash_offset(addr, size, &offset)){
+        return false;
+    }
+    for (i = 0; i < size; i++){
+        flash[offset + i] &= buf[i];
+    }
+    if (size == HISTORY_PAGE_SIZE){
+        flash_pages++;
+    }
+    flash_busy_us += FLASH_PAGE_PROGRAM_US;
+    return true;
+}
+
+
+bool spiflash_erase_sector(uint32_t addr){
+    uint32_t offset;
+
+    if (!flash_offset(addr, HISTORY_SECTOR_SIZE, &offset)){
+        return false;
+    }
+    memset(&flash[offset], 0xff, HISTORY_SECTOR_SIZE);
+    flash_erases++;
+    flash_busy_us += FLASH_ERASE_US;
+    return true;
+}
+
+
+static uint32_t bench_seed = 1;
+
+/* roughly normal with a standard deviation of sigma */
+static float bench_noise(float sigma){
+    float sum = 0;
+    int i;
+
+    for (i = 0; i < 12; i++){
+        bench_seed = bench_seed * 1103515245 + 12345;
+        sum += (bench_seed >> 8 & 0xffff) / 65536.0f;
+    }
+    return (sum - 6) * sigma;
+}
+
+
+/* a ten minute event every four hours, rising for two minutes and decaying over eight */
+static float bench_event(uint32_t minute){
+    float minutes = minute % 240 - 100.0f;
+
+    if (minutes < 0 || minutes > 10){
+        return 1;
+    }
+    return 1 + 4 * (minutes < 2 ? minutes / 2 : expf(-(minutes - 2) / 3));
+}
+
+
+/* the record history_job would append at a minute of the run */
+static void bench_record(uint32_t minute, history_record_t *record){
+    static const float gas_baseline[5] = { 2.0, 1.5, 20.0, 3.0, 4.0 };
+    static const history_field_t gas_field[5] = { HISTORY_LPG, HISTORY_CO, HISTORY_PM10, HISTORY_CH4, HISTORY_NH4 };
+    float day = 2 * M_PI * (minute % DAY_MINUTES) / DAY_MINUTES, event = bench_event(minute);
+    bool dht_valid = (bench_seed >> 8) % 500 != 0;
+    int gas;
+
+    memset(record, 0, sizeof(*record));
+    record->value[HISTORY_TEMPERATURE] = dht_valid ? lroundf((21 - 3 * cosf(day) + bench_noise(0.05)) * 10) : HISTORY_NO_VALUE;
+    record->value[HISTORY_HUMIDITY] = dht_valid ? lroundf((45 + 8 * cosf(day) + bench_noise(0.3)) * 10) : HISTORY_NO_VALUE;
+    record->value[HISTORY_RS] = lroundf(40000 / powf(event, 0.7f) * (1 + bench_noise(0.005)));
+    for (gas = 0; gas < 5; gas++){
+        record->value[gas_field[gas]] = lroundf(gas_baseline[gas] * event * (1 + bench_noise(0.03)) * 10);
+    }
+}
+
+
+static double bench_seconds(const struct timespec *start){
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+static bool bench_count_record(const history_record_t *record, void *context){
+    return true;
+}
+
+
+/* the records streamed back, checked against those appended */
+typedef struct {
+    const history_record_t *expected;
+    uint32_t next;
+    uint32_t count;
+    uint32_t mismatches;
+} bench_check_t;
+
+static bool bench_check_record(const history_record_t *record, void *context){
+    bench_check_t *check = context;
+
+    if (check->next >= check->count || memcmp(record, &check->expected[check->next], sizeof(*record)) != 0){
+        if (check->mismatches++ < 5){
+            fprintf(stderr, "record %u at time %u differs from the one appended\n", check->next, record->time);
+        }
+    }
+    check->next++;
+    return true;
+}
+
+
+int main(int argc, char **argv){
+    history_record_t *appended, record;
+    bench_check_t check;
+    struct timespec start;
+    uint32_t days = 30, records, minute, first, streamed;
+    double append_seconds, stream_seconds;
+    int option, out, null;
+
+    while ((option = getopt(argc, argv, "d:s:")) != -1){
+        switch (option){
+            case 'd': days = atoi(optarg); break;
+            case 's': bench_seed = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-d days] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (days == 0){
+        days = 1;
+    }
+    records = days * DAY_MINUTES;
+    appended = malloc(records * sizeof(history_record_t));
+    if (appended == NULL){
+        return 2;
+    }
+
+    /* the store logs its start */
+    memset(flash, 0xff, sizeof(flash));
+    out = dup(STDOUT_FILENO);
+    null = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(null, STDOUT_FILENO);
+    history_init();
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    close(null);
+
+    /* the records are made up front so only the store is timed */
+    for (minute = 0; minute < records; minute++){
+        bench_record(minute, &appended[minute]);
+        appended[minute].time = 1 + minute * (MINUTE_MS / 1000);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (minute = 0; minute < records; minute++){
+        bench_now_ms = minute * MINUTE_MS;
+        record = appended[minute];
+        history_append(&record);
+    }
+    history_flush();
+    append_seconds = bench_seconds(&start);
+
+    /* the region holds the newest pages */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    streamed = history_stream(0, UINT32_MAX, bench_count_record, NULL);
+    stream_seconds = bench_seconds(&start);
+    first = records - streamed;
+    check = (bench_check_t) { .expected = &appended[first], .count = streamed };
+    history_stream(0, UINT32_MAX, bench_check_record, &check);
+
+    printf("%u days, %u records of %u bytes, %u sectors of %u pages\n", days, records, (unsigned) sizeof(history_record_t),
+           HISTORY_FLASH_SECTORS, HISTORY_PAGES_PER_SECTOR);
+    printf("flash        %u pages, %u erases, %.1f bytes a record, %.1f records a page, %.1f days in the region\n",
+           flash_pages, flash_erases, (double) HISTORY_PAGE_SIZE * flash_pages / records, (double) records / flash_pages,
+           (double) HISTORY_PAGE_COUNT * records / flash_pages / DAY_MINUTES);
+    printf("append       %.0f records/s on the host, %.1f us of flash time a record on the device\n",
+           records / append_seconds, (double) flash_busy_us / records);
+    printf("stream       %u records in %.2f ms, %.0f records/s\n", streamed, stream_seconds * 1000, streamed / stream_seconds);
+    printf("check        %u records streamed back, %u differ from those appended\n", streamed, check.mismatches);
+
+    free(appended);
+    return check.mismatches || streamed == 0 ? 1 : 0;
+}
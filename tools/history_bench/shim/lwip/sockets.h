@@ -0,0 +1,11 @@
+/* The lwip socket calls of the history export are those of the host.
+ */
+
+#ifndef __BENCH_LWIP_SOCKETS_H__
+#define __BENCH_LWIP_SOCKETS_H__
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#endif
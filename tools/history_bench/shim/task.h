@@ -0,0 +1,16 @@
+/* Tasks for the history bench, which runs single threaded. A delay of the export
+ * returns at once.
+ */
+
+#ifndef __BENCH_TASK_H__
+#define __BENCH_TASK_H__
+
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+#define portMAX_DELAY           0xffffffffUL
+
+void vTaskDelay(TickType_t ticks);
+
+#endif
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Receive a history export of the sensor and write it out as CSV.
+
+Start this, then set History Export to the hours wanted in the Home app or
+any HomeKit client. It stops at the end of the export.
+
+    tools/history_dump.py [history.csv] [--port 45682]
+"""
+
+import argparse
+import socket
+import struct
+import sys
+
+MAGIC = 0x54534948
+VERSION = 1
+HEADER = struct.Struct("<IHHI")
+RECORD = struct.Struct("<I8i")
+NO_VALUE = -(1 << 31)
+# history_field_t in src/history_store.h, with the scale of each field
+FIELDS = (("temperature", 10), ("humidity", 10), ("rs", 1), ("co", 10),
+          ("lpg", 10), ("pm10", 10), ("ch4", 10), ("nh4", 10))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", nargs="?")
+    parser.add_argument("--port", type=int, default=45682)
+    options = parser.parse_args()
+
+    listener = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("", options.port))
+    output = open(options.output, "w") if options.output else sys.stdout
+    output.write("time," + ",".join(name for name, scale in FIELDS) + "\n")
+    expected = 0
+    records = 0
+    while True:
+        packet, sender = listener.recvfrom(2048)
+        if len(packet) < HEADER.size:
+            continue
+        magic, version, count, sequence = HEADER.unpack_from(packet)
+        if magic != MAGIC or version != VERSION:
+            continue
+        if sequence != expected:
+            sys.stderr.write("%d packets lost before packet %d\n" % (sequence - expected, sequence))
+        expected = sequence + 1
+        if count == 0:
+            break
+        for i in range(count):
+            fields = RECORD.unpack_from(packet, HEADER.size + i * RECORD.size)
+            values = ["" if value == NO_VALUE else "%g" % (value / scale)
+                      for value, (name, scale) in zip(fields[1:], FIELDS)]
+            output.write("%d,%s\n" % (fields[0], ",".join(values)))
+        records += count
+    output.flush()
+    sys.stderr.write("%d records\n" % records)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,314 @@
+/* Runs the notify filters on a simulated day of sensor cycles against a stand-in
+ * for the esp-homekit server, to count the encrypted frames and bytes the clients
+ * are sent when the events of a commit go out together and when each goes out on
+ * its own.
+ *
+ *     notify_bench [-d days] [-s seed]
+ *
+ * The workload follows the jobs in main.c: temperature and humidity every 10 s,
+ * the gases, air quality and AQI index every 3 s with their hour and day
+ * statistics once a minute, and the perf characteristics once a minute, each with
+ * the notify policy main.c and gas_table.c give it. The gases sit on a noisy
+ * baseline with a ten minute event every hour.
+ *
+ * The stand-in queues every notify for each subscribed client. Batched, the server
+ * drains the queues after each commit, which is what the sensor task running above
+ * the server gives; per value, it drains after every notify, as it would if it
+ * could preempt the sensor task. Each drain sends one event message for each
+ * client holding every queued event, an EVENT/1.0 header and a HAP JSON body,
+ * encrypted in frames of up to 1024 bytes with a 2 byte length and 16 byte tag.
+ * The server also drains when the sensor task sleeps, after an early commit of a
+ * full batch. The exit status is 0 when the server never found more than
+ * NOTIFY_BATCH_SIZE events queued for a client.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <task.h>
+#include "notify_filter.h"
+#include "sensor_hal.h"
+
+#define BENCH_STEP_MS           1000
+#define FRAME_SIZE              1024
+#define FRAME_OVERHEAD          (2 + 16)
+#define EVENT_HEADER            "EVENT/1.0 200 OK\r\nContent-Type: application/hap+json\r\nContent-Length: %u\r\n\r\n"
+#define MAX_QUEUED              64
+
+#define HOUR_MS                 (60UL * 60 * 1000)
+#define DAY_MS                  (24 * HOUR_MS)
+
+
+enum {
+    V_TEMPERATURE, V_HUMIDITY,
+    V_LPG, V_CO, V_PM10, V_CH4, V_NH4, V_AIR_QUALITY, V_AQI,
+    V_STATS,                                        /* hour and day min, average and max of each gas */
+    V_CO_TWA = V_STATS + 30,
+    V_HEAP, V_STACK, V_KCYCLES,
+    V_COUNT
+};
+
+
+static const notify_policy_t gas_policy[5] = {
+    { .abs_deadband = 1.0, .rel_deadband = 0.1, .min_interval_ms = 30000, .max_silence_ms = 30 * 60 * 1000 },
+    { .abs_deadband = 1.0, .rel_deadband = 0.05, .min_interval_ms = 6000, .max_silence_ms = 15 * 60 * 1000 },
+    { .abs_deadband = 5.0, .rel_deadband = 0.05, .min_interval_ms = 6000, .max_silence_ms = 15 * 60 * 1000 },
+    { .abs_deadband = 1.0, .rel_deadband = 0.1, .min_interval_ms = 30000, .max_silence_ms = 30 * 60 * 1000 },
+    { .abs_deadband = 1.0, .rel_deadband = 0.1, .min_interval_ms = 30000, .max_silence_ms = 30 * 60 * 1000 },
+};
+static const notify_policy_t temperature_policy = { .abs_deadband = 0.2, .max_silence_ms = 15 * 60 * 1000 };
+static const notify_policy_t humidity_policy = { .abs_deadband = 1.0, .max_silence_ms = 15 * 60 * 1000 };
+static const notify_policy_t air_quality_policy = { .abs_deadband = 1, .max_silence_ms = 15 * 60 * 1000 };
+static const notify_policy_t aqi_policy = { .abs_deadband = 5, .rel_deadband = 0.05, .min_interval_ms = 6000, .max_silence_ms = 15 * 60 * 1000 };
+static const notify_policy_t stat_policy = { .abs_deadband = 0.5, .rel_deadband = 0.02, .min_interval_ms = 60000, .max_silence_ms = 60 * 60 * 1000 };
+static const notify_policy_t perf_policy = { .min_interval_ms = 0 };
+static const float gas_baseline[5] = { 2.0, 1.5, 20.0, 3.0, 4.0 };
+
+static homekit_characteristic_t characteristic[V_COUNT];
+static notify_filter_t filter[V_COUNT];
+
+static uint32_t bench_now_ms;
+static bool bench_per_value;
+static homekit_characteristic_t *queued[MAX_QUEUED];
+static uint8_t queued_count;
+static uint8_t queued_max;
+static uint32_t bench_frames;
+static uint64_t bench_bytes;
+static uint32_t bench_messages;
+
+
+static uint32_t bench_now(void){
+    return bench_now_ms;
+}
+
+static const sensor_hal_t bench_hal = {
+    .now_ms = bench_now,
+};
+
+const sensor_hal_t *sensor_hal = &bench_hal;
+
+
+/* one event message with every queued event, as each subscribed client is sent it */
+static void server_drain(void){
+    char body[MAX_QUEUED * 48 + 32], header[128];
+    uint32_t length = 0, size, frames;
+    homekit_value_t *value;
+    uint8_t i;
+
+    if (queued_count == 0){
+        return;
+    }
+    length += sprintf(body, "{\"characteristics\":[");
+    for (i = 0; i < queued_count; i++){
+        value = &queued[i]->value;
+        length += sprintf(&body[length], "%s{\"aid\":1,\"iid\":%d,", i ? "," : "", (int) (queued[i] - characteristic) + 8);
+        if (value->format == homekit_format_float){
+            length += sprintf(&body[length], "\"value\":%g}", value->float_value);
+        } else {
+            length += sprintf(&body[length], "\"value\":%d}", value->int_value);
+        }
+    }
+    length += sprintf(&body[length], "]}");
+    size = sprintf(header, EVENT_HEADER, length) + length;
+    frames = (size + FRAME_SIZE - 1) / FRAME_SIZE;
+
+    bench_messages++;
+    bench_frames += frames;
+    bench_bytes += size + frames * FRAME_OVERHEAD;
+    if (queued_count > queued_max){
+        queued_max = queued_count;
+    }
+    queued_count = 0;
+}
+
+
+/* the sensor task sleeping, which lets the server run */
+void vTaskDelay(TickType_t ticks){
+    server_drain();
+}
+
+
+void homekit_characteristic_notify(homekit_characteristic_t *notified, homekit_value_t value){
+    if (queued_count == MAX_QUEUED){
+        server_drain();
+    }
+    queued[queued_count++] = notified;
+    if (bench_per_value){
+        server_drain();
+    }
+}
+
+
+static uint32_t bench_seed;
+
+static float bench_noise(void){
+    /* roughly normal, from the sum of uniform values */
+    float sum = 0;
+    int i;
+
+    for (i = 0; i < 4; i++){
+        bench_seed = bench_seed * 1103515245 + 12345;
+        sum += (bench_seed >> 8 & 0xffff) / 65536.0f - 0.5f;
+    }
+    return sum;
+}
+
+
+/* a ten minute event every hour, rising for two minutes and decaying over eight */
+static float bench_event(uint32_t now){
+    float minutes = (now % HOUR_MS) / 60000.0f - 20;
+
+    if (minutes < 0 || minutes > 10){
+        return 1;
+    }
+    return 1 + 4 * (minutes < 2 ? minutes / 2 : expf(-(minutes - 2) / 3));
+}
+
+
+static void bench_setup(void){
+    int i;
+
+    for (i = 0; i < V_COUNT; i++){
+        characteristic[i].description = "bench";
+        characteristic[i].value.format = homekit_format_float;
+        filter[i] = (notify_filter_t) { .characteristic = &characteristic[i], .policy = &stat_policy };
+    }
+    filter[V_TEMPERATURE].policy = &temperature_policy;
+    filter[V_HUMIDITY].policy = &humidity_policy;
+    for (i = 0; i < 5; i++){
+        filter[V_LPG + i].policy = &gas_policy[i];
+    }
+    filter[V_AIR_QUALITY].policy = &air_quality_policy;
+    filter[V_AQI].policy = &aqi_policy;
+    filter[V_HEAP].policy = filter[V_STACK].policy = filter[V_KCYCLES].policy = &perf_policy;
+}
+
+
+static homekit_value_t bench_float(float value){
+    return (homekit_value_t) { .format = homekit_format_float, .float_value = value };
+}
+
+static homekit_value_t bench_int(int value){
+    return (homekit_value_t) { .format = homekit_format_uint32, .int_value = value };
+}
+
+
+static void bench_run(uint32_t days, uint32_t seed, bool per_value, uint32_t *notifies, uint32_t *commits){
+    float ppm[5], hour_average[5] = { 0 }, day_average[5] = { 0 }, aqi, phase;
+    float hour_min[5] = { 0 }, hour_max[5] = { 0 }, day_min[5] = { 0 }, day_max[5] = { 0 };
+    uint32_t sent, suppressed, batches, sent_start, batches_start, heap = 30000;
+    int gas, level;
+
+    bench_setup();
+    bench_seed = seed;
+    bench_per_value = per_value;
+    bench_frames = bench_messages = 0;
+    bench_bytes = 0;
+    queued_max = 0;
+    notify_filter_totals(&sent_start, &suppressed, &batches_start);
+
+    for (bench_now_ms = 0; bench_now_ms < days * DAY_MS; bench_now_ms += BENCH_STEP_MS){
+        phase = 2 * M_PI * (bench_now_ms % DAY_MS) / DAY_MS;
+
+        if (bench_now_ms % 10000 == 0){
+            notify_filter_stage(&filter[V_TEMPERATURE], bench_float(21 + 2 * sinf(phase) + 0.05f * bench_noise()));
+            notify_filter_stage(&filter[V_HUMIDITY], bench_float(45 + 5 * cosf(phase) + 0.3f * bench_noise()));
+            notify_filter_commit();
+            server_drain();
+        }
+
+        if (bench_now_ms % 3000 == 0){
+            for (gas = 0; gas < 5; gas++){
+                ppm[gas] = gas_baseline[gas] * bench_event(bench_now_ms) * (1 + 0.03f * bench_noise());
+                hour_average[gas] += (ppm[gas] - hour_average[gas]) / 1200;
+                day_average[gas] += (ppm[gas] - day_average[gas]) / 28800;
+                if (bench_now_ms % HOUR_MS == 0 || ppm[gas] < hour_min[gas]){
+                    hour_min[gas] = ppm[gas];
+                }
+                if (bench_now_ms % HOUR_MS == 0 || ppm[gas] > hour_max[gas]){
+                    hour_max[gas] = ppm[gas];
+                }
+                if (bench_now_ms % DAY_MS == 0 || ppm[gas] < day_min[gas]){
+                    day_min[gas] = ppm[gas];
+                }
+                if (bench_now_ms % DAY_MS == 0 || ppm[gas] > day_max[gas]){
+                    day_max[gas] = ppm[gas];
+                }
+                notify_filter_stage(&filter[V_LPG + gas], bench_float(ppm[gas]));
+            }
+            aqi = ppm[1] * 11.4f;
+            level = 1 + (aqi > 50) + (aqi > 100) + (aqi > 150) + (aqi > 200);
+            notify_filter_stage(&filter[V_AIR_QUALITY], bench_int(level));
+            notify_filter_stage(&filter[V_AQI], bench_float(aqi));
+            if (bench_now_ms % 60000 == 0){
+                /* the statistics are due, they go in the same commit */
+                for (gas = 0; gas < 5; gas++){
+                    notify_filter_stage(&filter[V_STATS + gas * 6], bench_float(hour_min[gas]));
+                    notify_filter_stage(&filter[V_STATS + gas * 6 + 1], bench_float(hour_average[gas]));
+                    notify_filter_stage(&filter[V_STATS + gas * 6 + 2], bench_float(hour_max[gas]));
+                    notify_filter_stage(&filter[V_STATS + gas * 6 + 3], bench_float(day_min[gas]));
+                    notify_filter_stage(&filter[V_STATS + gas * 6 + 4], bench_float(day_average[gas]));
+                    notify_filter_stage(&filter[V_STATS + gas * 6 + 5], bench_float(day_max[gas]));
+                }
+                notify_filter_stage(&filter[V_CO_TWA], bench_float(hour_average[1]));
+            }
+            notify_filter_commit();
+            server_drain();
+        }
+
+        if (bench_now_ms % 60000 == 0){
+            heap -= bench_seed % 7 == 0 ? 8 : 0;
+            notify_filter_stage(&filter[V_HEAP], bench_int(heap));
+            notify_filter_stage(&filter[V_STACK], bench_int(112));
+            notify_filter_stage(&filter[V_KCYCLES], bench_int(840));
+            notify_filter_commit();
+            server_drain();
+        }
+    }
+    notify_filter_totals(&sent, &suppressed, &batches);
+    *notifies = sent - sent_start;
+    *commits = batches - batches_start;
+}
+
+
+int main(int argc, char **argv){
+    uint32_t days = 1, seed = 1, notifies, commits, batched_frames, batched_messages;
+    uint64_t batched_bytes;
+    static const uint8_t clients[] = { 1, 4, 16 };
+    uint8_t batched_max;
+    unsigned i;
+    int option;
+
+    while ((option = getopt(argc, argv, "d:s:")) != -1){
+        switch (option){
+            case 'd':
+                days = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d days] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    bench_run(days, seed, false, &notifies, &commits);
+    batched_frames = bench_frames;
+    batched_messages = bench_messages;
+    batched_bytes = bench_bytes;
+    batched_max = queued_max;
+    bench_run(days, seed, true, &notifies, &commits);
+
+    printf("%u days, %u notifies in %u commits, at most %u events queued for a client (batch size %u)\n",
+        days, notifies, commits, batched_max, NOTIFY_BATCH_SIZE);
+    printf("clients   batched messages  frames    kbytes   per value messages  frames    kbytes\n");
+    for (i = 0; i < sizeof(clients); i++){
+        printf("%7u   %16u %7u %9.1f   %18u %7u %9.1f\n", clients[i],
+            batched_messages * clients[i], batched_frames * clients[i], batched_bytes * clients[i] / 1024.0,
+            bench_messages * clients[i], bench_frames * clients[i], bench_bytes * clients[i] / 1024.0);
+    }
+    return batched_max <= NOTIFY_BATCH_SIZE ? 0 : 1;
+}
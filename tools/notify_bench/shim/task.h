@@ -0,0 +1,12 @@
+/* Tasks for the notify bench, a delay of the sensor task is where the stand-in
+ * server runs and drains its queues.
+ */
+
+#ifndef __BENCH_TASK_H__
+#define __BENCH_TASK_H__
+
+#include "FreeRTOS.h"
+
+void vTaskDelay(TickType_t ticks);
+
+#endif
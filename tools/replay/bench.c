@@ -0,0 +1,220 @@
+/* Times each stage of the sensor hot path on the host, from the same sources as the
+ * firmware, fed by a simulated ADC and DHT22.
+ *
+ *     bench [-n calls] [-s seed]
+ *
+ * The ADC is a noisy level that drifts slowly, sampled by the adc sampler as its
+ * timer would. Delays of the sensor code advance the simulated clock and take the
+ * samples that fall within them, so MQCalibration returns as soon as its window is
+ * full. Each stage is called the given number of times and the mean time of a call
+ * is printed, with the value the last call returned so the work is not optimised
+ * away. Build it as bench-fixed to time the MQ135_FIXED_POINT pipeline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "FreeRTOS.h"
+#include "timers.h"
+#include "sensor_hal.h"
+#include "sensor_trace.h"
+#include "esp8266_mq135.h"
+#include "mq_channels.h"
+#include "gas_table.h"
+#include "adc_sampler.h"
+#include "env_snapshot.h"
+#include "air_quality_index.h"
+#include "binlog.h"
+#include "burst_capture.h"
+
+
+static uint32_t bench_now_ms;
+static uint32_t bench_seed = 1;
+static float bench_level = 300;
+static uint32_t bench_period_ms = ADC_SAMPLE_PERIOD_MS;
+static TimerCallbackFunction_t bench_sampler;
+
+
+static float bench_noise(void){
+    bench_seed = bench_seed * 1103515245 + 12345;
+    return (bench_seed >> 8 & 0xffff) / 65536.0f - 0.5f;
+}
+
+
+/* everything the sensor sources need from outside, bound to the simulation */
+
+static uint16_t bench_adc_read(uint8_t channel){
+    bench_level += 0.05f * bench_noise();
+    return bench_level + 6 * bench_noise();
+}
+
+static void bench_adc_select(uint8_t channel){
+}
+
+static void bench_delay_ms(uint32_t ms){
+    uint32_t end = bench_now_ms + ms;
+
+    while ((int32_t) (end - bench_now_ms) >= (int32_t) bench_period_ms){
+        bench_now_ms += bench_period_ms;
+        bench_sampler(NULL);
+    }
+    bench_now_ms = end;
+}
+
+static uint32_t bench_now(void){
+    return bench_now_ms;
+}
+
+static uint32_t bench_now_us(void){
+    return bench_now_ms * 1000;
+}
+
+static uint32_t bench_cycles(void){
+    return 0;
+}
+
+static const sensor_hal_t bench_hal = {
+    .adc_read = bench_adc_read,
+    .adc_select = bench_adc_select,
+    .delay_ms = bench_delay_ms,
+    .now_ms = bench_now,
+    .now_us = bench_now_us,
+    .cycles = bench_cycles,
+};
+
+const sensor_hal_t *sensor_hal = &bench_hal;
+
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, BaseType_t reload, void *id, TimerCallbackFunction_t callback){
+    bench_sampler = callback;
+    bench_period_ms = period * portTICK_PERIOD_MS;
+    return &bench_sampler;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait){
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait){
+    bench_period_ms = period * portTICK_PERIOD_MS;
+    return pdPASS;
+}
+
+
+void binlog_write(binlog_id_t id, uint8_t level, uint8_t count, const uint32_t *arg){
+}
+
+void trace_adc(uint16_t code, uint32_t sample){
+}
+
+
+homekit_characteristic_t lpg_level, carbon_monoxide_level, pm10_density, methane_level, ammonium_level;
+homekit_characteristic_t lpg_hour_average, lpg_day_average, lpg_day_max, co_hour_average, co_day_average, co_day_max,
+    pm10_hour_average, pm10_day_average, pm10_day_max, ch4_hour_average, ch4_day_average, ch4_day_max,
+    nh4_hour_average, nh4_day_average, nh4_day_max;
+homekit_characteristic_t lpg_hour_min, lpg_hour_max, lpg_day_min, co_hour_min, co_hour_max, co_day_min,
+    pm10_hour_min, pm10_hour_max, pm10_day_min, ch4_hour_min, ch4_hour_max, ch4_day_min,
+    nh4_hour_min, nh4_hour_max, nh4_day_min;
+
+
+static struct timespec bench_start;
+
+static void bench_begin(void){
+    clock_gettime(CLOCK_MONOTONIC, &bench_start);
+}
+
+static void bench_end(const char *stage, uint32_t calls, float result){
+    struct timespec end;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = ((end.tv_sec - bench_start.tv_sec) * 1e9 + (end.tv_nsec - bench_start.tv_nsec)) / calls;
+    printf("%-28s %10u %12.1f   %g\n", stage, calls, ns, result);
+}
+
+
+int main(int argc, char **argv){
+    mq_readings_t readings;
+    float ppm[GAS_COUNT], result = 0;
+    uint32_t calls = 100000, i;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:s:")) != -1){
+        switch (option){
+            case 'n': calls = atoi(optarg); break;
+            case 's': bench_seed = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n calls] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (calls == 0){
+        calls = 1;
+    }
+
+    burst_capture_set_trigger(0, 0);
+    adc_sampler_start(ADC_SAMPLE_PERIOD_MS);
+    bench_delay_ms(ADC_SAMPLE_PERIOD_MS * ADC_WINDOW_SIZE);
+    env_snapshot_publish(22.5, 41.0);
+    MQInit(0);
+
+#ifdef MQ135_FIXED_POINT
+    printf("MQ135_FIXED_POINT build\n");
+#endif
+    printf("%-28s %10s %12s   %s\n", "stage", "calls", "ns/call", "last result");
+
+    bench_begin();
+    for (i = 0; i < calls; i++){
+        bench_now_ms += bench_period_ms;
+        bench_sampler(NULL);
+    }
+    bench_end("adc sample", calls, bench_level);
+
+    bench_begin();
+    for (i = 0; i < calls; i++){
+        result += get_correction_factor(-10 + (i % 800) * 0.1f, (i % 97) * 1.0f);
+    }
+    bench_end("get_correction_factor", calls, result);
+
+    /* a new DHT22 reading each call, so the correction is looked up again */
+    bench_begin();
+    for (i = 0; i < calls; i++){
+        env_snapshot_publish(-10 + (i % 800) * 0.1f, (i % 97) * 1.0f);
+        MQGetConcentrationsAt(bench_level, ppm);
+    }
+    bench_end("correction lookup + curves", calls, ppm[GAS_CO]);
+
+    bench_begin();
+    for (i = 0; i < calls; i++){
+        MQGetConcentrationsAt(bench_level, ppm);
+    }
+    bench_end("curves", calls, ppm[GAS_CO]);
+
+    bench_begin();
+    for (i = 0; i < calls; i++){
+        MQGetReadings(&readings);
+    }
+    bench_end("MQGetReadings", calls, readings.rs);
+
+    /* a sensor cycle with a new sample, and a DHT22 reading every 10 s as its job makes */
+    bench_begin();
+    for (i = 0; i < calls; i++){
+        if (i % (10000 / ADC_SAMPLE_PERIOD_MS) == 0){
+            env_snapshot_publish(22.5, 41.0);
+        }
+        MQGetReadings(&readings);
+        bench_now_ms += bench_period_ms;
+        bench_sampler(NULL);
+    }
+    bench_end("MQGetReadings + sample + env", calls, readings.aqi_index);
+
+    /* each call waits for a full window of samples, so it is mostly the sampler */
+    bench_begin();
+    for (i = 0; i < calls / 10000 + 1; i++){
+        result = MQCalibration(&mq_channels[MQ_CHANNEL_MQ135]);
+    }
+    bench_end("MQCalibration", calls / 10000 + 1, result);
+    return 0;
+}
@@ -0,0 +1,324 @@
+/* Replays a sensor trace through the same MQGetReadings, clamp and AQI code as the
+ * firmware, compares the outputs with those recorded and reports the throughput.
+ *
+ *     replay [-t tolerance] [-w warmup] [-v] trace...
+ *
+ * Trace files are 256 byte pages in any order, as captured from UDP by
+ * tools/trace_capture.py or read out of the flash region with esptool read_flash.
+ * The exit status is 0 when every output matches, 1 when any differ.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "FreeRTOS.h"
+#include "timers.h"
+#include "sensor_hal.h"
+#include "sensor_trace.h"
+#include "esp8266_mq135.h"
+#include "gas_table.h"
+#include "adc_sampler.h"
+#include "env_snapshot.h"
+#include "signal_filter.h"
+#include "air_quality_index.h"
+#include "binlog.h"
+#include "burst_capture.h"
+
+
+typedef struct {
+    uint8_t type;
+    bool consumed;
+    uint32_t time_ms;
+    union {
+        trace_adc_t adc;
+        trace_dht_t dht;
+        trace_state_t state;
+        trace_output_t output;
+    };
+} replay_record_t;
+
+
+static trace_page_t *pages;
+static size_t page_count;
+static replay_record_t *records;
+static size_t record_count;
+
+static uint32_t replay_now_ms;
+static uint16_t replay_code;
+static TimerCallbackFunction_t replay_sampler;
+static uint16_t replay_sample;
+
+static float tolerance = 1e-3;
+static uint32_t warmup = 0;
+static bool verbose = false;
+
+
+/* everything the sensor sources need from outside, bound to the trace */
+
+static uint16_t replay_adc_read(uint8_t channel){
+    return replay_code;
+}
+
+static void replay_delay_ms(uint32_t ms){
+    replay_now_ms += ms;
+}
+
+static uint32_t replay_now(void){
+    return replay_now_ms;
+}
+
+static uint32_t replay_now_us(void){
+    return replay_now_ms * 1000;
+}
+
+static uint32_t replay_cycles(void){
+    return 0;
+}
+
+static const sensor_hal_t replay_hal = {
+    .adc_read = replay_adc_read,
+    .delay_ms = replay_delay_ms,
+    .now_ms = replay_now,
+    .now_us = replay_now_us,
+    .cycles = replay_cycles,
+};
+
+const sensor_hal_t *sensor_hal = &replay_hal;
+
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, BaseType_t reload, void *id, TimerCallbackFunction_t callback){
+    replay_sampler = callback;
+    return &replay_sampler;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait){
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait){
+    return pdPASS;
+}
+
+
+void binlog_write(binlog_id_t id, uint8_t level, uint8_t count, const uint32_t *arg){
+}
+
+void trace_adc(uint16_t code, uint32_t sample){
+}
+
+
+/* the ranges of these in esp-homekit match the gas table, so the table limits are enough */
+homekit_characteristic_t lpg_level, carbon_monoxide_level, pm10_density, methane_level, ammonium_level;
+/* statistics are not replayed, gas_table only needs them to exist */
+homekit_characteristic_t lpg_hour_average, lpg_day_average, lpg_day_max, co_hour_average, co_day_average, co_day_max,
+    pm10_hour_average, pm10_day_average, pm10_day_max, ch4_hour_average, ch4_day_average, ch4_day_max,
+    nh4_hour_average, nh4_day_average, nh4_day_max;
+homekit_characteristic_t lpg_hour_min, lpg_hour_max, lpg_day_min, co_hour_min, co_hour_max, co_day_min,
+    pm10_hour_min, pm10_hour_max, pm10_day_min, ch4_hour_min, ch4_hour_max, ch4_day_min,
+    nh4_hour_min, nh4_hour_max, nh4_day_min;
+
+
+static bool load(const char *path){
+    FILE *file = fopen(path, "rb");
+    trace_page_t page;
+
+    if (file == NULL){
+        perror(path);
+        return false;
+    }
+    while (fread(&page, TRACE_PAGE_SIZE, 1, file) == 1){
+        if (page.magic != TRACE_PAGE_MAGIC || page.version != TRACE_VERSION || page.words > TRACE_PAGE_WORDS){
+            continue;
+        }
+        pages = realloc(pages, (page_count + 1) * sizeof(trace_page_t));
+        pages[page_count++] = page;
+    }
+    fclose(file);
+    return true;
+}
+
+
+static int compare_pages(const void *a, const void *b){
+    uint32_t sequence_a = ((const trace_page_t *) a)->sequence, sequence_b = ((const trace_page_t *) b)->sequence;
+    return sequence_a < sequence_b ? -1 : sequence_a > sequence_b;
+}
+
+
+static void decode(void){
+    trace_record_header_t header;
+    replay_record_t *record;
+    uint32_t time_ms, offset, gaps = 0;
+    size_t i;
+
+    qsort(pages, page_count, sizeof(trace_page_t), compare_pages);
+    for (i = 0; i < page_count; i++){
+        if (i > 0 && pages[i].sequence != pages[i - 1].sequence + 1){
+            gaps++;
+        }
+        time_ms = pages[i].time_ms;
+        for (offset = 0; offset < pages[i].words; offset += 1 + header.words){
+            memcpy(&header, &pages[i].data[offset], sizeof(header));
+            if (offset + 1 + header.words > pages[i].words){
+                break;
+            }
+            time_ms += header.dt_ms;
+            records = realloc(records, (record_count + 1) * sizeof(replay_record_t));
+            record = &records[record_count++];
+            memset(record, 0, sizeof(*record));
+            record->type = header.type;
+            record->time_ms = time_ms;
+            if (header.words * 4 <= sizeof(record->output)){
+                memcpy(&record->adc, &pages[i].data[offset + 1], header.words * 4);
+            }
+        }
+    }
+    printf("%zu pages, %u gaps, %zu records\n", page_count, gaps, record_count);
+}
+
+
+static void feed_adc(replay_record_t *record){
+    record->consumed = true;
+    replay_now_ms = record->time_ms;
+    replay_code = record->adc.code;
+    replay_sample = record->adc.sample;
+    replay_sampler(NULL);
+}
+
+
+static float relative_error(float replayed, float recorded){
+    float scale = fabsf(recorded) > 1 ? fabsf(recorded) : 1;
+    if (isnan(replayed) && isnan(recorded)){
+        return 0;
+    }
+    return fabsf(replayed - recorded) / scale;
+}
+
+
+int main(int argc, char **argv){
+    signal_filter_t temperature_filter = ENV_TEMPERATURE_FILTER;
+    signal_filter_t humidity_filter = ENV_HUMIDITY_FILTER;
+    mq_readings_t readings;
+    replay_record_t *record;
+    uint32_t samples = 0, outputs = 0, mismatches = 0, compared = 0;
+    float error, worst = 0;
+    const char *worst_field = "";
+    struct timespec start, end;
+    double seconds;
+    size_t i, j;
+    int option, gas;
+
+    while ((option = getopt(argc, argv, "t:w:v")) != -1){
+        switch (option){
+            case 't': tolerance = atof(optarg); break;
+            case 'w': warmup = atoi(optarg); break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-t tolerance] [-w warmup outputs] [-v] trace...\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind == argc){
+        fprintf(stderr, "no trace given\n");
+        return 2;
+    }
+    for (; optind < argc; optind++){
+        if (!load(argv[optind])){
+            return 2;
+        }
+    }
+    decode();
+    /* burst codes are not traced, so the recorded samples are all at the normal rate */
+    burst_capture_set_trigger(0, 0);
+    adc_sampler_start(ADC_SAMPLE_PERIOD_MS);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < record_count; i++){
+        record = &records[i];
+        switch (record->type){
+            case TRACE_ADC:
+                if (!record->consumed){
+                    feed_adc(record);
+                    samples++;
+                }
+                break;
+
+            case TRACE_DHT:
+                replay_now_ms = record->time_ms;
+                if (record->dht.valid){
+                    env_snapshot_publish(Q16_TO_FLOAT(signal_filter_update(&temperature_filter, Q16(record->dht.temperature))),
+                                         Q16_TO_FLOAT(signal_filter_update(&humidity_filter, Q16(record->dht.humidity))));
+                } else {
+                    env_snapshot_fail();
+                }
+                break;
+
+            case TRACE_STATE:
+                if (record->state.ro > 0){
+                    mq_channels[MQ_CHANNEL_MQ135].ro = record->state.ro;
+                    aqi_set_standard(record->state.aqi_standard);
+                }
+                break;
+
+            case TRACE_OUTPUT:
+                /* a sample can be taken between the reading and its record, catch up with it */
+                for (j = i + 1; j < record_count && (int16_t) ((uint16_t) record->output.samples - replay_sample) > 0; j++){
+                    if (records[j].type == TRACE_ADC && !records[j].consumed){
+                        feed_adc(&records[j]);
+                        samples++;
+                    }
+                }
+                replay_now_ms = record->time_ms;
+
+                /* as air_quality_sensor_job in main.c */
+                if (!MQGetReadings(&readings)){
+                    break;
+                }
+                for (gas = 0; gas < GAS_COUNT; gas++){
+                    readings.ppm[gas] = gas_clamp(&gas_table[gas], readings.ppm[gas]);
+                }
+
+                if (outputs++ < warmup){
+                    break;
+                }
+                compared++;
+                error = 0;
+                #define REPLAY_CHECK(name, replayed, recorded) do { \
+                    float e = relative_error((replayed), (recorded)); \
+                    if (e > error) error = e; \
+                    if (e > worst){ worst = e; worst_field = (name); } \
+                } while (0)
+                REPLAY_CHECK("rs", readings.rs, record->output.rs);
+                REPLAY_CHECK("correction", readings.correction_factor, record->output.correction_factor);
+                REPLAY_CHECK("ratio", readings.rs_ro_ratio, record->output.rs_ro_ratio);
+                for (gas = 0; gas < GAS_COUNT; gas++){
+                    REPLAY_CHECK(gas_table[gas].name, readings.ppm[gas], record->output.ppm[gas]);
+                }
+                REPLAY_CHECK("aqi index", readings.aqi_index, record->output.aqi_index);
+                if (readings.air_quality != record->output.air_quality){
+                    error = INFINITY;
+                }
+
+                if (error > tolerance){
+                    mismatches++;
+                }
+                if (verbose || (error > tolerance && mismatches <= 20)){
+                    printf("%10.3f %s rs %.1f/%.1f ratio %.4f/%.4f CO %.2f/%.2f PM10 %.1f/%.1f index %.1f/%.1f level %u/%u\n",
+                           record->time_ms / 1000.0, error > tolerance ? "DIFF" : "ok  ",
+                           readings.rs, record->output.rs, readings.rs_ro_ratio, record->output.rs_ro_ratio,
+                           readings.ppm[GAS_CO], record->output.ppm[GAS_CO], readings.ppm[GAS_PM10], record->output.ppm[GAS_PM10],
+                           readings.aqi_index, record->output.aqi_index, readings.air_quality, record->output.air_quality);
+                }
+                break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%u samples, %u outputs, %u compared, %u differ beyond %g, worst relative error %g (%s)\n",
+           samples, outputs, compared, mismatches, tolerance, worst, worst_field);
+    printf("%.3f ms, %.0f samples/s, %.0f outputs/s\n", seconds * 1000, samples / seconds, outputs / seconds);
+    return mismatches ? 1 : 0;
+}
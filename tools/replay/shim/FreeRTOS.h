@@ -0,0 +1,21 @@
+/* Just enough of FreeRTOS for the sensor sources to build in the replay tool, which
+ * runs single threaded.
+ */
+
+#ifndef __REPLAY_FREERTOS_H__
+#define __REPLAY_FREERTOS_H__
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+
+#define pdTRUE                  1
+#define pdPASS                  1
+#define portTICK_PERIOD_MS      10
+#define pdMS_TO_TICKS(ms)       ((TickType_t) (ms) / portTICK_PERIOD_MS)
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+#endif
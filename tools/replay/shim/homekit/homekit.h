@@ -0,0 +1,39 @@
+/* The parts of the esp-homekit types the sensor sources use, for the replay tool.
+ */
+
+#ifndef __REPLAY_HOMEKIT_H__
+#define __REPLAY_HOMEKIT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    homekit_format_bool,
+    homekit_format_uint8,
+    homekit_format_uint16,
+    homekit_format_uint32,
+    homekit_format_uint64,
+    homekit_format_int,
+    homekit_format_float,
+} homekit_format_t;
+
+typedef struct {
+    homekit_format_t format;
+    union {
+        bool bool_value;
+        int int_value;
+        float float_value;
+    };
+} homekit_value_t;
+
+typedef struct {
+    const char *description;
+    homekit_value_t value;
+    float *min_value;
+    float *max_value;
+} homekit_characteristic_t;
+
+/* defined by the host tools that publish, tools/notify_bench counts what would be sent */
+void homekit_characteristic_notify(homekit_characteristic_t *characteristic, homekit_value_t value);
+
+#endif
@@ -0,0 +1,17 @@
+/* Software timers for the replay tool, the callback is kept so the replay can call
+ * it for each recorded sample instead of on a timer.
+ */
+
+#ifndef __REPLAY_TIMERS_H__
+#define __REPLAY_TIMERS_H__
+
+#include "FreeRTOS.h"
+
+typedef void *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, BaseType_t reload, void *id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait);
+
+#endif
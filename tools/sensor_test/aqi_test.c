@@ -0,0 +1,183 @@
+/* Checks the air quality index at the edges of every band of each standard, and
+ * the US EPA levels against the threshold ladders the breakpoint tables replaced.
+ *
+ *     aqi_test
+ *
+ * The ladders rated CO at 4.5, 9.5, 12.5 and 15.4 ppm and PM10 at 55, 155, 255 and
+ * 355 ug/m3 for levels 2 to 5. The tables follow the EPA bands, which put 15.4 ppm
+ * of CO at the top of band 4, so from 15.4 up to 15.5 the level is 4 where the
+ * ladder gave 5, and that is the only difference allowed.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "air_quality_index.h"
+#include "test_support.h"
+
+
+typedef struct {
+    uint8_t pollutant;
+    float concentration;
+    uint8_t level;
+    float index;                    /* negative if the standard does not rate the pollutant */
+} aqi_edge_t;
+
+#define CO      AQI_POLLUTANT_CO
+#define PM10    AQI_POLLUTANT_PM10
+
+static const aqi_edge_t us_epa_edges[] = {
+    { CO, 0, 1, 0 }, { CO, 4.4, 1, 50 }, { CO, 4.45, 1, 50 }, { CO, 4.5, 2, 51 }, { CO, 9.4, 2, 100 },
+    { CO, 9.5, 3, 101 }, { CO, 12.4, 3, 150 }, { CO, 12.5, 4, 151 }, { CO, 15.4, 4, 200 }, { CO, 15.45, 4, 200 },
+    { CO, 15.5, 5, 201 }, { CO, 30.4, 5, 300 }, { CO, 30.5, 5, 301 }, { CO, 50.4, 5, 500 }, { CO, 80, 5, 500 },
+    { PM10, 0, 1, 0 }, { PM10, 54, 1, 50 }, { PM10, 54.5, 1, 50 }, { PM10, 55, 2, 51 }, { PM10, 154, 2, 100 },
+    { PM10, 155, 3, 101 }, { PM10, 254, 3, 150 }, { PM10, 255, 4, 151 }, { PM10, 354, 4, 200 },
+    { PM10, 355, 5, 201 }, { PM10, 424, 5, 300 }, { PM10, 425, 5, 301 }, { PM10, 604, 5, 500 }, { PM10, 900, 5, 500 },
+};
+
+static const aqi_edge_t eu_caqi_edges[] = {
+    { CO, 0, 1, 0 }, { CO, 4.36, 1, 24.943 }, { CO, 4.37, 2, 25 }, { CO, 6.55, 3, 50 }, { CO, 8.73, 4, 75 },
+    { CO, 17.46, 4, 99.971 }, { CO, 17.47, 5, 100 }, { CO, 100, 5, 336 }, { CO, 150, 5, 336 },
+    { PM10, 0, 1, 0 }, { PM10, 24.9, 1, 24.9 }, { PM10, 25, 2, 25 }, { PM10, 50, 3, 50 }, { PM10, 90, 4, 75 },
+    { PM10, 179.9, 4, 99.972 }, { PM10, 180, 5, 100 }, { PM10, 1000, 5, 328 }, { PM10, 2000, 5, 328 },
+};
+
+static const aqi_edge_t uk_daqi_edges[] = {
+    { CO, 0, 1, -1 }, { CO, 50, 1, -1 },
+    { PM10, 0, 1, 1 }, { PM10, 16, 1, 1 }, { PM10, 16.5, 1, 1 }, { PM10, 17, 2, 2 }, { PM10, 34, 2, 3 },
+    { PM10, 50, 2, 3 }, { PM10, 51, 3, 4 }, { PM10, 59, 3, 5 }, { PM10, 67, 3, 6 }, { PM10, 75.5, 3, 6 },
+    { PM10, 76, 4, 7 }, { PM10, 84, 4, 8 }, { PM10, 92, 4, 9 }, { PM10, 100, 4, 9 }, { PM10, 101, 5, 10 },
+    { PM10, 5000, 5, 10 },
+};
+
+static const struct {
+    uint8_t standard;
+    const char *name;
+    const aqi_edge_t *edges;
+    unsigned count;
+} standards[] = {
+    { AQI_STANDARD_US_EPA, "US EPA", us_epa_edges, sizeof(us_epa_edges) / sizeof(aqi_edge_t) },
+    { AQI_STANDARD_EU_CAQI, "EU CAQI", eu_caqi_edges, sizeof(eu_caqi_edges) / sizeof(aqi_edge_t) },
+    { AQI_STANDARD_UK_DAQI, "UK DAQI", uk_daqi_edges, sizeof(uk_daqi_edges) / sizeof(aqi_edge_t) },
+};
+
+
+/* the ladders of MQGetReadings before the breakpoint tables */
+static uint8_t ladder_level(float co, float pm10){
+    uint8_t level = co >= 15.4 ? 5 : co >= 12.5 ? 4 : co >= 9.5 ? 3 : co >= 4.5 ? 2 : 1;
+    uint8_t pm10_level = pm10 >= 355 ? 5 : pm10 >= 255 ? 4 : pm10 >= 155 ? 3 : pm10 >= 55 ? 2 : 1;
+
+    return pm10_level > level ? pm10_level : level;
+}
+
+
+static void check_edges(void){
+    const aqi_edge_t *edge;
+    unsigned s, i;
+    uint8_t level;
+    float index;
+
+    for (s = 0; s < sizeof(standards) / sizeof(standards[0]); s++){
+        aqi_set_standard(standards[s].standard);
+        assert(aqi_get_standard() == standards[s].standard);
+        for (i = 0; i < standards[s].count; i++){
+            edge = &standards[s].edges[i];
+            index = aqi_sub_index(edge->pollutant, edge->concentration, &level);
+            if (level != edge->level || fabsf(index - edge->index) > 1e-3){
+                printf("%s: %s pollutant %u at %g is level %u index %g, expected %u %g\n", __func__, standards[s].name,
+                    edge->pollutant, edge->concentration, level, index, edge->level, edge->index);
+            }
+            assert(level == edge->level);
+            assert(fabsf(index - edge->index) <= 1e-3);
+        }
+        printf("%s: %s %u edges ok\n", __func__, standards[s].name, standards[s].count);
+    }
+}
+
+
+/* rising concentrations never lower the level or the index */
+static void check_monotonic(void){
+    float concentration, index, last_index;
+    uint8_t pollutant, level, last_level;
+    unsigned s;
+
+    for (s = 0; s < sizeof(standards) / sizeof(standards[0]); s++){
+        aqi_set_standard(standards[s].standard);
+        for (pollutant = 0; pollutant < AQI_POLLUTANT_COUNT; pollutant++){
+            last_index = -1;
+            last_level = 1;
+            for (concentration = 0; concentration < 1200; concentration += 0.01){
+                index = aqi_sub_index(pollutant, concentration, &level);
+                assert(index >= last_index && level >= last_level);
+                last_index = index;
+                last_level = level;
+            }
+        }
+    }
+    printf("%s: ok\n", __func__);
+}
+
+
+static void check_ladder(void){
+    float concentration[AQI_POLLUTANT_COUNT];
+    uint32_t compared = 0, moved = 0;
+    aqi_result_t result;
+    uint8_t expected;
+    int co, pm10;
+
+    aqi_set_standard(AQI_STANDARD_US_EPA);
+    for (co = 0; co <= 6000; co++){
+        for (pm10 = 0; pm10 <= 700; pm10 += 5){
+            concentration[CO] = co / 100.0f;
+            concentration[PM10] = pm10 + (co % 10) / 10.0f;
+            aqi_calculate(concentration, &result);
+            expected = ladder_level(concentration[CO], concentration[PM10]);
+            if (result.level != expected){
+                /* 15.4 ppm of CO is the top of EPA band 4, the ladder made it 5 */
+                assert(concentration[CO] >= 15.4f && concentration[CO] < 15.5f && expected == 5 && result.level == 4);
+                moved++;
+            }
+            compared++;
+        }
+    }
+    assert(moved > 0);
+    printf("%s: %u pairs, %u moved from level 5 to 4 at CO 15.4 to 15.5 ppm\n", __func__, compared, moved);
+}
+
+
+static void check_worst(void){
+    float concentration[AQI_POLLUTANT_COUNT] = { 10, 100 };
+    aqi_result_t result;
+
+    aqi_set_standard(AQI_STANDARD_US_EPA);
+    aqi_calculate(concentration, &result);
+    assert(result.level == 3 && result.dominant == CO && fabsf(result.index - result.sub_index[CO]) < 1e-6);
+
+    concentration[CO] = NAN;
+    aqi_calculate(concentration, &result);
+    assert(result.level == 2 && result.dominant == PM10 && result.sub_index[CO] < 0);
+
+    concentration[PM10] = NAN;
+    aqi_calculate(concentration, &result);
+    assert(result.level == 1 && result.index == 0 && result.dominant == AQI_POLLUTANT_NONE);
+
+    /* CO is not rated by the UK index, so it cannot make the air worse */
+    aqi_set_standard(AQI_STANDARD_UK_DAQI);
+    concentration[CO] = 40;
+    concentration[PM10] = 20;
+    aqi_calculate(concentration, &result);
+    assert(result.level == 2 && result.dominant == PM10 && result.index == 2);
+
+    /* an unknown standard is ignored */
+    aqi_set_standard(AQI_STANDARD_COUNT);
+    assert(aqi_get_standard() == AQI_STANDARD_UK_DAQI);
+    printf("%s: ok\n", __func__);
+}
+
+
+int main(void){
+    check_edges();
+    check_monotonic();
+    check_ladder();
+    check_worst();
+    return 0;
+}
@@ -0,0 +1,175 @@
+/* Runs simulated gas puffs on a noisy baseline through the adc sampler and checks
+ * the burst captures they trigger: the baseline, the peak and the time to it, the
+ * sampler rate during and after a burst, and that noise, a garbage frame, a level
+ * that stays crossed and a puff within the holdoff do not trigger.
+ *
+ *     burst_test
+ *
+ * A puff is the difference of two exponentials, a fast rise and a slower decay as
+ * an MQ sensor answers a short burst of gas, so its peak and the time from the
+ * start of its rise to the peak are known in closed form.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "adc_sampler.h"
+#include "burst_capture.h"
+#include "test_support.h"
+
+#define BASELINE            200
+#define NOISE               3       /* codes either way */
+#define RISE_MS             400.0
+#define DECAY_MS            3000.0
+
+
+static uint32_t noise_seed = 1;
+static uint32_t bursts;
+static uint32_t puff_start_ms;
+static float puff_height;          /* 0 for no puff */
+
+
+static void on_burst(void){
+    bursts++;
+}
+
+
+/* the code of a puff of the given height above the baseline, without noise */
+static float puff(uint32_t now_ms){
+    float t = (int32_t) (now_ms - puff_start_ms);
+
+    if (puff_height == 0 || t < 0){
+        return 0;
+    }
+    return puff_height * (exp(-t / DECAY_MS) - exp(-t / RISE_MS));
+}
+
+
+static void run(uint32_t ms){
+    uint32_t end = test_now_ms + ms;
+    int noise;
+
+    while ((int32_t) (end - test_now_ms) > 0){
+        noise_seed = noise_seed * 1103515245 + 12345;
+        noise = (int) (noise_seed >> 16 & 0xff) % (2 * NOISE + 1) - NOISE;
+        test_code = BASELINE + noise + puff(test_now_ms + test_period_ms) + 0.5f;
+        test_sample(1);
+    }
+}
+
+
+static void check_quiet(void){
+    burst_result_t result;
+
+    run(120000);
+    assert(bursts == 0 && !burst_capture_result(&result));
+    assert(test_period_ms == ADC_SAMPLE_PERIOD_MS);
+
+    /* one garbage frame is not confirmed */
+    test_code = 1023;
+    test_sample(1);
+    run(10000);
+    assert(bursts == 0);
+    printf("%s: ok\n", __func__);
+}
+
+
+static void check_puff(void){
+    float ratio = DECAY_MS / RISE_MS, peak_t, peak, onset_t, expected_ttp, early_t, late_t;
+    burst_result_t result;
+    uint32_t start;
+
+    /* where the puff peaks, and where it first reaches the onset fraction of that */
+    peak_t = log(ratio) * RISE_MS * DECAY_MS / (DECAY_MS - RISE_MS);
+    puff_height = 600;
+    puff_start_ms = start = test_now_ms + 10;
+    peak = puff(puff_start_ms + peak_t);
+    for (onset_t = 0; puff(puff_start_ms + onset_t) < peak * BURST_ONSET_FRACTION; onset_t += 1){
+    }
+    expected_ttp = peak_t - onset_t;
+    /* the top is flat, so with noise the highest mean can be anywhere it is within the noise of the peak */
+    for (early_t = peak_t; puff(puff_start_ms + early_t) > peak - 2 * NOISE; early_t -= 1){
+    }
+    for (late_t = peak_t; puff(puff_start_ms + late_t) > peak - 2 * NOISE; late_t += 1){
+    }
+
+    while (bursts == 0){
+        run(ADC_SAMPLE_PERIOD_MS);
+        assert(test_now_ms - start < 1000);
+    }
+    /* the burst rate until the capture is full, then the normal rate again */
+    assert(test_period_ms == BURST_PERIOD_MS);
+    assert(!burst_capture_result(&result));
+    run(BURST_POST_MS);
+    assert(test_period_ms == ADC_SAMPLE_PERIOD_MS);
+    assert(burst_capture_result(&result));
+    assert(!burst_capture_result(&result));
+
+    printf("%s: triggered %u ms into the rise, baseline %.1f, peak %.1f of %.1f, time to peak %u ms of %.0f (%.0f to %.0f within the noise)\n",
+        __func__, result.trigger_ms - start, result.baseline, result.peak, BASELINE + peak, result.time_to_peak_ms, expected_ttp,
+        early_t - onset_t, late_t - onset_t);
+    assert(result.samples == BURST_POST_SAMPLES);
+    assert(result.trigger_ms - start < 300);
+    assert(fabsf(result.baseline - BASELINE) <= NOISE);
+    assert(fabsf(result.peak - (BASELINE + peak)) <= 0.02 * peak);
+    /* and the onset is found at the normal rate, so to within a sample period */
+    assert(result.time_to_peak_ms >= early_t - onset_t - ADC_SAMPLE_PERIOD_MS);
+    assert(result.time_to_peak_ms <= late_t - onset_t + ADC_SAMPLE_PERIOD_MS);
+}
+
+
+static void check_holdoff(void){
+    burst_result_t result;
+
+    /* another puff before the holdoff ends is not captured, one after it is */
+    run(10000);
+    puff_start_ms = test_now_ms;
+    run(10000);
+    assert(bursts == 1);
+    run(BURST_HOLDOFF_MS);
+    puff_start_ms = test_now_ms;
+    run(1000);
+    assert(bursts == 2);
+    run(BURST_POST_MS);
+    assert(burst_capture_result(&result));
+    puff_height = 0;
+    run(BURST_HOLDOFF_MS);
+    printf("%s: ok\n", __func__);
+}
+
+
+static void check_level(void){
+    burst_result_t result;
+    uint32_t t;
+
+    /* a slow climb through the level triggers once, staying above it does not trigger again */
+    burst_capture_set_trigger(400, 0);
+    for (t = 0; t <= 300; t++){
+        test_code = BASELINE + t;
+        test_sample(20);
+    }
+    assert(bursts == 3);
+    assert(burst_capture_result(&result));
+    assert(result.peak > 400);
+    test_sample(2 * BURST_HOLDOFF_MS / ADC_SAMPLE_PERIOD_MS);
+    assert(bursts == 3);
+
+    /* off */
+    burst_capture_set_trigger(0, 0);
+    test_code = 100;
+    test_sample(100);
+    test_code = 1000;
+    test_sample(100);
+    assert(bursts == 3);
+    printf("%s: ok\n", __func__);
+}
+
+
+int main(void){
+    adc_sampler_on_burst(on_burst);
+    adc_sampler_start(ADC_SAMPLE_PERIOD_MS);
+    check_quiet();
+    check_puff();
+    check_holdoff();
+    check_level();
+    return 0;
+}
@@ -0,0 +1,72 @@
+/* Bounds the error of the correction tables against get_correction_factor, the
+ * model they are built from, over the range of the DHT22 and beyond it.
+ *
+ *     correction_test
+ *
+ * The factor is taken from MQGetReadings after each new temperature and humidity,
+ * so the whole path from the snapshot to the reading is checked. Below 20 degrees
+ * the tables interpolate a quadratic and the error is bounded in the remarks of
+ * MQCorrectionLookup, above it the model is linear and only rounding is left.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "esp8266_mq135.h"
+#include "adc_sampler.h"
+#include "adc_window.h"
+#include "env_snapshot.h"
+#include "test_support.h"
+
+/* half a Q12 step for the table entry and each of the two interpolations */
+#define ROUNDING_MAX_ERROR  (1.5 / 4096)
+#define COLD_MAX_ERROR      (0.0022 + ROUNDING_MAX_ERROR)
+#define WARM_MAX_ERROR      ROUNDING_MAX_ERROR
+
+
+static float clamp(float value, float low, float high){
+    return value < low ? low : value > high ? high : value;
+}
+
+
+int main(void){
+    mq_readings_t readings;
+    float temperature, humidity, expected, error, cold_worst = 0, warm_worst = 0;
+    uint32_t checked = 0;
+
+    adc_sampler_start(ADC_SAMPLE_PERIOD_MS);
+    test_sample(ADC_WINDOW_SIZE);
+    MQInit(1000);
+
+    for (temperature = -50; temperature <= 90; temperature += 0.125){
+        for (humidity = -5; humidity <= 105; humidity += 0.5){
+            env_snapshot_publish(temperature, humidity);
+            MQGetReadings(&readings);
+            expected = get_correction_factor(clamp(temperature, CORRECTION_T_MIN, CORRECTION_T_MAX), clamp(humidity, 0, 100));
+            error = fabsf(readings.correction_factor - expected);
+            if (temperature < CORRECTION_T_SPLIT){
+                assert(error <= COLD_MAX_ERROR);
+                cold_worst = fmaxf(cold_worst, error);
+            } else {
+                assert(error <= WARM_MAX_ERROR);
+                warm_worst = fmaxf(warm_worst, error);
+            }
+            checked++;
+        }
+    }
+
+    /* the table rows on each side of the split are the limits of their own model */
+    env_snapshot_publish(CORRECTION_T_SPLIT - 0.001, 50);
+    MQGetReadings(&readings);
+    assert(fabsf(readings.correction_factor - CORRECTION_COLD(CORRECTION_T_SPLIT, 50)) <= WARM_MAX_ERROR);
+    env_snapshot_publish(CORRECTION_T_SPLIT, 50);
+    MQGetReadings(&readings);
+    assert(fabsf(readings.correction_factor - CORRECTION_WARM(CORRECTION_T_SPLIT, 50)) <= WARM_MAX_ERROR);
+
+    /* without a fresh reading the defaults are corrected for */
+    test_now_ms += ENV_STALE_MS + 1;
+    MQGetReadings(&readings);
+    assert(fabsf(readings.correction_factor - get_correction_factor(ENV_DEFAULT_TEMPERATURE, ENV_DEFAULT_HUMIDITY)) <= COLD_MAX_ERROR);
+
+    printf("%s: %u points, worst error %.5f below %d degrees, %.5f above\n", __FILE__, checked, cold_worst, CORRECTION_T_SPLIT, warm_worst);
+    return 0;
+}
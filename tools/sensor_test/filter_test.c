@@ -0,0 +1,162 @@
+/* Checks the Hampel and Kalman stages of signal_filter with the tunings the
+ * firmware uses: spikes and garbage frames are replaced by the median, steps and
+ * noise within the deviation are let through, and the smoother follows a float
+ * Kalman filter of the same model.
+ *
+ *     filter_test
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "signal_filter.h"
+#include "adc_sampler.h"
+#include "env_snapshot.h"
+#include "test_support.h"
+
+
+static uint32_t noise_seed = 1;
+
+/* roughly normal with a standard deviation of sigma */
+static float noise(float sigma){
+    float sum = 0;
+    int i;
+
+    for (i = 0; i < 12; i++){
+        noise_seed = noise_seed * 1103515245 + 12345;
+        sum += (noise_seed >> 8 & 0xffff) / 65536.0f;
+    }
+    return (sum - 6) * sigma;
+}
+
+
+static void check_hampel(void){
+    signal_filter_t filter = ADC_FILTER;
+    q16_t value, clean;
+    int i;
+
+    /* nothing is rejected until the window is full */
+    for (i = 0; i < SIGNAL_FILTER_WINDOW; i++){
+        value = Q16(i == 3 ? 900 : 300);
+        assert(signal_filter_clean(&filter, value) == value);
+    }
+    assert(filter.rejected == 0);
+
+    /* noise of 2 codes is kept, a spike or a garbage frame of 0 is replaced by the median */
+    for (i = 0; i < 200; i++){
+        value = Q16(300 + (i % 5) - 2);
+        if (i % 20 == 10){
+            clean = signal_filter_clean(&filter, Q16(i % 40 == 10 ? 1023 : 0));
+            assert(clean >= Q16(298) && clean <= Q16(302));
+        } else {
+            assert(signal_filter_clean(&filter, value) == value);
+        }
+    }
+    assert(filter.rejected == 10);
+
+    /* a real step is rejected until it holds the majority of the window */
+    for (i = 0; i < SIGNAL_FILTER_WINDOW; i++){
+        clean = signal_filter_clean(&filter, Q16(360));
+        if (i <= SIGNAL_FILTER_WINDOW / 2){
+            assert(clean < Q16(303));
+        } else {
+            assert(clean == Q16(360));
+        }
+    }
+
+    /* on a flat signal the minimum deviation keeps the next code from being an outlier */
+    signal_filter_reset(&filter);
+    for (i = 0; i < 50; i++){
+        value = Q16(i < 40 ? 512 : 513);
+        assert(signal_filter_clean(&filter, value) == value);
+    }
+    assert(filter.rejected == 0);
+    printf("%s: ok\n", __func__);
+}
+
+
+/* the same constant level model in floats */
+static void kalman(float *estimate, float *variance, float q, float r, float value){
+    float gain;
+
+    *variance += q;
+    gain = *variance / (*variance + r);
+    *estimate += (value - *estimate) * gain;
+    *variance *= 1 - gain;
+}
+
+
+static void check_kalman(void){
+    const signal_filter_t tunings[] = { ADC_FILTER, ENV_TEMPERATURE_FILTER, ENV_HUMIDITY_FILTER };
+    const float levels[] = { 300, 21.5, 45 }, sigmas[] = { 4, 0.1, 1 };
+    float q, r, estimate = 0, variance = 0, value, worst, in_error, out_error, in_sum, out_sum;
+    signal_filter_t filter;
+    q16_t smoothed;
+    unsigned t;
+    int i;
+
+    for (t = 0; t < sizeof(tunings) / sizeof(tunings[0]); t++){
+        filter = tunings[t];
+        signal_filter_reset(&filter);
+        q = Q16_TO_FLOAT(filter.process_noise);
+        r = Q16_TO_FLOAT(filter.measurement_noise);
+        worst = in_sum = out_sum = 0;
+        for (i = 0; i < 2000; i++){
+            value = levels[t] + noise(sigmas[t]) + (i >= 1000 ? 10 * sigmas[t] : 0);
+            smoothed = signal_filter_smooth(&filter, Q16(value));
+            if (i == 0){
+                estimate = value;
+                variance = r;
+                assert(smoothed == Q16(value));
+            } else {
+                kalman(&estimate, &variance, q, r, value);
+            }
+            worst = fmaxf(worst, fabsf(Q16_TO_FLOAT(smoothed) - estimate));
+            if (i >= 100 && i < 1000){
+                in_error = value - levels[t];
+                out_error = Q16_TO_FLOAT(smoothed) - levels[t];
+                in_sum += in_error * in_error;
+                out_sum += out_error * out_error;
+            }
+        }
+        /* tracks the float filter to within the Q16 rounding of each update, reduces the
+           noise and follows the step */
+        assert(worst < 2e-5 * levels[t] + 5e-4);
+        assert(out_sum < in_sum);
+        assert(fabsf(Q16_TO_FLOAT(filter.estimate) - (levels[t] + 10 * sigmas[t])) < 3 * sigmas[t]);
+        printf("%s: tuning %u follows the float filter within %.5f, noise power %.1f%% of the input\n",
+            __func__, t, worst, 100 * out_sum / in_sum);
+    }
+}
+
+
+static void check_restore(void){
+    signal_filter_t filter = ENV_HUMIDITY_FILTER, saved, other = ENV_TEMPERATURE_FILTER;
+    q16_t expected;
+    int i;
+
+    for (i = 0; i < 20; i++){
+        signal_filter_update(&filter, Q16(45 + noise(1)));
+    }
+    saved = filter;
+    expected = signal_filter_update(&filter, Q16(47));
+
+    /* a fresh filter restored from the copy carries on the same */
+    filter = (signal_filter_t) ENV_HUMIDITY_FILTER;
+    signal_filter_restore(&filter, &saved);
+    assert(signal_filter_update(&filter, Q16(47)) == expected);
+
+    /* a different window drops the history but keeps the estimate */
+    other.window = 3;
+    signal_filter_restore(&other, &saved);
+    assert(other.count == 0 && other.started && other.estimate == saved.estimate && other.variance == saved.variance);
+    printf("%s: ok\n", __func__);
+}
+
+
+int main(void){
+    check_hampel();
+    check_kalman();
+    check_restore();
+    return 0;
+}
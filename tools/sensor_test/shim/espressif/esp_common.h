@@ -0,0 +1,14 @@
+/* The RTC user memory of the SDK, for rtc_snapshot on the host. The test defines
+ * them over a buffer that outlives its simulated resets.
+ */
+
+#ifndef __TEST_ESP_COMMON_H__
+#define __TEST_ESP_COMMON_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool sdk_system_rtc_mem_read(uint32_t src, void *dst, uint16_t n);
+bool sdk_system_rtc_mem_write(uint32_t dst, void *src, uint16_t n);
+
+#endif
@@ -0,0 +1,99 @@
+/* Simulated clock and ADC for the host tests, see test_support.h
+ */
+
+#include <stdio.h>
+#include "FreeRTOS.h"
+#include "timers.h"
+#include "sensor_hal.h"
+#include "sensor_trace.h"
+#include "binlog.h"
+#include "homekit/homekit.h"
+#include "test_support.h"
+
+
+uint32_t test_now_ms;
+uint16_t test_code = 512;
+
+uint32_t test_period_ms = 50;
+static TimerCallbackFunction_t test_sampler;
+
+
+static uint16_t test_adc_read(uint8_t channel){
+    return test_code;
+}
+
+static void test_adc_select(uint8_t channel){
+}
+
+static void test_delay_ms(uint32_t ms){
+    uint32_t end = test_now_ms + ms;
+
+    while (test_sampler != NULL && (int32_t) (end - test_now_ms) >= (int32_t) test_period_ms){
+        test_sample(1);
+    }
+    test_now_ms = end;
+}
+
+static uint32_t test_now(void){
+    return test_now_ms;
+}
+
+static uint32_t test_now_us(void){
+    return test_now_ms * 1000;
+}
+
+static uint32_t test_cycles(void){
+    return 0;
+}
+
+static const sensor_hal_t test_hal = {
+    .adc_read = test_adc_read,
+    .adc_select = test_adc_select,
+    .delay_ms = test_delay_ms,
+    .now_ms = test_now,
+    .now_us = test_now_us,
+    .cycles = test_cycles,
+};
+
+const sensor_hal_t *sensor_hal = &test_hal;
+
+
+void test_sample(uint32_t count){
+    assert(test_sampler != NULL);
+    while (count--){
+        test_now_ms += test_period_ms;
+        test_sampler(NULL);
+    }
+}
+
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, BaseType_t reload, void *id, TimerCallbackFunction_t callback){
+    test_sampler = callback;
+    test_period_ms = period * portTICK_PERIOD_MS;
+    return &test_sampler;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait){
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait){
+    test_period_ms = period * portTICK_PERIOD_MS;
+    return pdPASS;
+}
+
+
+void binlog_write(binlog_id_t id, uint8_t level, uint8_t count, const uint32_t *arg){
+}
+
+void trace_adc(uint16_t code, uint32_t sample){
+}
+
+
+homekit_characteristic_t lpg_level, carbon_monoxide_level, pm10_density, methane_level, ammonium_level;
+homekit_characteristic_t lpg_hour_average, lpg_day_average, lpg_day_max, co_hour_average, co_day_average, co_day_max,
+    pm10_hour_average, pm10_day_average, pm10_day_max, ch4_hour_average, ch4_day_average, ch4_day_max,
+    nh4_hour_average, nh4_day_average, nh4_day_max;
+homekit_characteristic_t lpg_hour_min, lpg_hour_max, lpg_day_min, co_hour_min, co_hour_max, co_day_min,
+    pm10_hour_min, pm10_hour_max, pm10_day_min, ch4_hour_min, ch4_hour_max, ch4_day_min,
+    nh4_hour_min, nh4_hour_max, nh4_day_min;
@@ -0,0 +1,21 @@
+/* What the sensor sources need from outside, for the host tests: a sensor_hal with
+ * a simulated clock and ADC code, the adc sampler timer run by hand, and the logs
+ * and characteristics the sources refer to.
+ */
+
+#ifndef __TEST_SUPPORT_H__
+#define __TEST_SUPPORT_H__
+
+#include <stdint.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+extern uint32_t test_now_ms;
+extern uint16_t test_code;              /* returned by every adc read */
+extern uint32_t test_period_ms;         /* of the adc sampler timer */
+
+/* advance the clock by a sample period and take a sample, count times */
+void test_sample(uint32_t count);
+
+#endif
@@ -0,0 +1,80 @@
+/* Checks that the readings restored from RTC memory after a soft reset stay
+ * published until the adc sampler has taken a sample of the new run, rather than
+ * being replaced by a reading of the empty window.
+ *
+ *     warm_start_test
+ *
+ * The test starts as the firmware does after the reset, with a snapshot saved by
+ * rtc_snapshot_job in the RTC memory and the sampler not yet running. It restores
+ * the readings and runs MQInit and the reading of air_quality_sensor_job as
+ * main.c does.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <espressif/esp_common.h>
+#include "adc_sampler.h"
+#include "rtc_snapshot.h"
+#include "test_support.h"
+
+
+/* the RTC user memory, in 4 byte blocks */
+static uint32_t rtc_memory[RTC_SNAPSHOT_END];
+
+bool sdk_system_rtc_mem_read(uint32_t src, void *dst, uint16_t n){
+    assert(src >= 64 && (src + (n + 3) / 4) <= RTC_SNAPSHOT_END);
+    memcpy(dst, &rtc_memory[src], n);
+    return true;
+}
+
+bool sdk_system_rtc_mem_write(uint32_t dst, void *src, uint16_t n){
+    assert(dst >= 64 && (dst + (n + 3) / 4) <= RTC_SNAPSHOT_END);
+    memcpy(&rtc_memory[dst], src, n);
+    return true;
+}
+
+
+static mq_readings_t readings;
+
+/* the reading of air_quality_sensor_job, false when the cycle publishes nothing */
+static bool air_quality_cycle(void){
+    return MQGetReadings(&readings);
+}
+
+
+int main(void){
+    rtc_state_t warm_state, saved = {
+        .readings = { .rs = 4200, .correction_factor = 1, .rs_ro_ratio = 4.2, .ppm = { 3.1, 4.5, 60, 2.2, 6.4 },
+                      .air_quality = 3, .aqi_index = 72, .samples = 12345 },
+        .ro = 1000,
+        .valid_air = true,
+    };
+    mq_readings_t restored;
+
+    /* what rtc_snapshot_job left in the RTC memory before the reset */
+    assert(rtc_snapshot_save(&saved));
+
+    /* the reset, the process starts from zeroed globals with the gas at another level */
+    test_code = 700;
+    assert(rtc_snapshot_load(&warm_state));
+    assert(warm_state.valid_air && warm_state.ro == saved.ro);
+    readings = warm_state.readings;
+    restored = readings;
+
+    /* the stored Ro skips the calibration, so no sample has been taken yet */
+    assert(!MQInit(warm_state.ro));
+    assert(!air_quality_cycle());
+    assert(memcmp(&readings, &restored, sizeof(readings)) == 0);
+    assert(!air_quality_cycle());
+    assert(memcmp(&readings, &restored, sizeof(readings)) == 0);
+
+    /* the first sample of the run replaces them */
+    test_sample(1);
+    assert(air_quality_cycle());
+    assert(readings.samples == 1 && isfinite(readings.rs) && readings.rs > 0 && readings.rs != restored.rs);
+
+    printf("%s: restored rs %.0f level %u kept until the first sample, then rs %.0f level %u\n", __FILE__,
+           restored.rs, restored.air_quality, readings.rs, readings.air_quality);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/* Checks the minute, hour and day statistics of window_stats against the samples
+ * they were given, and that the CO exposure span covers exactly its 8 hours.
+ *
+ *     window_stats_test
+ *
+ * The samples come at an irregular rate, as the adaptive polling gives them. Each
+ * window is the buckets of its ring, so it reaches back to the start of its oldest
+ * bucket, and the expected figures are worked out from the samples since then with
+ * each held until the next, as window_stats integrates them.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "window_stats.h"
+#include "test_support.h"
+
+#define HOUR_MS             (60 * 60 * 1000UL)
+#define MAX_SAMPLES         40000
+
+static const uint32_t bucket_ms[WINDOW_STATS_TIERS] = { 10 * 1000, 5 * 60 * 1000, HOUR_MS };
+static const uint8_t buckets[WINDOW_STATS_TIERS] = { WINDOW_STATS_MINUTE_BUCKETS, WINDOW_STATS_HOUR_BUCKETS, WINDOW_STATS_DAY_BUCKETS };
+
+
+static uint32_t sample_ms[MAX_SAMPLES];
+static float sample_value[MAX_SAMPLES];
+static uint32_t samples;
+static uint32_t noise_seed = 1;
+
+
+static uint32_t noise(uint32_t range){
+    noise_seed = noise_seed * 1103515245 + 12345;
+    return (noise_seed >> 8) % range;
+}
+
+
+/* the figures of the samples from a time on, each held until the next and the last until now */
+static void expected(uint32_t from_ms, uint32_t now_ms, window_stats_result_t *result){
+    double sum = 0, integral = 0;
+    uint32_t i, start, end;
+
+    *result = (window_stats_result_t) { .min = INFINITY, .max = -INFINITY };
+    for (i = 0; i < samples; i++){
+        end = i + 1 < samples ? sample_ms[i + 1] : now_ms;
+        if (end <= from_ms && i + 1 < samples){
+            continue;
+        }
+        start = sample_ms[i] > from_ms ? sample_ms[i] : from_ms;
+        integral += (double) sample_value[i] * (end - start);
+        if (sample_ms[i] >= from_ms){
+            result->min = fminf(result->min, sample_value[i]);
+            result->max = fmaxf(result->max, sample_value[i]);
+            sum += sample_value[i];
+            result->count++;
+        }
+    }
+    result->mean = sum / result->count;
+    result->twa = integral / (now_ms - from_ms);
+}
+
+
+static void check_windows(const window_stats_t *stats, uint32_t now_ms){
+    window_stats_result_t result, reference;
+    uint32_t from;
+    uint8_t tier;
+
+    for (tier = 0; tier < WINDOW_STATS_TIERS; tier++){
+        /* the current bucket of a ring starts with the current bucket of the ring above */
+        from = stats->start_ms[tier] - (buckets[tier] - 1) * bucket_ms[tier];
+        if ((int32_t) (from - sample_ms[0]) < 0){
+            from = sample_ms[0];
+        }
+        assert(window_stats_result(stats, tier, 0, &result));
+        expected(from, now_ms, &reference);
+        assert(result.count == reference.count);
+        assert(result.min == reference.min && result.max == reference.max);
+        assert(fabsf(result.mean - reference.mean) <= 1e-4f * fabsf(reference.mean));
+        assert(fabsf(result.twa - reference.twa) <= 1e-4f * fabsf(reference.twa));
+    }
+}
+
+
+/* a noisy level sampled every 1 to 10 s over two days, checked every few minutes */
+static void check_irregular(void){
+    window_stats_t stats = { 0 };
+    uint32_t now = 5000, publishes = 0, checks = 0;
+
+    samples = 0;
+    while (samples < MAX_SAMPLES && now < 2 * 24 * HOUR_MS){
+        sample_ms[samples] = now;
+        sample_value[samples] = 10 + 5 * sinf(now / 3.6e6f) + noise(100) / 50.0f;
+        publishes += window_stats_add(&stats, sample_value[samples], now);
+        samples++;
+        if (samples % 97 == 0){
+            check_windows(&stats, now);
+            checks++;
+        }
+        now += 1000 + noise(9001);
+    }
+    /* once at the start and then at the first sample a minute after the last */
+    assert(publishes <= (now - sample_ms[0]) / WINDOW_STATS_PUBLISH_MS + 1);
+    assert(publishes >= (now - sample_ms[0]) / (WINDOW_STATS_PUBLISH_MS + 10000));
+    printf("%s: %u samples, %u checks of the three windows, %u publishes\n", __func__, samples, checks, publishes);
+}
+
+
+/* each hour at a level of its own, so the oldest hour of the span is steady */
+static void check_exposure(void){
+    window_stats_t stats = { 0 };
+    window_stats_result_t exposure, eight_hours, buckets8;
+    uint32_t now, end = 30 * HOUR_MS + 20 * 60 * 1000;
+    double reference = 0;
+    int hour;
+
+    for (now = 0; now <= end; now += 3000){
+        window_stats_add(&stats, now / HOUR_MS, now);
+    }
+    now -= 3000;
+
+    /* 40 min of hour 22, hours 23 to 29 and the 20 min of hour 30 so far */
+    reference = 22 * 40.0;
+    for (hour = 23; hour < 30; hour++){
+        reference += hour * 60.0;
+    }
+    reference = (reference + 30 * 20.0) / (8 * 60);
+
+    assert(window_stats_span(&stats, 8 * HOUR_MS, &eight_hours));
+    assert(fabs(eight_hours.twa - reference) <= 1e-4 * reference);
+    assert(eight_hours.max == 30 && eight_hours.min == 22);
+
+    /* the 8 newest hourly buckets fall short by the 40 min of the one still filling */
+    assert(window_stats_result(&stats, WINDOW_STATS_DAY, 8, &buckets8));
+    assert(buckets8.twa > reference + 0.1);
+
+    /* a span within the current hour, and one longer than there are samples */
+    assert(window_stats_span(&stats, 10 * 60 * 1000, &exposure) && exposure.twa == 30);
+    stats = (window_stats_t) { 0 };
+    for (now = 0; now <= 2 * HOUR_MS; now += 3000){
+        window_stats_add(&stats, now < HOUR_MS ? 1 : 3, now);
+    }
+    assert(window_stats_span(&stats, 8 * HOUR_MS, &exposure));
+    assert(fabsf(exposure.twa - 2) <= 1e-3f);
+    printf("%s: 8 h average %.4f, %.4f expected, %.4f from the 8 newest hourly buckets\n", __func__,
+           eight_hours.twa, reference, buckets8.twa);
+}
+
+
+int main(void){
+    check_irregular();
+    check_exposure();
+    return 0;
+}
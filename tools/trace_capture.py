@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+"""Capture the sensor trace broadcasts into a file for tools/replay.
+
+    tools/trace_capture.py trace.bin [--port 45681]
+
+Pages are appended as they arrive, stop with Ctrl-C.
+"""
+
+import argparse
+import socket
+import struct
+
+PAGE_SIZE = 256
+PAGE_MAGIC = 0x5254
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output")
+    parser.add_argument("--port", type=int, default=45681)
+    options = parser.parse_args()
+
+    listener = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("", options.port))
+    pages = 0
+    expected = None
+    with open(options.output, "ab") as output:
+        try:
+            while True:
+                page, sender = listener.recvfrom(2048)
+                if len(page) != PAGE_SIZE or struct.unpack_from("<H", page)[0] != PAGE_MAGIC:
+                    continue
+                sequence = struct.unpack_from("<I", page, 4)[0]
+                if expected is not None and sequence != expected:
+                    print("gap before page %d" % sequence)
+                expected = sequence + 1
+                output.write(page)
+                output.flush()
+                pages += 1
+        except KeyboardInterrupt:
+            pass
+    print("%d pages captured" % pages)
+
+
+if __name__ == "__main__":
+    main()